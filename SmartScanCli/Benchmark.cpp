@@ -0,0 +1,1696 @@
+#include <iostream>
+#include <iomanip>
+#include <algorithm>
+#include <numeric>
+#include <thread>
+#include <chrono>
+#include <atomic>
+#include <cmath>
+#include <random>
+#include <fstream>
+#include <sstream>
+#include <cstdio>
+#include <cstring>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/resource.h>
+#endif
+
+#include "Benchmark.h"
+#include "FrameRing.h"
+#include "MockFileDevice.h"
+#include "DataAcquisition.h"
+#include "SyntheticDevice.h"
+#include "Scan.h"
+#include "CellGrid.h"
+#include "RefIndex.h"
+#include "AngleBins.h"
+#include "EqualAreaBins.h"
+#include "FilterEngine.h"
+#include "RawStore.h"
+#include "ThreadPool.h"
+#include "SmartScanService.h"
+#include "CSVExport.h"
+#include "CloudExport.h"
+#include "SessionArchive.h"
+#include "SessionJournal.h"
+#include "ReplayDevice.h"
+
+using namespace SmartScan;
+
+void PrintLatencyStats(const std::string& name, std::vector<double>& samplesUs)
+{
+	if (samplesUs.empty()) {
+		std::cout << std::setw(24) << std::left << name << "no samples" << std::endl;
+		return;
+	}
+
+	std::sort(samplesUs.begin(), samplesUs.end());
+	double mean = std::accumulate(samplesUs.begin(), samplesUs.end(), 0.0) / samplesUs.size();
+	double p99 = samplesUs[(size_t)(0.99 * (samplesUs.size() - 1))];
+
+	std::streamsize precision = std::cout.precision();
+	std::cout << std::setw(24) << std::left << name << std::right << std::fixed << std::setprecision(2);
+	std::cout << "mean " << std::setw(9) << mean << " us   p99 " << std::setw(9) << p99 << " us   max " << std::setw(9) << samplesUs.back() << " us   (" << samplesUs.size() << " samples)" << std::endl;
+	std::cout.unsetf(std::ios::fixed);
+	std::cout.precision(precision);
+}
+
+double ProcessCpuSeconds()
+{
+#ifdef _WIN32
+	FILETIME creation, exit, kernel, user;
+	GetProcessTimes(GetCurrentProcess(), &creation, &exit, &kernel, &user);
+	ULARGE_INTEGER k, u;
+	k.LowPart = kernel.dwLowDateTime;
+	k.HighPart = kernel.dwHighDateTime;
+	u.LowPart = user.dwLowDateTime;
+	u.HighPart = user.dwHighDateTime;
+	return (k.QuadPart + u.QuadPart) * 1e-7;	// FILETIME counts in 100 ns steps.
+#else
+	struct rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+	return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec + (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) * 1e-6;
+#endif
+}
+
+void BenchmarkFrameRing(int numSensors, double measurementRate, double seconds, int numConsumers)
+{
+	typedef std::chrono::steady_clock clock;
+
+	const int numFrames = (int)(measurementRate * seconds);
+
+	FrameRing ring;
+	ring.Init(numSensors, (int)(measurementRate * 8));
+
+	std::vector<clock::time_point> commitTimes(numFrames);				// Time at which every frame was committed.
+	std::vector<double> producerLatency;								// Time spent writing and committing a frame.
+	std::vector<std::vector<double>> consumerLatency(numConsumers);		// Time between commit and read, per consumer.
+	std::vector<int> droppedFrames(numConsumers, 0);
+	std::atomic<bool> producing { true };
+
+	std::cout << "Frame ring: " << numSensors << " sensors, " << measurementRate << " Hz, " << numConsumers << " consumers, " << seconds << " s" << std::endl;
+
+	// Start the consumers, they read every frame at their own cursor like a scan does.
+	std::vector<std::thread> consumers;
+	for (int c = 0; c < numConsumers; c++) {
+		consumers.emplace_back([&, c]() {
+			std::vector<Point3> frame(numSensors);
+			uint64_t cursor = 0;
+			consumerLatency[c].reserve(numFrames);
+
+			while (cursor < (uint64_t)numFrames && (producing || cursor < ring.Committed())) {
+				if (cursor >= ring.Committed()) {
+					ring.WaitForFrame(cursor, producing);
+					continue;
+				}
+				if (!ring.ReadFrame(cursor, frame.data())) {
+					droppedFrames[c] += (int)(ring.Oldest() - cursor);
+					cursor = ring.Oldest();
+					continue;
+				}
+				std::chrono::duration<double, std::micro> latency = clock::now() - commitTimes[cursor];
+				consumerLatency[c].push_back(latency.count());
+				cursor++;
+			}
+		});
+	}
+
+	// Produce frames at the measurement rate.
+	producerLatency.reserve(numFrames);
+	auto period = std::chrono::duration_cast<clock::duration>(std::chrono::duration<double>(1 / measurementRate));
+	auto deadline = clock::now();
+	for (int f = 0; f < numFrames; f++) {
+		deadline += period;
+		std::this_thread::sleep_until(deadline);
+
+		auto start = clock::now();
+		Point3* slot = ring.BeginFrame();
+		for (int i = 0; i < numSensors; i++) {
+			slot[i] = Point3(f, i, 0, 0, 0, 0, 0, 1);
+			slot[i].time = f / measurementRate;
+		}
+		commitTimes[f] = clock::now();
+		ring.CommitFrame();
+
+		std::chrono::duration<double, std::micro> latency = clock::now() - start;
+		producerLatency.push_back(latency.count());
+	}
+	producing = false;
+	ring.WakeAll();
+
+	for (int c = 0; c < numConsumers; c++) {
+		consumers[c].join();
+	}
+
+	// Print the results.
+	PrintLatencyStats("Producer write+commit", producerLatency);
+	std::vector<double> allConsumers;
+	for (int c = 0; c < numConsumers; c++) {
+		allConsumers.insert(allConsumers.end(), consumerLatency[c].begin(), consumerLatency[c].end());
+	}
+	PrintLatencyStats("Consumer commit->read", allConsumers);
+	std::cout << "Dropped frames: " << std::accumulate(droppedFrames.begin(), droppedFrames.end(), 0) << std::endl;
+}
+
+void BenchmarkMockDevice(double measurementRate, double seconds)
+{
+	typedef std::chrono::steady_clock clock;
+
+	// Load and parse the mock data files.
+	MockFileDevice device;
+	auto start = clock::now();
+	device.Configure(DataAcqConfig());
+	std::chrono::duration<double, std::milli> loadTime = clock::now() - start;
+
+	size_t numSamples = 0;
+	std::vector<int> ports = device.GetAttachedPorts();
+	for (int port : ports) {
+		numSamples += device.NumSamples(port);
+	}
+	std::cout << "Mock data: " << ports.size() << " files, " << numSamples << " samples loaded in " << loadTime.count() << " ms" << std::endl;
+
+	// Read frames as fast as possible.
+	const int numReads = 1000000;
+	std::vector<Point3> frame;
+	Point3Ref ref;
+	double checksum = 0;
+	start = clock::now();
+	for (int f = 0; f < numReads; f++) {
+		device.GetFrame(&frame, &ref);
+		checksum += frame[0].x;
+	}
+	std::chrono::duration<double, std::nano> readTime = clock::now() - start;
+	std::cout << "GetFrame: " << readTime.count() / numReads << " ns per frame (checksum " << checksum << ")" << std::endl;
+
+	// Acquire from the mock device at a high rate.
+	DataAcqConfig config;
+	config.measurementRate = measurementRate;
+	DataAcq acq(device_backend::MOCK_FILE);
+	acq.Init(config);
+	double cpu = ProcessCpuSeconds();
+	start = clock::now();
+	acq.Start();
+	std::this_thread::sleep_for(std::chrono::duration<double>(seconds));
+	acq.Stop();
+	std::chrono::duration<double> wall = clock::now() - start;
+	cpu = ProcessCpuSeconds() - cpu;
+
+	// Stop() keeps sampling for a moment, so the achieved rate is computed from the time stamp of the last frame.
+	SamplingStats stats = acq.GetSamplingStats();
+	const RawStore* raw = acq.GetRawBuffer();
+	size_t numFrames = raw->NumFrames();
+	double lastTime = numFrames ? raw->At(0, numFrames - 1).time : 0;
+	std::cout << "Acquisition at " << measurementRate << " Hz: " << numFrames << " frames in " << lastTime << " s (" << (lastTime > 0 ? numFrames / lastTime : 0) << " Hz), " << stats.missedDeadlines << " missed deadlines" << std::endl;
+	std::cout << "Lateness mean: " << stats.meanLateness * 1e6 << " us, max: " << stats.maxLateness * 1e6 << " us" << std::endl;
+	std::cout << "CPU use: " << cpu / wall.count() << " cores" << std::endl;
+}
+
+void BenchmarkSynthetic(int numSensors, double measurementRate, double seconds)
+{
+	// Port 0 of the synthetic device is the reference sensor, the scan sees the foot in the reference sensor frame.
+	DataAcqConfig config;
+	config.measurementRate = measurementRate;
+	config.refSensorSerial = 0;
+	config.synthetic.numSensors = numSensors;
+
+	DataAcq acq(device_backend::SYNTHETIC);
+	acq.Init(config);
+
+	// One reference point in the centre of the foot.
+	ScanConfig scanConfig;
+	scanConfig.inBuff = acq.GetFrameRing();
+	scanConfig.rawBuff = acq.GetRawBuffer();
+	scanConfig.refPoints.push_back(Point3(0, 0, 0));
+	scanConfig.filteringPrecision = 2;
+	scanConfig.stopAtSample = -1;
+	scanConfig.outlierThreshold = 1000;
+	Scan scan(0, scanConfig);
+
+	std::cout << "Synthetic: " << numSensors << " sensors, " << measurementRate << " Hz, " << seconds << " s" << std::endl;
+
+	acq.Start();
+	scan.Run();
+	std::this_thread::sleep_for(std::chrono::duration<double>(seconds));
+	acq.Stop();
+	scan.Stop();
+
+	// Wait for the scan to filter the last frames.
+	while (scan.IsRunning()) {
+		std::this_thread::sleep_for(std::chrono::milliseconds(10));
+	}
+
+	SamplingStats stats = acq.GetSamplingStats();
+	size_t numFrames = acq.GetRawBuffer()->NumFrames();
+	std::cout << "Acquired " << numFrames << " frames, " << stats.missedDeadlines << " missed deadlines, lateness mean " << stats.meanLateness * 1e6 << " us, max " << stats.maxLateness * 1e6 << " us" << std::endl;
+	std::cout << "Scan dropped " << scan.NumDroppedFrames() << " frames" << std::endl;
+
+	// Compare every stored point with the distance to the synthetic surface in its direction.
+	std::vector<Point3> output;
+	scan.CopyOutputBuffer(&output);
+
+	SyntheticDevice truth(config.synthetic);
+	double sumError = 0, sumSquaredError = 0, maxError = 0;
+	for (const Point3& p : output) {
+		double error = std::abs(p.s.r - truth.GroundTruthRadius(scanConfig.refPoints[0], p.s.theta, p.s.phi));
+		sumError += error;
+		sumSquaredError += error * error;
+		maxError = std::max(maxError, error);
+	}
+
+	int numCells = (360 / scanConfig.filteringPrecision) * (180 / scanConfig.filteringPrecision);
+	std::cout << "Filled " << output.size() << " of " << numCells << " cells, " << scan.MemoryUsage() / 1024 << " KB" << std::endl;
+	if (!output.empty()) {
+		std::cout << "Radius error against ground truth: mean " << sumError / output.size() << " mm, rms " << std::sqrt(sumSquaredError / output.size()) << " mm, max " << maxError << " mm (noise " << config.synthetic.noise << " mm)" << std::endl;
+	}
+}
+
+void BenchmarkScanWakeups(int numScans, double seconds)
+{
+	typedef std::chrono::steady_clock clock;
+
+	DataAcqConfig config;
+	config.measurementRate = 255;
+	config.refSensorSerial = 0;
+	config.synthetic.numSensors = 8;
+
+	DataAcq acq(device_backend::SYNTHETIC);
+	acq.Init(config);
+
+	ScanConfig scanConfig;
+	scanConfig.inBuff = acq.GetFrameRing();
+	scanConfig.rawBuff = acq.GetRawBuffer();
+	scanConfig.refPoints.push_back(Point3(0, 0, 0));
+	scanConfig.filteringPrecision = 2;
+	scanConfig.stopAtSample = -1;
+	scanConfig.outlierThreshold = 1000;
+
+	std::vector<std::unique_ptr<Scan>> scans;
+	for (int i = 0; i < numScans; i++) {
+		scans.push_back(std::make_unique<Scan>(i, scanConfig));
+		scans.back()->Run();
+	}
+
+	std::cout << "Scan wake ups: " << numScans << " scans, " << config.synthetic.numSensors << " sensors at " << config.measurementRate << " Hz" << std::endl;
+
+	// Measure how many cores the scans use while they wait for frames without acquisition running.
+	double cpu = ProcessCpuSeconds();
+	auto start = clock::now();
+	std::this_thread::sleep_for(std::chrono::duration<double>(seconds));
+	std::chrono::duration<double> wall = clock::now() - start;
+	std::cout << "Idle:      " << (ProcessCpuSeconds() - cpu) / wall.count() << " cores in use" << std::endl;
+
+	// Measure again while acquisition is running and every scan filters every frame.
+	acq.Start();
+	cpu = ProcessCpuSeconds();
+	start = clock::now();
+	std::this_thread::sleep_for(std::chrono::duration<double>(seconds));
+	wall = clock::now() - start;
+	std::cout << "Acquiring: " << (ProcessCpuSeconds() - cpu) / wall.count() << " cores in use" << std::endl;
+	acq.Stop();
+
+	int dropped = 0;
+	for (auto& scan : scans) {
+		scan->Stop();
+		dropped += scan->NumDroppedFrames();
+	}
+	std::cout << "Frames: " << acq.GetRawBuffer()->NumFrames() << ", dropped by the scans: " << dropped << std::endl;
+}
+
+void BenchmarkRefIndex(int numSamples)
+{
+	typedef std::chrono::steady_clock clock;
+	typedef std::chrono::duration<double, std::nano> nanoseconds;
+
+	std::mt19937 random(1);
+	std::uniform_real_distribution<double> unit(0, 1);
+
+	// The reference points are spread through the synthetic foot, like dense reference points placed over a real foot.
+	SyntheticConfig footConfig;
+	footConfig.numSensors = 8;
+	footConfig.noise = 0;
+	footConfig.moveReference = false;
+	SyntheticDevice foot(footConfig);
+	auto insideFoot = [&]() {
+		Point3 surface = foot.SurfacePoint(0.05 + 0.9 * unit(random), 2 * 3.141592653589793 * unit(random));
+		double depth = unit(random);
+		return Point3(surface.x * depth, surface.y * depth, surface.z * depth);
+	};
+
+	// Two sets of samples: uniformly random ones in a box around the foot, and the stroke paths of the synthetic sensors over the foot surface.
+	std::vector<Point3> boxSamples, strokeSamples;
+	for (int i = 0; i < numSamples; i++) {
+		boxSamples.push_back(Point3(250 * unit(random) - 125, 100 * unit(random) - 50, 80 * unit(random) - 40));
+	}
+	DataAcqConfig config;
+	config.measurementRate = 255;
+	config.synthetic = footConfig;
+	foot.Configure(config);
+	std::vector<Point3> frame;
+	Point3Ref ref;
+	while ((int)strokeSamples.size() < numSamples) {
+		foot.GetFrame(&frame, &ref);
+		for (int s = 1; s < (int)frame.size(); s++) {
+			strokeSamples.push_back(foot.GroundTruth(s));
+		}
+	}
+
+	std::cout << "Reference index: " << numSamples << " samples, time per sample in ns" << std::endl;
+	std::cout << std::setw(8) << "" << std::setw(30) << "random samples in a box" << std::setw(30) << "samples on stroke paths" << std::endl;
+	std::cout << std::setw(8) << "refs" << std::setw(10) << "linear" << std::setw(10) << "tree" << std::setw(10) << "grid" << std::setw(10) << "linear" << std::setw(10) << "tree" << std::setw(10) << "grid" << std::setw(14) << "mismatches" << std::endl;
+
+	for (int numRefs = 1; numRefs <= 1024; numRefs *= 2) {
+		std::vector<Point3> refs;
+		for (int i = 0; i < numRefs; i++) {
+			refs.push_back(insideFoot());
+		}
+		RefIndex index;
+		index.Build(refs);
+
+		std::cout << std::fixed << std::setprecision(1) << std::setw(8) << numRefs;
+
+		int mismatches = 0;
+		for (const std::vector<Point3>* samples : { &boxSamples, &strokeSamples }) {
+			std::vector<int> linearResult(numSamples), treeResult(numSamples), gridResult(numSamples);
+			double distance;
+
+			// Keep the fastest of a few runs, to filter out interruptions by other processes.
+			nanoseconds linearTime = std::chrono::hours(1), treeTime = std::chrono::hours(1), gridTime = std::chrono::hours(1);
+			for (int run = 0; run < 5; run++) {
+				auto start = clock::now();
+				for (int i = 0; i < numSamples; i++) {
+					linearResult[i] = index.NearestLinear((*samples)[i].x, (*samples)[i].y, (*samples)[i].z, &distance);
+				}
+				linearTime = std::min<nanoseconds>(linearTime, clock::now() - start);
+
+				start = clock::now();
+				for (int i = 0; i < numSamples; i++) {
+					treeResult[i] = index.NearestTree((*samples)[i].x, (*samples)[i].y, (*samples)[i].z, &distance);
+				}
+				treeTime = std::min<nanoseconds>(treeTime, clock::now() - start);
+
+				start = clock::now();
+				for (int i = 0; i < numSamples; i++) {
+					gridResult[i] = index.NearestGrid((*samples)[i].x, (*samples)[i].y, (*samples)[i].z, &distance);
+				}
+				gridTime = std::min<nanoseconds>(gridTime, clock::now() - start);
+			}
+
+			for (int i = 0; i < numSamples; i++) {
+				mismatches += (linearResult[i] != treeResult[i]) + (linearResult[i] != gridResult[i]);
+			}
+			std::cout << std::setw(10) << linearTime.count() / numSamples << std::setw(10) << treeTime.count() / numSamples << std::setw(10) << gridTime.count() / numSamples;
+		}
+
+		std::cout << std::setw(14) << mismatches << std::endl;
+		std::cout.unsetf(std::ios::fixed);
+	}
+	std::cout << "Scans search linearly up to " << RefIndex::linearLimit << " reference points and use the grid above that." << std::endl;
+}
+
+void BenchmarkAngleBins(int numSamples)
+{
+	typedef std::chrono::steady_clock clock;
+	typedef std::chrono::duration<double, std::nano> nanoseconds;
+
+	std::mt19937 random(1);
+	std::uniform_real_distribution<double> unit(0, 1);
+
+	// Two sets of samples around a reference point in the centre of the foot: uniformly random ones in a box, and the stroke paths of the synthetic sensors.
+	// The radius is filled in the same way as Scan::CalcNearestRef() does.
+	const Point3 refPoint(0, 0, 0);
+	auto withRadius = [&](Point3 point) {
+		point.s.r = (float)sqrt(point.x * point.x + point.y * point.y + point.z * point.z);
+		return point;
+	};
+	// The sets are kept small enough to stay in the cache, like a frame that is binned right after it is read.
+	const int setSize = 4096;
+	std::vector<Point3> boxSamples, strokeSamples;
+	for (int i = 0; i < setSize; i++) {
+		boxSamples.push_back(withRadius(Point3(250 * unit(random) - 125, 100 * unit(random) - 50, 80 * unit(random) - 40)));
+	}
+	SyntheticConfig footConfig;
+	footConfig.numSensors = 8;
+	footConfig.moveReference = false;
+	SyntheticDevice foot(footConfig);
+	DataAcqConfig config;
+	config.measurementRate = 255;
+	config.synthetic = footConfig;
+	foot.Configure(config);
+	std::vector<Point3> frame;
+	Point3Ref ref;
+	while ((int)strokeSamples.size() < setSize) {
+		foot.GetFrame(&frame, &ref);
+		for (int s = 1; s < (int)frame.size(); s++) {
+			strokeSamples.push_back(withRadius(foot.GroundTruth(s)));
+		}
+	}
+
+	// Samples on the Z axis, where the radius rounded to a float is smaller than the distance along Z, at the poles, at exactly 180 degrees theta
+	// and on the reference point itself. They are not timed, only checked.
+	std::vector<Point3> edgeSamples;
+	for (const Point3& point : { Point3(1e-9, 0, 100.00000001), Point3(1e-9, 0, -100.00000001), Point3(0, 0, 100), Point3(0, 0, -100),
+		Point3(-100, 0, 10), Point3(-100, -0.0, 10), Point3(-100, 1e-12, -30), Point3(0, 0, 0) }) {
+		edgeSamples.push_back(withRadius(point));
+	}
+
+	std::cout << "Angle bins: " << numSamples << " samples, time per sample in ns" << std::endl;
+	std::cout << std::setw(10) << "" << std::setw(20) << "random samples" << std::setw(20) << "stroke samples" << std::endl;
+	std::cout << std::setw(10) << "precision" << std::setw(10) << "exact" << std::setw(10) << "kernel" << std::setw(10) << "exact" << std::setw(10) << "kernel" << std::setw(14) << "mismatches"
+		<< std::setw(14) << "edge errors" << std::endl;
+
+	for (int precision : { 1, 2, 5, 7, 10 }) {
+		AngleBins bins(precision);
+		std::cout << std::fixed << std::setprecision(1) << std::setw(10) << precision;
+
+		int mismatches = 0;
+		for (const std::vector<Point3>* samples : { &boxSamples, &strokeSamples }) {
+			std::vector<int> exactTheta(setSize), exactPhi(setSize), theta(setSize), phi(setSize);
+
+			// Keep the fastest of a few runs, to filter out interruptions by other processes.
+			nanoseconds exactTime = std::chrono::hours(1), kernelTime = std::chrono::hours(1);
+			for (int run = 0; run < 5; run++) {
+				auto start = clock::now();
+				for (int i = 0; i < numSamples; i++) {
+					int s = i % setSize;
+					bins.BinExact(refPoint, (*samples)[s], &exactTheta[s], &exactPhi[s]);
+				}
+				exactTime = std::min<nanoseconds>(exactTime, clock::now() - start);
+
+				start = clock::now();
+				for (int i = 0; i < numSamples; i++) {
+					int s = i % setSize;
+					bins.Bin(refPoint, (*samples)[s], &theta[s], &phi[s]);
+				}
+				kernelTime = std::min<nanoseconds>(kernelTime, clock::now() - start);
+			}
+
+			for (int i = 0; i < setSize; i++) {
+				mismatches += exactTheta[i] != theta[i] || exactPhi[i] != phi[i];
+			}
+			std::cout << std::setw(10) << exactTime.count() / numSamples << std::setw(10) << kernelTime.count() / numSamples;
+		}
+
+		// Both have to give the same bin, within the grid of the scan.
+		int edgeErrors = 0;
+		for (const Point3& point : edgeSamples) {
+			int exactTheta, exactPhi, theta, phi;
+			bins.BinExact(refPoint, point, &exactTheta, &exactPhi);
+			bins.Bin(refPoint, point, &theta, &phi);
+			edgeErrors += exactTheta != theta || exactPhi != phi || theta < 0 || theta >= 360 / precision || phi < 0 || phi >= 180 / precision;
+		}
+
+		std::cout << std::setw(14) << mismatches << std::setw(14) << edgeErrors << std::endl;
+		std::cout.unsetf(std::ios::fixed);
+	}
+}
+
+void BenchmarkFilterEngine(int numVariants, int numFrames)
+{
+	// Record a synthetic session into a frame ring and a raw store that are big enough to hold all of it, so no frames are dropped.
+	DataAcqConfig config;
+	config.measurementRate = 1000;
+	config.synthetic.numSensors = 16;
+	config.synthetic.moveReference = false;
+	SyntheticDevice device;
+	device.Configure(config);
+
+	const int numSensors = config.synthetic.numSensors;
+	FrameRing ring;
+	ring.Init(numSensors, numFrames);
+	RawStore raw;
+	raw.Init(numSensors, config.measurementRate);
+	std::vector<Point3> records;
+	Point3Ref ref;
+	for (int f = 0; f < numFrames; f++) {
+		device.GetFrame(&records, &ref);
+		Point3* frame = ring.BeginFrame();
+		std::copy(records.begin() + 1, records.end(), frame);
+		raw.AppendFrame(frame);
+		ring.CommitFrame();
+	}
+
+	// Parameter variants of one scan: the same reference points along the foot, with different bin sizes and outlier thresholds.
+	const int precisions[] = { 1, 2, 3, 5, 6, 10 };
+	std::vector<ScanConfig> variants;
+	for (int v = 0; v < numVariants; v++) {
+		ScanConfig scanConfig;
+		scanConfig.inBuff = &ring;
+		scanConfig.rawBuff = &raw;
+		for (int r = 0; r < 5; r++) {
+			scanConfig.refPoints.push_back(Point3(-100 + 50 * r, 0, 0));
+		}
+		scanConfig.filteringPrecision = precisions[v % 6];
+		scanConfig.stopAtSample = -1;
+		scanConfig.outlierThreshold = 60 + 20 * (v / 6);
+		variants.push_back(scanConfig);
+	}
+
+	std::cout << "Filter engine: " << numVariants << " variants of a scan, " << numFrames << " frames of " << numSensors << " sensors" << std::endl;
+
+	// Filter the session with one thread per scan, and with the engine. The Stop() calls sleep, so CPU time is measured instead of wall time.
+	for (int engineRun = 0; engineRun < 2; engineRun++) {
+		for (int count : { 1, numVariants }) {
+			FilterEngine engine(&ring);
+			std::vector<std::shared_ptr<Scan>> scans;
+			for (int v = 0; v < count; v++) {
+				scans.push_back(std::make_shared<Scan>(v, variants[v], engineRun ? &engine : nullptr));
+				if (engineRun) {
+					engine.Add(scans.back());
+				}
+			}
+
+			// Only the filtering is measured, creating the scans allocates and clears their cells.
+			double cpu = ProcessCpuSeconds();
+			for (auto& scan : scans) {
+				scan->Run();
+			}
+			for (auto& scan : scans) {
+				scan->Stop();
+			}
+			if (engineRun) {
+				engine.Wait();
+			}
+			else {
+				// The destructors wait for the threads to catch up.
+				scans.clear();
+			}
+			cpu = ProcessCpuSeconds() - cpu;
+
+			std::cout << std::setw(12) << (engineRun ? "engine" : "own threads") << std::setw(4) << count << (count == 1 ? " scan:  " : " scans: ") << std::fixed << std::setprecision(1) << std::setw(8) << cpu * 1e3 << " ms CPU, "
+				<< std::setw(6) << cpu * 1e9 / ((double)numFrames * numSensors) << " ns per sample" << std::endl;
+			std::cout.unsetf(std::ios::fixed);
+		}
+	}
+}
+
+void BenchmarkRefilter(int maxThreads, int numFrames)
+{
+	typedef std::chrono::steady_clock clock;
+
+	if (maxThreads <= 0) {
+		maxThreads = std::max((int)std::thread::hardware_concurrency(), 1);
+	}
+
+	// Record a synthetic session into a raw store. The frame ring is only needed to create the scan.
+	DataAcqConfig config;
+	config.measurementRate = 1000;
+	config.synthetic.numSensors = 16;
+	SyntheticDevice device;
+	device.Configure(config);
+
+	const int numSensors = config.synthetic.numSensors;
+	FrameRing ring;
+	ring.Init(numSensors, 1);
+	RawStore raw;
+	raw.Init(numSensors, config.measurementRate);
+	std::vector<Point3> records;
+	Point3Ref ref;
+	for (int f = 0; f < numFrames; f++) {
+		device.GetFrame(&records, &ref);
+		raw.AppendFrame(records.data() + 1);
+	}
+
+	// The reference pose moves, so the samples are spread over a large volume and many cells.
+	ScanConfig scanConfig;
+	scanConfig.inBuff = &ring;
+	scanConfig.rawBuff = &raw;
+	for (int r = 0; r < 5; r++) {
+		scanConfig.refPoints.push_back(Point3(100 + 50 * r, 0, 100));
+	}
+	scanConfig.filteringPrecision = 1;
+	scanConfig.stopAtSample = -1;
+	scanConfig.outlierThreshold = 200;
+	Scan scan(0, scanConfig);
+
+	std::cout << "Refilter: " << numFrames << " frames of " << numSensors << " sensors" << std::endl;
+
+	std::vector<Point3> reference, cells;
+	double singleTime = 0;
+	for (int numThreads = 1; numThreads <= maxThreads; numThreads = numThreads < maxThreads ? std::min(numThreads * 2, maxThreads) : numThreads + 1) {
+		ThreadPool pool(numThreads);
+
+		// Keep the fastest of a few runs, to filter out interruptions by other processes.
+		std::chrono::duration<double> time = std::chrono::hours(1);
+		for (int run = 0; run < 3; run++) {
+			auto start = clock::now();
+			scan.Refilter(numThreads > 1 ? &pool : nullptr);
+			time = std::min<std::chrono::duration<double>>(time, clock::now() - start);
+		}
+
+		// Compare the cells with the ones of the single thread.
+		cells.clear();
+		scan.CopyOutputBuffer(&cells);
+		if (numThreads == 1) {
+			reference = cells;
+			singleTime = time.count();
+		}
+		bool identical = cells.size() == reference.size();
+		for (size_t i = 0; identical && i < cells.size(); i++) {
+			identical = cells[i].x == reference[i].x && cells[i].y == reference[i].y && cells[i].z == reference[i].z && cells[i].time == reference[i].time && cells[i].s.r == reference[i].s.r;
+		}
+
+		std::cout << std::setw(4) << numThreads << (numThreads == 1 ? " thread:  " : " threads: ") << std::fixed << std::setprecision(1) << std::setw(8) << time.count() * 1e3 << " ms, speed-up "
+			<< std::setprecision(2) << singleTime / time.count() << ", " << cells.size() << " cells, " << (identical ? "identical" : "DIFFERENT") << std::endl;
+		std::cout.unsetf(std::ios::fixed);
+	}
+}
+
+void BenchmarkSweep(int numVariants, int numFrames)
+{
+	typedef std::chrono::steady_clock clock;
+
+	// Record a synthetic session into a raw store, like a session recorded with the service.
+	DataAcqConfig config;
+	config.measurementRate = 255;
+	config.synthetic.numSensors = 16;
+	config.synthetic.moveReference = false;
+	SyntheticDevice device;
+	device.Configure(config);
+
+	const int numSensors = config.synthetic.numSensors;
+	RawStore raw;
+	raw.Init(numSensors, config.measurementRate);
+	std::vector<Point3> records;
+	Point3Ref ref;
+	for (int f = 0; f < numFrames; f++) {
+		device.GetFrame(&records, &ref);
+		raw.AppendFrame(records.data() + 1);
+	}
+
+	// Variants of a scan with reference points along the foot: every filtering precision with a tight and a loose outlier threshold.
+	const int precisions[] = { 1, 2, 3, 5, 6, 10 };
+	std::vector<ScanConfig> variants;
+	for (int v = 0; v < numVariants; v++) {
+		ScanConfig scanConfig;
+		for (int r = 0; r < 5; r++) {
+			scanConfig.refPoints.push_back(Point3(100 + 50 * r, 0, 100));
+		}
+		scanConfig.filteringPrecision = precisions[v % 6];
+		scanConfig.stopAtSample = -1;
+		scanConfig.outlierThreshold = (v / 6) % 2 ? 35 : 60;
+		variants.push_back(scanConfig);
+	}
+
+	SmartScanService service(device_backend::SYNTHETIC);
+	double cpu = ProcessCpuSeconds();
+	auto start = clock::now();
+	std::vector<SweepResult> results = service.SweepScans(variants, &raw);
+	std::chrono::duration<double> wall = clock::now() - start;
+	cpu = ProcessCpuSeconds() - cpu;
+
+	std::cout << "Sweep: " << numVariants << " variants of a scan, " << numFrames << " frames of " << numSensors << " sensors (" << numFrames / config.measurementRate << " s of scanning)" << std::endl;
+	std::cout << std::setw(10) << "precision" << std::setw(11) << "threshold" << std::setw(14) << "filled cells" << std::setw(10) << "filled" << std::setw(18) << "mean radius (mm)" << std::endl;
+	for (const SweepResult& result : results) {
+		std::cout << std::fixed << std::setprecision(1) << std::setw(10) << result.config.filteringPrecision << std::setw(11) << result.config.outlierThreshold
+			<< std::setw(14) << result.filledCells << std::setw(9) << 100.0 * result.filledCells / result.numCells << "%" << std::setw(18) << result.meanRadius << std::endl;
+	}
+	std::cout << "Wall time: " << std::setprecision(2) << wall.count() << " s, CPU time: " << cpu << " s" << std::endl;
+	std::cout.unsetf(std::ios::fixed);
+}
+
+void BenchmarkLiveDelta(double seconds, int pollInterval)
+{
+	typedef std::chrono::steady_clock clock;
+
+	// Every poll of a grid has to give exactly the cells that were updated since the previous poll: 100 updates, 1 update and none.
+	{
+		CellGrid grid;
+		grid.Init(1, 64, 64, true);
+		uint32_t since = 0;
+		std::vector<size_t> changed;
+		const size_t updates[] = { 100, 1, 0 };
+		size_t numUpdated = 0, numReported = 0;
+		bool exact = true;
+		for (size_t numUpdates : updates) {
+			for (size_t u = 0; u < numUpdates; u++) {
+				grid.Update(numUpdated++, 1.0f, 0);
+			}
+			uint32_t next = grid.NextVersion();
+			changed.clear();
+			grid.ChangedSince(since, &changed);
+			since = next;
+			exact = exact && changed.size() == numUpdates;
+			numReported += changed.size();
+		}
+		std::cout << "Change tracking: " << numReported << " cells reported for " << numUpdated << " updated cells, " << (exact ? "exact" : "NOT exact") << " per poll" << std::endl;
+	}
+
+	DataAcqConfig config;
+	config.measurementRate = 255;
+	config.refSensorSerial = 0;
+	config.synthetic.numSensors = 16;
+
+	DataAcq acq(device_backend::SYNTHETIC);
+	acq.Init(config);
+
+	// A scan with reference points along the foot and the finest filtering precision, the largest output buffer a view has to show.
+	ScanConfig scanConfig;
+	scanConfig.inBuff = acq.GetFrameRing();
+	scanConfig.rawBuff = acq.GetRawBuffer();
+	for (int r = 0; r < 5; r++) {
+		scanConfig.refPoints.push_back(Point3(-100 + 50 * r, 0, 0));
+	}
+	scanConfig.filteringPrecision = 1;
+	scanConfig.stopAtSample = -1;
+	scanConfig.outlierThreshold = 1000;
+	Scan scan(0, scanConfig);
+
+	std::cout << "Live view: " << config.synthetic.numSensors << " sensors at " << config.measurementRate << " Hz, " << scan.NumCells() << " cells, a poll every " << pollInterval << " ms for " << seconds << " s" << std::endl;
+
+	// The view keeps its own copy of the cells, and only applies the changes to it.
+	std::vector<Point3> view(scan.NumCells());
+	std::vector<bool> filled(scan.NumCells(), false);
+	std::vector<Point3> full, changes;
+	std::vector<size_t> cells;
+	std::vector<double> fullUs, changesUs;
+	size_t fullPoints = 0, changedPoints = 0, repeatedPoints = 0;
+	uint32_t version = 0;
+
+	auto poll = [&]() {
+		full.clear();
+		auto start = clock::now();
+		scan.CopyOutputBuffer(&full);
+		fullUs.push_back(std::chrono::duration<double, std::micro>(clock::now() - start).count());
+		fullPoints += full.size();
+
+		changes.clear();
+		cells.clear();
+		bool reset = false;
+		start = clock::now();
+		version = scan.CopyChanges(version, &changes, &cells, &reset);
+		changesUs.push_back(std::chrono::duration<double, std::micro>(clock::now() - start).count());
+		changedPoints += changes.size();
+
+		if (reset) {
+			std::fill(filled.begin(), filled.end(), false);
+		}
+		for (size_t i = 0; i < changes.size(); i++) {
+			// A cell that an earlier poll already gave with the same sample was reported twice.
+			const Point3& old = view[cells[i]];
+			if (filled[cells[i]] && old.x == changes[i].x && old.y == changes[i].y && old.z == changes[i].z && old.s.r == changes[i].s.r) {
+				repeatedPoints++;
+			}
+			view[cells[i]] = changes[i];
+			filled[cells[i]] = true;
+		}
+	};
+
+	acq.Start();
+	scan.Run();
+	auto end = clock::now() + std::chrono::duration_cast<clock::duration>(std::chrono::duration<double>(seconds));
+	while (clock::now() < end) {
+		std::this_thread::sleep_for(std::chrono::milliseconds(pollInterval));
+		poll();
+	}
+	acq.Stop();
+	scan.Stop();
+	while (scan.IsRunning()) {
+		std::this_thread::sleep_for(std::chrono::milliseconds(10));
+	}
+
+	// One last poll picks up the frames filtered after acquisition stopped, after that the view has to match the scan.
+	poll();
+	size_t numPolls = fullUs.size();
+
+	// Nothing was filtered since, so another poll has no changes.
+	changes.clear();
+	scan.CopyChanges(version, &changes);
+	size_t emptyPoll = changes.size();
+	int mismatches = 0;
+	size_t p = 0;
+	for (size_t c = 0; c < view.size(); c++) {
+		if (!filled[c]) {
+			continue;
+		}
+		if (p >= full.size() || view[c].x != full[p].x || view[c].y != full[p].y || view[c].z != full[p].z || view[c].s.r != full[p].s.r) {
+			mismatches++;
+		}
+		p++;
+	}
+	if (p != full.size()) {
+		mismatches++;
+	}
+
+	std::cout << "Full copy:    " << fullPoints / numPolls << " points per poll" << std::endl;
+	PrintLatencyStats("  time per poll", fullUs);
+	std::cout << "Changes only: " << changedPoints / numPolls << " points per poll" << std::endl;
+	PrintLatencyStats("  time per poll", changesUs);
+	std::cout << "View after " << numPolls << " polls: " << full.size() << " points, " << mismatches << " mismatches with a full copy, "
+		<< repeatedPoints << " points reported twice, " << emptyPoll << " points in a poll without new frames" << std::endl;
+}
+
+void BenchmarkSnapshot(double seconds, double measurementRate)
+{
+	typedef std::chrono::steady_clock clock;
+
+	DataAcqConfig config;
+	config.measurementRate = measurementRate;
+	config.refSensorSerial = 0;
+	config.synthetic.numSensors = 16;
+
+	DataAcq acq(device_backend::SYNTHETIC);
+	acq.Init(config);
+
+	ScanConfig scanConfig;
+	scanConfig.inBuff = acq.GetFrameRing();
+	scanConfig.rawBuff = acq.GetRawBuffer();
+	for (int r = 0; r < 5; r++) {
+		scanConfig.refPoints.push_back(Point3(-100 + 50 * r, 0, 0));
+	}
+	scanConfig.filteringPrecision = 1;
+	scanConfig.stopAtSample = -1;
+	scanConfig.outlierThreshold = 1000;
+	Scan scan(0, scanConfig);
+
+	std::cout << "Snapshots: " << config.synthetic.numSensors << " sensors at " << measurementRate << " Hz, " << scan.NumCells() << " cells, " << seconds << " s" << std::endl;
+
+	// Keep a few consistent snapshots, spread over the run, to check them afterwards.
+	struct Kept
+	{
+		int frames;
+		std::vector<Point3> points;
+	};
+	std::vector<Kept> kept;
+	std::vector<double> snapshotUs;
+	std::vector<Point3> points;
+	int numConsistent = 0;
+
+	acq.Start();
+	scan.Run();
+	auto start = clock::now();
+	auto end = start + std::chrono::duration_cast<clock::duration>(std::chrono::duration<double>(seconds));
+	while (clock::now() < end) {
+		points.clear();
+		bool consistent = false;
+		auto before = clock::now();
+		int frames = scan.CopySnapshot(&points, &consistent);
+		snapshotUs.push_back(std::chrono::duration<double, std::micro>(clock::now() - before).count());
+
+		if (consistent) {
+			numConsistent++;
+			if (kept.size() < 4 && clock::now() - start > (end - start) * (int)(kept.size() + 1) / 5) {
+				kept.push_back(Kept { frames, points });
+			}
+		}
+	}
+	acq.Stop();
+	scan.Stop();
+	while (scan.IsRunning()) {
+		std::this_thread::sleep_for(std::chrono::milliseconds(10));
+	}
+
+	size_t numSnapshots = snapshotUs.size();
+	std::cout << "Acquired " << acq.GetRawBuffer()->NumFrames() << " frames, the scan dropped " << scan.NumDroppedFrames() << std::endl;
+	std::cout << numSnapshots << " snapshots, " << numConsistent << " consistent" << std::endl;
+	PrintLatencyStats("Time per snapshot", snapshotUs);
+
+	// Filter the recorded frames again up to the frames of every kept snapshot, the cells have to be exactly the same.
+	for (const Kept& k : kept) {
+		ScanConfig checkConfig = scanConfig;
+		checkConfig.stopAtSample = k.frames;
+		Scan check(1, checkConfig);
+		check.Refilter();
+		points.clear();
+		check.CopyOutputBuffer(&points);
+
+		bool same = points.size() == k.points.size();
+		for (size_t i = 0; same && i < points.size(); i++) {
+			same = points[i].x == k.points[i].x && points[i].y == k.points[i].y && points[i].z == k.points[i].z && points[i].s.r == k.points[i].s.r;
+		}
+		std::cout << "Snapshot after " << k.frames << " frames, " << k.points.size() << " points: " << (same ? "same as refiltered" : "DIFFERENT from refiltered") << std::endl;
+	}
+}
+
+void BenchmarkSparseCells(int numFrames)
+{
+	typedef std::chrono::steady_clock clock;
+	typedef std::chrono::duration<double, std::milli> milliseconds;
+
+	// Record a synthetic session into a raw store.
+	DataAcqConfig config;
+	config.measurementRate = 255;
+	config.synthetic.numSensors = 16;
+	config.synthetic.moveReference = false;
+	SyntheticDevice device;
+	device.Configure(config);
+
+	const int numSensors = config.synthetic.numSensors;
+	FrameRing ring;
+	ring.Init(numSensors, 2);
+	RawStore raw;
+	raw.Init(numSensors, config.measurementRate);
+	std::vector<Point3> records;
+	Point3Ref ref;
+	for (int f = 0; f < numFrames; f++) {
+		device.GetFrame(&records, &ref);
+		raw.AppendFrame(records.data() + 1);
+	}
+
+	// The reference points are spread through the synthetic foot.
+	std::mt19937 random(1);
+	std::uniform_real_distribution<double> unit(0, 1);
+	std::vector<Point3> refPoints;
+	for (int r = 0; r < 160; r++) {
+		Point3 surface = device.SurfacePoint(0.05 + 0.9 * unit(random), 2 * 3.141592653589793 * unit(random));
+		double depth = unit(random);
+		refPoints.push_back(Point3(surface.x * depth, surface.y * depth, surface.z * depth));
+	}
+
+	std::cout << "Sparse cells: " << numFrames << " frames of " << numSensors << " sensors, filtering precision 1" << std::endl;
+	std::cout << std::setw(6) << "refs" << std::setw(8) << "cells" << std::setw(10) << "create" << std::setw(12) << "filter" << std::setw(12) << "memory" << std::endl;
+	std::cout << std::fixed << std::setprecision(1);
+	for (int numRefs : { 5, 20, 80, 160 }) {
+		ScanConfig scanConfig;
+		scanConfig.inBuff = &ring;
+		scanConfig.rawBuff = &raw;
+		scanConfig.refPoints.assign(refPoints.begin(), refPoints.begin() + numRefs);
+		scanConfig.filteringPrecision = 1;
+		scanConfig.stopAtSample = -1;
+		scanConfig.outlierThreshold = 1000;
+
+		std::vector<Point3> output[2];
+		for (int sparse = 0; sparse < 2; sparse++) {
+			scanConfig.cellMemoryBudget = sparse ? 0 : SIZE_MAX;
+			auto start = clock::now();
+			Scan scan(0, scanConfig);
+			milliseconds create = clock::now() - start;
+			start = clock::now();
+			scan.Refilter();
+			milliseconds filter = clock::now() - start;
+			scan.CopyOutputBuffer(&output[sparse]);
+
+			std::cout << std::setw(6) << numRefs << std::setw(8) << (sparse ? "sparse" : "dense") << std::setw(7) << create.count() << " ms" << std::setw(9) << filter.count() << " ms"
+				<< std::setw(9) << scan.MemoryUsage() / (1024.0 * 1024.0) << " MB" << std::endl;
+		}
+
+		bool same = output[0].size() == output[1].size();
+		for (size_t i = 0; same && i < output[0].size(); i++) {
+			same = output[0][i].x == output[1][i].x && output[0][i].y == output[1][i].y && output[0][i].z == output[1][i].z && output[0][i].s.r == output[1][i].s.r;
+		}
+		std::cout << std::setw(6) << numRefs << "  " << output[0].size() << " filled cells, " << (same ? "same" : "DIFFERENT") << std::endl;
+	}
+	std::cout.unsetf(std::ios::fixed);
+}
+
+void BenchmarkGrids(int numFrames)
+{
+	typedef std::chrono::steady_clock clock;
+	typedef std::chrono::duration<double, std::milli> milliseconds;
+	const double pi = 3.141592653589793;
+	const grid_type gridTypes[] = { grid_type::THETA_PHI, grid_type::EQUAL_AREA };
+	const char* gridNames[] = { "theta/phi", "equal-area" };
+
+	// Spread uniformly random directions over the cells of both grids. Equal-area cells get the same number of hits, up to the random spread of 1 / sqrt(hits).
+	const int precision = 5;
+	const int numDirections = 1000000;
+	std::mt19937 random(1);
+	std::normal_distribution<double> normal;
+	AngleBins angleBins(precision);
+	EqualAreaBins equalAreaBins(precision);
+	std::vector<int> hits[2];
+	hits[0].assign((360 / precision) * (180 / precision), 0);
+	hits[1].assign(equalAreaBins.NumCells(), 0);
+	Point3 origin(0, 0, 0);
+	for (int i = 0; i < numDirections; i++) {
+		Point3 p(normal(random), normal(random), normal(random));
+		p.s.r = sqrt(p.x * p.x + p.y * p.y + p.z * p.z);
+		int theta, phi;
+		angleBins.Bin(origin, p, &theta, &phi);
+		hits[0][theta * (180 / precision) + phi]++;
+		hits[1][equalAreaBins.Bin(origin, p)]++;
+	}
+	std::cout << "Grids: " << numDirections << " uniformly random directions at a filtering precision of " << precision << std::endl;
+	for (int g = 0; g < 2; g++) {
+		double mean = (double)numDirections / hits[g].size(), sumSquares = 0;
+		for (int h : hits[g]) {
+			sumSquares += (h - mean) * (h - mean);
+		}
+		auto range = std::minmax_element(hits[g].begin(), hits[g].end());
+		std::cout << std::setw(11) << gridNames[g] << ": " << hits[g].size() << " cells, hits per cell " << *range.first << " to " << *range.second
+			<< ", spread " << sqrt(sumSquares / hits[g].size()) / mean << " (random spread " << 1 / sqrt(mean) << ")" << std::endl;
+	}
+
+	// Record a synthetic session into a raw store.
+	DataAcqConfig config;
+	config.measurementRate = 255;
+	config.synthetic.numSensors = 16;
+	config.synthetic.moveReference = false;
+	SyntheticDevice device;
+	device.Configure(config);
+
+	const int numSensors = config.synthetic.numSensors;
+	FrameRing ring;
+	ring.Init(numSensors, 2);
+	RawStore raw;
+	raw.Init(numSensors, config.measurementRate);
+	std::vector<Point3> records;
+	Point3Ref ref;
+	std::normal_distribution<double> noise(0, config.synthetic.noise);
+	for (int f = 0; f < numFrames; f++) {
+		// Store the samples in the reference sensor frame, where the synthetic foot is centred in the origin.
+		device.GetFrame(&records, &ref);
+		for (int s = 1; s <= numSensors; s++) {
+			Point3 truth = device.GroundTruth(s);
+			records[s] = Point3(truth.x + noise(random), truth.y + noise(random), truth.z + noise(random));
+		}
+		raw.AppendFrame(records.data() + 1);
+	}
+
+	// Filter the session into both grids. The largest cell is the square root of its solid angle, for theta/phi the cells at the equator.
+	std::cout << std::endl << "Session of " << numFrames << " frames of " << numSensors << " sensors, one reference point in the centre of the foot" << std::endl;
+	std::cout << std::setw(10) << "precision" << std::setw(12) << "grid" << std::setw(8) << "cells" << std::setw(15) << "largest cell" << std::setw(8) << "filled"
+		<< std::setw(12) << "filter" << std::setw(16) << "rms error" << std::endl;
+	std::cout << std::fixed;
+	for (int p : { 1, 2, 3, 5 }) {
+		for (int g = 0; g < 2; g++) {
+			ScanConfig scanConfig;
+			scanConfig.inBuff = &ring;
+			scanConfig.rawBuff = &raw;
+			scanConfig.refPoints.push_back(origin);
+			scanConfig.filteringPrecision = p;
+			scanConfig.stopAtSample = -1;
+			scanConfig.outlierThreshold = 1000;
+			scanConfig.gridType = gridTypes[g];
+			Scan scan(0, scanConfig);
+
+			auto start = clock::now();
+			scan.Refilter();
+			milliseconds filter = clock::now() - start;
+			std::vector<Point3> output;
+			scan.CopyOutputBuffer(&output);
+
+			double sumSquaredError = 0;
+			for (const Point3& point : output) {
+				double error = point.s.r - device.GroundTruthRadius(origin, point.s.theta, point.s.phi);
+				sumSquaredError += error * error;
+			}
+			double largest = g ? sqrt(EqualAreaBins(p).CellArea()) * 180 / pi : p;
+			std::cout << std::setw(10) << p << std::setw(12) << gridNames[g] << std::setw(8) << scan.NumCells() << std::setprecision(2) << std::setw(11) << largest << " deg"
+				<< std::setw(8) << output.size() << std::setprecision(1) << std::setw(9) << filter.count() << " ms" << std::setprecision(3) << std::setw(13)
+				<< (output.empty() ? 0 : sqrt(sumSquaredError / output.size())) << " mm" << std::endl;
+		}
+	}
+
+	// Coarse copies of the equal-area grid at the finest precision.
+	ScanConfig scanConfig;
+	scanConfig.inBuff = &ring;
+	scanConfig.rawBuff = &raw;
+	scanConfig.refPoints.push_back(origin);
+	scanConfig.filteringPrecision = 1;
+	scanConfig.stopAtSample = -1;
+	scanConfig.outlierThreshold = 1000;
+	scanConfig.gridType = grid_type::EQUAL_AREA;
+	Scan scan(0, scanConfig);
+	scan.Refilter();
+	std::cout << std::endl << "Coarse copies of the equal-area grid at precision 1" << std::endl;
+	for (int level = 0; level <= EqualAreaBins::maxLevel; level++) {
+		std::vector<Point3> output;
+		auto start = clock::now();
+		scan.CopyCoarse(level, &output);
+		milliseconds copy = clock::now() - start;
+		std::cout << "Level " << level << ": " << std::setw(6) << output.size() << " points, " << std::setprecision(2) << copy.count() << " ms" << std::endl;
+	}
+	std::cout.unsetf(std::ios::fixed);
+}
+
+void BenchmarkCoverage(double seconds)
+{
+	typedef std::chrono::steady_clock clock;
+	typedef std::chrono::duration<double, std::milli> milliseconds;
+
+	// Record a synthetic session into a raw store, with the samples in the reference sensor frame.
+	DataAcqConfig config;
+	config.measurementRate = 255;
+	config.synthetic.numSensors = 16;
+	config.synthetic.moveReference = false;
+	SyntheticDevice device;
+	device.Configure(config);
+
+	const int numSensors = config.synthetic.numSensors;
+	const int numFrames = (int)(seconds * config.measurementRate);
+	FrameRing ring;
+	ring.Init(numSensors, 2);
+	RawStore raw;
+	raw.Init(numSensors, config.measurementRate);
+	std::vector<Point3> records;
+	Point3Ref ref;
+	std::mt19937 random(1);
+	std::normal_distribution<double> noise(0, config.synthetic.noise);
+	for (int f = 0; f < numFrames; f++) {
+		device.GetFrame(&records, &ref);
+		for (int s = 1; s <= numSensors; s++) {
+			Point3 truth = device.GroundTruth(s);
+			records[s] = Point3(truth.x + noise(random), truth.y + noise(random), truth.z + noise(random));
+		}
+		raw.AppendFrame(records.data() + 1);
+	}
+
+	ScanConfig scanConfig;
+	scanConfig.inBuff = &ring;
+	scanConfig.rawBuff = &raw;
+	scanConfig.refPoints.push_back(Point3(-60, 0, 0));
+	scanConfig.refPoints.push_back(Point3(60, 0, 0));
+	scanConfig.filteringPrecision = 2;
+	scanConfig.stopAtSample = -1;
+	scanConfig.outlierThreshold = 1000;
+
+	std::cout << "Coverage: session of " << seconds << " s, " << numSensors << " sensors at " << config.measurementRate << " Hz, 2 reference points, precision 2" << std::endl;
+	std::cout << std::setw(20) << "stop below (cells/s)" << std::setw(12) << "stopped at" << std::setw(14) << "filled cells" << std::setw(12) << "of session" << std::setw(12) << "filter" << std::endl;
+	std::cout << std::fixed << std::setprecision(1);
+	int sessionCells = 0;
+	for (double threshold : { 0.0, 200.0, 100.0, 50.0, 30.0, 20.0 }) {
+		scanConfig.stopBelowFillRate = threshold;
+		Scan scan(0, scanConfig);
+		auto start = clock::now();
+		scan.Refilter();
+		milliseconds filter = clock::now() - start;
+
+		ScanCoverage coverage = scan.GetCoverage();
+		int filled = std::accumulate(coverage.filledCells.begin(), coverage.filledCells.end(), 0);
+		if (threshold == 0) {
+			sessionCells = filled;
+		}
+		std::cout << std::setw(20) << threshold << std::setw(10) << coverage.filteredFrames / config.measurementRate << " s" << std::setw(14) << filled
+			<< std::setw(11) << 100.0 * filled / std::max(sessionCells, 1) << "%" << std::setw(9) << filter.count() << " ms" << (threshold == 0 ? "   (whole session)" : coverage.converged ? "" : "   (did not converge)") << std::endl;
+	}
+	std::cout.unsetf(std::ios::fixed);
+}
+
+void BenchmarkCloudExport(int numFrames)
+{
+	typedef std::chrono::steady_clock clock;
+	typedef std::chrono::duration<double, std::milli> milliseconds;
+
+	// Record a synthetic session into a raw store.
+	DataAcqConfig config;
+	config.measurementRate = 255;
+	config.synthetic.numSensors = 16;
+	SyntheticDevice device;
+	device.Configure(config);
+
+	const int numSensors = config.synthetic.numSensors;
+	RawStore raw;
+	raw.Init(numSensors, config.measurementRate);
+	std::vector<Point3> records;
+	Point3Ref ref;
+	for (int f = 0; f < numFrames; f++) {
+		device.GetFrame(&records, &ref);
+		raw.AppendFrame(records.data() + 1);
+	}
+	const size_t numPoints = (size_t)numFrames * numSensors;
+
+	std::cout << "Cloud export: " << numFrames << " frames of " << numSensors << " sensors, " << numPoints << " points" << std::endl;
+	std::cout << std::setw(24) << "format" << std::setw(12) << "time" << std::setw(14) << "throughput" << std::setw(12) << "size" << std::setw(14) << "bytes/point" << std::endl;
+	std::cout << std::fixed << std::setprecision(1);
+	auto report = [&](const char* name, const std::string& filename, milliseconds time) {
+		std::ifstream file(filename, std::ios::binary | std::ios::ate);
+		double size = file.is_open() ? (double)file.tellg() : 0;
+		std::cout << std::setw(24) << name << std::setw(9) << time.count() << " ms" << std::setw(8) << numPoints / time.count() / 1000 << " Mp/s"
+			<< std::setw(9) << size / (1 << 20) << " MB" << std::setw(14) << size / numPoints << std::endl;
+	};
+
+	CSVExport csvExport;
+	auto start = clock::now();
+	csvExport.ExportPoint3RawCloud(&raw, "benchmark_cloud.csv");
+	report("csv (x, y, z)", "benchmark_cloud.csv", clock::now() - start);
+	std::remove("benchmark_cloud.csv");
+
+	CloudExport cloudExport;
+	CloudOptions options;
+	for (cloud_format format : { cloud_format::PLY, cloud_format::PCD }) {
+		options.format = format;
+		options.normals = options.quality = options.radius = false;
+		std::string filename = "benchmark_cloud" + CloudExport::Extension(format);
+		start = clock::now();
+		cloudExport.ExportRawCloud(&raw, filename, options);
+		report(format == cloud_format::PLY ? "ply (x, y, z)" : "pcd (x, y, z)", filename, clock::now() - start);
+
+		options.normals = options.quality = options.radius = true;
+		start = clock::now();
+		cloudExport.ExportRawCloud(&raw, filename, options);
+		report(format == cloud_format::PLY ? "ply (all properties)" : "pcd (all properties)", filename, clock::now() - start);
+		std::remove(filename.c_str());
+	}
+
+	// Read the positions of a PLY file back, they have to be the samples rounded to floats. This assumes a little-endian machine.
+	options.format = cloud_format::PLY;
+	options.normals = options.quality = options.radius = false;
+	cloudExport.ExportRawCloud(&raw, "benchmark_cloud.ply", options);
+	std::ifstream file("benchmark_cloud.ply", std::ios::binary);
+	std::string line;
+	while (std::getline(file, line) && line != "end_header") {
+	}
+	size_t mismatches = 0;
+	float position[3];
+	for (int j = 0; j < numSensors; j++) {
+		for (int i = 0; i < numFrames; i++) {
+			const Point3& p = raw.At(j, i);
+			if (!file.read((char*)position, sizeof(position)) || position[0] != (float)p.x || position[1] != (float)p.y || position[2] != (float)p.z) {
+				mismatches++;
+			}
+		}
+	}
+	file.close();
+	std::remove("benchmark_cloud.ply");
+	std::cout << "PLY read back: " << mismatches << " of " << numPoints << " positions differ" << std::endl;
+	std::cout.unsetf(std::ios::fixed);
+}
+
+// Returns the FNV-1a hash of the contents of a file.
+// Arguments:
+// - filename : Name of the file.
+static uint64_t HashFile(const std::string& filename)
+{
+	std::ifstream file(filename, std::ios::binary);
+	std::vector<char> buffer(1 << 20);
+	uint64_t hash = 14695981039346656037ull;
+	while (file.read(buffer.data(), buffer.size()) || file.gcount()) {
+		for (std::streamsize i = 0; i < file.gcount(); i++) {
+			hash = (hash ^ (unsigned char)buffer[i]) * 1099511628211ull;
+		}
+	}
+	return hash;
+}
+
+void BenchmarkCSVExport(double minutes, int numSensors, int maxThreads)
+{
+	typedef std::chrono::steady_clock clock;
+	typedef std::chrono::duration<double, std::milli> milliseconds;
+
+	// Record a synthetic session into a raw store, with a time stamp, quality and button state on every sample.
+	DataAcqConfig config;
+	config.measurementRate = 255;
+	config.synthetic.numSensors = numSensors;
+	SyntheticDevice device;
+	device.Configure(config);
+
+	const int numFrames = (int)(minutes * 60 * config.measurementRate);
+	RawStore raw;
+	raw.Init(numSensors, config.measurementRate);
+	std::vector<Point3> records;
+	Point3Ref ref;
+	for (int f = 0; f < numFrames; f++) {
+		device.GetFrame(&records, &ref);
+		for (int s = 1; s <= numSensors; s++) {
+			records[s].time = f / config.measurementRate;
+			records[s].quality = (unsigned short)(f % 1000);
+			records[s].buttonState = (button_state)(f % 3);
+		}
+		raw.AppendFrame(records.data() + 1);
+	}
+
+	if (maxThreads <= 0) {
+		maxThreads = std::max((int)std::thread::hardware_concurrency(), 1);
+	}
+	std::cout << "CSV export: " << minutes << " minutes of " << numSensors << " sensors at " << config.measurementRate << " Hz, " << numFrames << " frames, "
+		<< std::thread::hardware_concurrency() << " cores" << std::endl;
+	std::cout << std::setw(8) << "threads" << std::setw(14) << "format" << std::setw(13) << "time" << std::setw(9) << "size" << std::setw(14) << "throughput" << std::setw(10) << "speedup" << std::endl;
+	std::cout << std::fixed << std::setprecision(1);
+
+	// Write the first rows with a stream, the way the exporter used to, to compare them with the file of one thread.
+	const int checkFrames = std::min(numFrames, 10000);
+	std::ostringstream expected;
+	expected << numFrames << "," << numSensors << std::endl;
+	for (int i = 0; i < checkFrames; i++) {
+		for (int j = 0; j < numSensors; j++) {
+			const Point3& p = raw.At(j, i);
+			expected << p.time << "," << p.x << "," << p.y << "," << p.z << "," << p.r.x << "," << p.r.y << "," << p.r.z << "," << p.quality << "," << (int)p.buttonState << ",";
+		}
+		expected << std::endl;
+	}
+	bool matchesStream = false;
+
+	// The files written on one thread are the reference for the others.
+	uint64_t matlabHash = 0, cloudHash = 0;
+	double matlabTime = 0, cloudTime = 0;
+	bool same = true;
+	for (int threads = 1; threads <= maxThreads; threads = threads < maxThreads ? std::min(threads * 2, maxThreads) : threads + 1) {
+		ThreadPool pool(threads);
+		CSVExport csvExport;
+		csvExport.SetThreadPool(&pool);
+
+		for (bool cloud : { false, true }) {
+			std::string filename = cloud ? "benchmark_raw_pc.csv" : "benchmark_raw.csv";
+			auto start = clock::now();
+			if (cloud) {
+				csvExport.ExportPoint3RawCloud(&raw, filename);
+			}
+			else {
+				csvExport.ExportPoint3Raw(&raw, filename);
+			}
+			milliseconds time = clock::now() - start;
+
+			std::ifstream file(filename, std::ios::binary | std::ios::ate);
+			double size = (double)file.tellg() / (1 << 20);
+			file.close();
+			uint64_t hash = HashFile(filename);
+			double& reference = cloud ? cloudTime : matlabTime;
+			uint64_t& referenceHash = cloud ? cloudHash : matlabHash;
+			if (threads == 1) {
+				reference = time.count();
+				referenceHash = hash;
+			}
+			same = same && hash == referenceHash;
+
+			std::cout << std::setw(8) << threads << std::setw(14) << (cloud ? "cloudcompare" : "matlab") << std::setw(10) << time.count() << " ms" << std::setw(6) << size << " MB"
+				<< std::setw(9) << size / time.count() * 1000 << " MB/s" << std::setw(9) << reference / time.count() << "x" << std::endl;
+			if (threads == 1 && !cloud) {
+				std::ifstream check(filename);
+				std::string actual(expected.str().size(), '\0');
+				check.read(&actual[0], actual.size());
+				matchesStream = actual == expected.str();
+			}
+			std::remove(filename.c_str());
+		}
+	}
+	std::cout << "Files on more threads " << (same ? "are the same as" : "DIFFER from") << " the files on one thread" << std::endl;
+	std::cout << "First " << checkFrames << " rows on one thread " << (matchesStream ? "match" : "DO NOT match") << " the stream formatting" << std::endl;
+	std::cout.unsetf(std::ios::fixed);
+}
+
+void BenchmarkAsyncExport(double seconds, double measurementRate)
+{
+	typedef std::chrono::steady_clock clock;
+	typedef std::chrono::duration<double, std::milli> milliseconds;
+
+	DataAcqConfig config;
+	config.measurementRate = measurementRate;
+	config.refSensorSerial = 0;
+	config.synthetic.numSensors = 16;
+
+	SmartScanService service(device_backend::SYNTHETIC);
+	service.Init(config);
+	service.StartScan();
+	std::this_thread::sleep_for(std::chrono::duration<double>(seconds));
+
+	std::cout << "Async export: " << config.synthetic.numSensors << " sensors at " << measurementRate << " Hz, acquisition keeps running" << std::endl;
+	std::cout << std::setw(8) << "export" << std::setw(10) << "frames" << std::setw(16) << "caller blocked" << std::setw(12) << "written" << std::setw(20) << "acquired meanwhile" << std::setw(18) << "missed deadlines" << std::endl;
+	std::cout << std::fixed << std::setprecision(1);
+	for (bool async : { false, true }) {
+		SamplingStats before = service.GetSamplingStats();
+		auto start = clock::now();
+		size_t numFrames = 0;
+		milliseconds blocked, written;
+		if (async) {
+			std::shared_ptr<ExportJob> job = service.ExportCSVAsync("benchmark_async.csv", 0, true);
+			blocked = clock::now() - start;
+
+			// Wait like a user interface would, checking the progress now and then.
+			while (job->GetFuture().wait_for(std::chrono::milliseconds(50)) != std::future_status::ready) {
+				job->GetProgress();
+			}
+			written = clock::now() - start;
+			job->GetFuture().get();
+			std::cout << std::setw(8) << "async";
+		}
+		else {
+			service.ExportCSV("benchmark_async.csv", 0, true);
+			blocked = written = clock::now() - start;
+			std::cout << std::setw(8) << "sync";
+		}
+		SamplingStats after = service.GetSamplingStats();
+
+		std::ifstream file("benchmark_async.csv");
+		file >> numFrames;
+		file.close();
+		std::remove("benchmark_async.csv");
+		std::cout << std::setw(10) << numFrames << std::setw(13) << blocked.count() << " ms" << std::setw(9) << written.count() << " ms"
+			<< std::setw(20) << after.numSamples - before.numSamples << std::setw(18) << after.missedDeadlines - before.missedDeadlines << std::endl;
+	}
+	std::cout.unsetf(std::ios::fixed);
+	service.StopScan();
+}
+
+void BenchmarkSessionArchive(double minutes, int numSensors, int maxThreads)
+{
+	typedef std::chrono::steady_clock clock;
+	typedef std::chrono::duration<double, std::milli> milliseconds;
+
+	// Record a synthetic session, with the time stamps of data acquisition and the button held down now and then.
+	DataAcqConfig config;
+	config.measurementRate = 255;
+	config.synthetic.numSensors = numSensors;
+	SyntheticDevice device;
+	device.Configure(config);
+
+	const int numFrames = (int)(minutes * 60 * config.measurementRate);
+	RawStore raw;
+	raw.Init(numSensors, config.measurementRate);
+	std::vector<Point3> records;
+	Point3Ref ref;
+	for (int f = 0; f < numFrames; f++) {
+		device.GetFrame(&records, &ref);
+		for (int s = 1; s <= numSensors; s++) {
+			records[s].time = f / config.measurementRate;
+			records[s].buttonState = (f / 2000) % 2 ? button_state::REFERENCE : button_state::BAD;
+		}
+		raw.AppendFrame(records.data() + 1);
+	}
+	const size_t numSamples = (size_t)numFrames * numSensors;
+	const double sampleMegabytes = (double)numSamples * sizeof(Point3) / (1 << 20);
+
+	SessionInfo info;
+	info.config = config;
+	info.refPoints.push_back({ Point3(0, 0, 0), Point3(60, 0, 20), Point3(-60, 0, 20) });
+
+	if (maxThreads <= 0) {
+		maxThreads = std::max((int)std::thread::hardware_concurrency(), 1);
+	}
+	std::cout << "Session archive: " << minutes << " minutes of " << numSensors << " sensors at " << config.measurementRate << " Hz, " << numFrames << " frames, "
+		<< std::thread::hardware_concurrency() << " cores" << std::endl;
+	std::cout << std::setw(10) << "format" << std::setw(13) << "save time" << std::setw(10) << "size" << std::setw(16) << "bytes/sample" << std::endl;
+	std::cout << std::fixed << std::setprecision(1);
+	auto report = [&](const char* name, const std::string& filename, milliseconds time) {
+		std::ifstream file(filename, std::ios::binary | std::ios::ate);
+		double size = file.is_open() ? (double)file.tellg() : 0;
+		std::cout << std::setw(10) << name << std::setw(10) << time.count() << " ms" << std::setw(7) << size / (1 << 20) << " MB" << std::setw(16) << size / numSamples << std::endl;
+		return size;
+	};
+
+	CSVExport csvExport;
+	auto start = clock::now();
+	csvExport.ExportPoint3Raw(&raw, "benchmark_session.csv");
+	double csvSize = report("csv", "benchmark_session.csv", clock::now() - start);
+	std::remove("benchmark_session.csv");
+
+	const std::string filename = "benchmark_session" + SessionArchive::Extension();
+	ThreadPool savePool(maxThreads);
+	SessionArchive archive;
+	archive.SetThreadPool(&savePool);
+	start = clock::now();
+	archive.Save(&raw, info, filename);
+	double archiveSize = report("archive", filename, clock::now() - start);
+	std::cout << "The archive is " << csvSize / archiveSize << " times smaller than the csv file" << std::endl;
+
+	// Copying the samples into a new raw store is what loading costs at least.
+	start = clock::now();
+	RawStore copy;
+	copy.Init(numSensors, config.measurementRate);
+	std::vector<Point3> frame(numSensors);
+	for (int i = 0; i < numFrames; i++) {
+		for (int j = 0; j < numSensors; j++) {
+			frame[j] = raw.At(j, i);
+		}
+		copy.AppendFrame(frame.data());
+	}
+	milliseconds copyTime = clock::now() - start;
+	std::cout << std::setw(20) << "load" << std::setw(13) << "time" << std::setw(14) << "throughput" << std::endl;
+	std::cout << std::setw(20) << "copy raw store" << std::setw(10) << copyTime.count() << " ms" << std::setw(9) << sampleMegabytes / copyTime.count() * 1000 << " MB/s" << std::endl;
+
+	RawStore loaded;
+	SessionInfo loadedInfo;
+	for (int threads = 1; threads <= maxThreads; threads = threads < maxThreads ? std::min(threads * 2, maxThreads) : threads + 1) {
+		ThreadPool pool(threads);
+		SessionArchive loader;
+		loader.SetThreadPool(&pool);
+		start = clock::now();
+		loadedInfo = loader.Load(filename, &loaded);
+		milliseconds time = clock::now() - start;
+		std::cout << std::setw(11) << threads << " threads" << std::setw(10) << time.count() << " ms" << std::setw(9) << sampleMegabytes / time.count() * 1000 << " MB/s" << std::endl;
+	}
+	copy.Clear();
+
+	// The samples come back rounded to the steps of the archive, the other fields exactly.
+	double timeError = 0, positionError = 0, angleError = 0;
+	size_t differ = 0;
+	for (int j = 0; j < numSensors; j++) {
+		for (int i = 0; i < numFrames; i++) {
+			const Point3& p = raw.At(j, i);
+			const Point3& q = loaded.At(j, i);
+			timeError = std::max(timeError, std::abs(p.time - q.time));
+			positionError = std::max({ positionError, std::abs(p.x - q.x), std::abs(p.y - q.y), std::abs(p.z - q.z) });
+			angleError = std::max({ angleError, std::abs(p.r.x - q.r.x), std::abs(p.r.y - q.r.y), std::abs(p.r.z - q.r.z) });
+			if (p.quality != q.quality || p.button != q.button || p.buttonState != q.buttonState) {
+				differ++;
+			}
+		}
+	}
+	std::cout << std::setprecision(2) << "Largest difference after loading: time " << timeError * 1e6 << " us, position " << positionError * 1e3 << " um, angle "
+		<< angleError * 1e3 << " millidegrees, " << differ << " samples with another quality or button" << std::endl;
+	std::cout << "Loaded " << loaded.NumFrames() << " frames, " << loadedInfo.refPoints.size() << " scan with " << loadedInfo.refPoints[0].size() << " reference points, measurement rate "
+		<< loadedInfo.config.measurementRate << " Hz" << std::endl;
+
+	// Saving the loaded samples again rounds them to the same steps.
+	const uint64_t hash = HashFile(filename);
+	archive.Save(&loaded, loadedInfo, filename);
+	std::cout << "Saving the loaded session again gives " << (HashFile(filename) == hash ? "the same archive" : "ANOTHER archive") << std::endl;
+
+	ReplayDevice replay(filename);
+	replay.Configure(config);
+	std::vector<Point3> replayed;
+	replay.GetFrame(&replayed, &ref);
+	bool same = replayed.size() == numSensors;
+	for (int j = 0; same && j < numSensors; j++) {
+		same = replayed[j].x == loaded.At(j, 0).x && replayed[j].time == loaded.At(j, 0).time;
+	}
+	std::cout << "The replay device " << (same ? "replays" : "DOES NOT replay") << " the archive" << std::endl;
+	std::remove(filename.c_str());
+	std::cout.unsetf(std::ios::fixed);
+}
+
+// Copy the first bytes of a file into another file.
+static void CopyFileStart(const std::string& source, const std::string& destination, size_t size)
+{
+	std::ifstream in(source, std::ios::binary);
+	std::ofstream out(destination, std::ios::binary | std::ios::trunc);
+	std::vector<char> buffer(1 << 20);
+	while (size && in.read(buffer.data(), std::min(buffer.size(), size)).gcount()) {
+		out.write(buffer.data(), in.gcount());
+		size -= (size_t)in.gcount();
+	}
+}
+
+// Returns the number of recovered frames that are equal to the first frames of a raw store, field by field.
+static size_t CountEqualFrames(const RawStore& expected, const RawStore& recovered)
+{
+	for (size_t f = 0; f < recovered.NumFrames(); f++) {
+		for (int j = 0; j < expected.NumSensors(); j++) {
+			const Point3& p = expected.At(j, f);
+			const Point3& q = recovered.At(j, f);
+			if (p.time != q.time || p.x != q.x || p.y != q.y || p.z != q.z || p.r.x != q.r.x || p.r.y != q.r.y || p.r.z != q.r.z
+				|| p.quality != q.quality || p.button != q.button || p.buttonState != q.buttonState) {
+				return f;
+			}
+		}
+	}
+	return recovered.NumFrames();
+}
+
+void BenchmarkSessionJournal(double seconds, int numSensors)
+{
+	typedef std::chrono::steady_clock clock;
+	typedef std::chrono::duration<double, std::micro> microseconds;
+
+	// Record 30 minutes of a synthetic session, with the time stamps of data acquisition.
+	DataAcqConfig config;
+	config.measurementRate = 255;
+	config.synthetic.numSensors = numSensors;
+	SyntheticDevice device;
+	device.Configure(config);
+
+	const int numFrames = (int)(30 * 60 * config.measurementRate);
+	std::vector<Point3> frames((size_t)numFrames * numSensors);
+	std::vector<Point3> records;
+	Point3Ref ref;
+	for (int f = 0; f < numFrames; f++) {
+		device.GetFrame(&records, &ref);
+		for (int s = 0; s < numSensors; s++) {
+			frames[(size_t)f * numSensors + s] = records[s + 1];
+			frames[(size_t)f * numSensors + s].time = f / config.measurementRate;
+		}
+	}
+	std::vector<int> serials(numSensors);
+	std::iota(serials.begin(), serials.end(), 1);
+
+	std::cout << "Session journal: " << numSensors << " sensors at " << config.measurementRate << " Hz" << std::endl;
+
+	// Time every append on its own, the sample loop cares about the slowest one.
+	RawStore raw;
+	raw.Init(numSensors, config.measurementRate);
+	std::vector<double> rawUs, journalUs;
+	rawUs.reserve(numFrames);
+	journalUs.reserve(numFrames);
+	const std::string filename = "benchmark_journal" + SessionJournal::Extension();
+	const std::string crashed = "benchmark_crashed" + SessionJournal::Extension();
+	SessionJournal journal;
+	auto start = clock::now();
+	journal.Open(filename, config, serials, 30);
+	microseconds openTime = clock::now() - start;
+	for (int f = 0; f < numFrames; f++) {
+		const Point3* frame = frames.data() + (size_t)f * numSensors;
+		start = clock::now();
+		raw.AppendFrame(frame);
+		auto middle = clock::now();
+		journal.Append(frame, numSensors);
+		auto end = clock::now();
+		rawUs.push_back(microseconds(middle - start).count());
+		journalUs.push_back(microseconds(end - middle).count());
+	}
+	std::cout << "Appending " << numFrames << " frames (30 minutes), opening the journal took " << openTime.count() / 1000 << " ms" << std::endl;
+	PrintLatencyStats("raw store", rawUs);
+	PrintLatencyStats("journal", journalUs);
+
+	// A copy of the journal before it is closed holds what the operating system would write to the disk after a crash.
+	// The header takes a page, a frame is its index and checksum followed by 64 bytes per sample. (See SessionJournal.cpp)
+	const size_t frameSize = 16 + 64 * (size_t)numSensors;
+	const size_t headerSize = 4096;
+	CopyFileStart(filename, crashed, SIZE_MAX);
+	start = clock::now();
+	journal.Close();
+	std::cout << "Closing the journal took " << std::chrono::duration<double, std::milli>(clock::now() - start).count() << " ms" << std::endl;
+
+	RawStore recovered;
+	auto recover = [&](const char* name, const std::string& file, size_t expected) {
+		SessionInfo info = SessionJournal::Recover(file, &recovered);
+		size_t equal = CountEqualFrames(raw, recovered);
+		bool good = recovered.NumFrames() == expected && equal == expected && info.serials == serials && info.config.measurementRate == config.measurementRate;
+		std::cout << std::setw(24) << std::left << name << std::right << "recovered " << recovered.NumFrames() << " of " << expected << " frames, "
+			<< (good ? "all equal" : "WRONG") << std::endl;
+	};
+	recover("closed journal", filename, numFrames);
+	recover("crashed journal", crashed, numFrames);
+
+	// A frame that did not reach the disk ends the recovery, also when the watermark is past it.
+	const size_t damaged = numFrames * 3 / 4;
+	{
+		std::fstream file(crashed, std::ios::in | std::ios::out | std::ios::binary);
+		file.seekp(headerSize + damaged * frameSize + 40);
+		file.put(0x55);
+	}
+	recover("damaged frame", crashed, damaged);
+
+	// A file that is cut off in the middle of a frame keeps the frames in front of it.
+	const size_t cut = numFrames / 2;
+	CopyFileStart(filename, crashed, headerSize + cut * frameSize + frameSize / 2);
+	recover("cut off journal", crashed, cut);
+	std::remove(crashed.c_str());
+	recovered.Clear();
+
+	// The journal should not make data acquisition any later. The synthetic device has a reference sensor on port 0.
+	config.refSensorSerial = 0;
+	DataAcq acq(device_backend::SYNTHETIC);
+	acq.Init(config);
+	for (int run = 0; run < 2; run++) {
+		if (run) {
+			acq.OpenJournal(filename);
+		}
+		acq.Start();
+		std::this_thread::sleep_for(std::chrono::duration<double>(seconds));
+		acq.Stop();
+
+		SamplingStats stats = acq.GetSamplingStats();
+		std::cout << std::setw(24) << std::left << (run ? "acquisition, journal" : "acquisition") << std::right << stats.numSamples << " frames, "
+			<< stats.missedDeadlines << " missed deadlines, lateness mean " << stats.meanLateness * 1e6 << " us, max " << stats.maxLateness * 1e6 << " us" << std::endl;
+		if (run) {
+			acq.CloseJournal();
+			SessionJournal::Recover(filename, &recovered);
+			std::cout << "The journal holds " << recovered.NumFrames() << " of " << acq.GetRawBuffer()->NumFrames() << " acquired frames, "
+				<< (CountEqualFrames(*acq.GetRawBuffer(), recovered) == acq.GetRawBuffer()->NumFrames() ? "all equal" : "NOT equal") << std::endl;
+		}
+		acq.Stop(true);
+	}
+	std::remove(filename.c_str());
+}
@@ -0,0 +1,160 @@
+// Benchmarks for the performance critical parts of the SmartScanService library.
+// They are started from the command line application with the 'benchmark' command.
+
+#pragma once
+
+#include <vector>
+#include <string>
+
+// Print the mean, 99th percentile and maximum of a set of latency measurements.
+// Arguments:
+// - name : Name printed in front of the statistics.
+// - samplesUs : Latency measurements in microseconds. The vector is sorted in place.
+void PrintLatencyStats(const std::string& name, std::vector<double>& samplesUs);
+
+// Returns the CPU time used by all threads of this process in seconds.
+double ProcessCpuSeconds();
+
+// Measure the producer and consumer latency of the frame ring at a realistic acquisition rate.
+// One producer publishes frames at the given rate while every consumer reads them at its own cursor.
+// Arguments:
+// - numSensors : Number of samples in one frame.
+// - measurementRate : Rate in Hz at which the producer publishes frames.
+// - seconds : Duration of the benchmark.
+// - numConsumers : Number of consumer threads, similar to the number of running scans.
+void BenchmarkFrameRing(int numSensors = 8, double measurementRate = 255, double seconds = 5, int numConsumers = 4);
+
+// Measure how fast the mock data files are loaded and served, and how fast the mock acquisition can run.
+// The files are loaded and read through a MockFileDevice, after that a DataAcq object acquires from them at the given rate and its CPU use is measured.
+// Arguments:
+// - measurementRate : Rate in Hz at which the mock data is acquired, far above the 255 Hz of the real device.
+// - seconds : Duration of the acquisition run.
+void BenchmarkMockDevice(double measurementRate = 5000, double seconds = 2);
+
+// Run data acquisition and a scan on the synthetic device and check the filtered scan against the ground truth of the synthetic foot.
+// Arguments:
+// - numSensors : Number of stroking sensors.
+// - measurementRate : Rate in Hz at which the synthetic samples are acquired.
+// - seconds : Duration of the acquisition run.
+void BenchmarkSynthetic(int numSensors = 16, double measurementRate = 1000, double seconds = 10);
+
+// Measure the CPU use of running scans, first while they wait for frames with acquisition stopped and then while acquisition runs.
+// Arguments:
+// - numScans : Number of concurrent scans.
+// - seconds : Duration of each measurement.
+void BenchmarkScanWakeups(int numScans = 5, double seconds = 3);
+
+// Compare the time per sample of the linear search, the k-d tree and the grid of the reference index, for an increasing number of reference points.
+// The reference points lie inside a foot, the samples are spread over a box around it or follow the stroke paths of the synthetic device.
+// The results of the tree and the grid are checked against the linear search.
+// Arguments:
+// - numSamples : Number of samples that are matched for every number of reference points.
+void BenchmarkRefIndex(int numSamples = 200000);
+
+// Compare the time per sample of the exact theta and phi bins of a scan with the trigonometry free kernel of the AngleBins class, for a few filtering precisions.
+// The samples are spread over a box around a reference point or follow the stroke paths of the synthetic device. The bins of both are checked against each other,
+// also for a few samples on the Z axis and the theta border, which have to stay within the grid.
+// Arguments:
+// - numSamples : Number of samples that are binned for every filtering precision.
+void BenchmarkAngleBins(int numSamples = 1000000);
+
+// Compare filtering a recorded synthetic session into several parameter variants of a scan, once with a thread per scan and once with the filter engine.
+// The variants share their reference points and differ in filtering precision and outlier threshold.
+// Arguments:
+// - numVariants : Number of scans that are filtered at the same time.
+// - numFrames : Number of frames in the session.
+void BenchmarkFilterEngine(int numVariants = 6, int numFrames = 20000);
+
+// Measure filtering a recorded synthetic session into a scan again, with a thread pool of 1, 2, 4 and so on up to the given number of threads.
+// The cells of every run are checked against the ones filtered by a single thread.
+// Arguments:
+// - maxThreads : Largest number of threads, 0 for one thread per core.
+// - numFrames : Number of frames in the session.
+void BenchmarkRefilter(int maxThreads = 0, int numFrames = 50000);
+
+// Sweep a recorded synthetic session with several parameter variants of a scan through SmartScanService::SweepScans(), and print the statistics of every variant.
+// Arguments:
+// - numVariants : Number of scan configurations in the sweep.
+// - numFrames : Number of frames in the session.
+void BenchmarkSweep(int numVariants = 12, int numFrames = 30000);
+
+// Measure what a live view of a scan costs, polling the scan while synthetic acquisition runs.
+// Every poll copies the whole output buffer and then only the cells that changed since the previous poll.
+// At the end the cells collected from the changes are checked against a full copy. Cells that two polls report with the same sample are counted, only a cell
+// that the filter improves while a poll copies it can be reported twice.
+// The change tracking of a cell grid is checked first with a known number of updates per poll.
+// Arguments:
+// - seconds : Duration of the acquisition run.
+// - pollInterval : Time between two polls in milliseconds, 33 ms is a view at 30 Hz.
+void BenchmarkLiveDelta(double seconds = 5, int pollInterval = 33);
+
+// Take snapshots of a live scan as fast as possible while synthetic acquisition runs, and measure what they cost and how often they are consistent.
+// A few consistent snapshots are checked afterwards against the same scan filtered again up to the number of frames of the snapshot.
+// Arguments:
+// - seconds : Duration of the acquisition run.
+// - measurementRate : Rate in Hz at which the synthetic samples are acquired.
+void BenchmarkSnapshot(double seconds = 5, double measurementRate = 1000);
+
+// Compare dense and sparse cells of scans at a filtering precision of 1 degree, for an increasing number of reference points.
+// A recorded synthetic session is filtered into both, the time to create the scan, the time to filter and the memory are printed, and the cells are checked against each other.
+// Arguments:
+// - numFrames : Number of frames in the session.
+void BenchmarkSparseCells(int numFrames = 20000);
+
+// Compare the theta/phi grid with the equal-area grid of a scan.
+// Uniformly random directions show how evenly the cells divide the sphere. A recorded synthetic session is filtered into both grids
+// at a few filtering precisions, and checked against the ground truth of the synthetic foot. Coarse copies of the equal-area grid are timed per level.
+// Arguments:
+// - numFrames : Number of frames in the session.
+void BenchmarkGrids(int numFrames = 20000);
+
+// Filter a recorded synthetic session into scans that stop on their coverage, with a few fill rate thresholds.
+// Prints after how much of the session every scan stopped and how much of the coverage of the whole session it reached by then.
+// Arguments:
+// - seconds : Length of the session in seconds at 255 Hz.
+void BenchmarkCoverage(double seconds = 120);
+
+// Export a recorded synthetic session as a CSV point cloud and as binary PLY and PCD point clouds.
+// Prints the time, throughput and size of every file, and reads the positions of the PLY file back to check them.
+// The files are written to the working directory and removed afterwards.
+// Arguments:
+// - numFrames : Number of frames in the session.
+void BenchmarkCloudExport(int numFrames = 100000);
+
+// Export a recorded synthetic session to the MATLAB and CloudCompare CSV formats, with the rows formatted on 1, 2, 4 and up to maxThreads threads.
+// Prints the time, throughput and speedup of both files. The files on more threads have to be the same as on one thread,
+// and the first rows of the MATLAB file the same as those rows written with a stream.
+// The files are written to the working directory and removed afterwards.
+// Arguments:
+// - minutes : Length of the session in minutes at 255 Hz.
+// - numSensors : Number of sensors.
+// - maxThreads : Largest number of threads, 0 uses one thread per core.
+void BenchmarkCSVExport(double minutes = 30, int numSensors = 4, int maxThreads = 0);
+
+// Export the raw data of a running synthetic session, once on the calling thread and once in the background.
+// Prints how long the caller is blocked, how long the export takes and how data acquisition kept up while the file was written.
+// The files are written to the working directory and removed afterwards.
+// Arguments:
+// - seconds : Number of seconds that is recorded before the exports start.
+// - measurementRate : Rate of the synthetic device in Hz.
+void BenchmarkAsyncExport(double seconds = 20, double measurementRate = 1000);
+
+// Save a synthetic session in a session archive and compare it with the raw CSV file, then load the archive on a thread pool of 1, 2, 4 and so on
+// up to the given number of threads, next to copying the same samples from one raw store into another.
+// The loaded samples are checked against the recorded ones, the archive is saved again from them to check that it stays the same, and it is replayed by the replay device.
+// The files are written to the working directory and removed afterwards.
+// Arguments:
+// - minutes : Length of the session.
+// - numSensors : Number of sensors.
+// - maxThreads : Largest number of threads, 0 for one thread per core.
+void BenchmarkSessionArchive(double minutes = 30, int numSensors = 4, int maxThreads = 0);
+
+// Measure what journaling a session costs data acquisition, and recover journals that were cut off by a crash.
+// Appending every frame of a 30 minute session to a journal is timed next to appending it to a raw store. A copy of the journal taken before
+// it is closed, which is what a crash leaves behind, is recovered as it is, with a damaged frame and cut off in the middle of a frame.
+// Finally the synthetic device is acquired at 255 Hz without and with a journal, to compare how late the samples are taken.
+// The files are written to the working directory and removed afterwards.
+// Arguments:
+// - seconds : Duration of each acquisition run.
+// - numSensors : Number of sensors.
+void BenchmarkSessionJournal(double seconds = 10, int numSensors = 4);
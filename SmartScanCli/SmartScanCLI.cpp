@@ -13,6 +13,7 @@
 //   6. In the future, to open this project again, go to File > Open > Project and select the .sln file
 
 #include "SmartScanConfig.h"
+#include "Benchmark.h"
 
 using namespace SmartScan;
 
@@ -21,7 +22,7 @@ void Usage();
 void RawPrintCallback(const std::vector<SmartScan::Point3>& record);
 
 // Create SmartScanService object
-SmartScanService s3(mockMode);
+SmartScanService s3(deviceBackend);
 
 int main()
 {
@@ -67,6 +68,9 @@ int main()
 	std::cout << "Welcome to the SmartScan command line application! (Type help to see a full list of commands)" << std::endl;
 
 	char cmd[128];
+
+	// Exports that are written in the background.
+	std::vector<std::shared_ptr<ExportJob>> exports;
 	do {
 		// Print prompt.
 		std::cout << "SmartScan>";
@@ -147,6 +151,16 @@ int main()
 				}
 				std::cin.ignore();
 
+				int gridType;
+				std::cout << "Enter the grid type (0 for theta/phi bins, 1 for equal-area cells): " << std::flush;
+				while(!(std::cin >> gridType) || gridType < 0 || gridType > 1){
+					std::cin.clear();
+					std::cin.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
+					std::cout << "Invalid input.  Try again: ";
+				}
+				std::cin.ignore();
+				config.gridType = gridType ? grid_type::EQUAL_AREA : grid_type::THETA_PHI;
+
 				std::cout << "Enter the samplenumber after which the scan is stopped (-1 for infite duration): " << std::flush;
 				while(!(std::cin >> config.stopAtSample)){
 					std::cin.clear();
@@ -163,6 +177,14 @@ int main()
 				}
 				std::cin.ignore();
 
+				std::cout << "Enter the number of newly filled cells per second below which the scan is stopped (0 to disable): " << std::flush;
+				while(!(std::cin >> config.stopBelowFillRate)){
+					std::cin.clear();
+					std::cin.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
+					std::cout << "Invalid input.  Try again: ";
+				}
+				std::cin.ignore();
+
 				try {
 					s3.NewScan(config);
 					std::cout << "New scan created" << std::endl;
@@ -239,6 +261,39 @@ int main()
 				std::cerr << e.what() << " thrown in function " << e.get_function() << " in file " << e.get_file() << std::endl;
 			}
 		}
+		// Filter the recorded session into a specific scan again.
+		else if (strlen(cmd) > 9 && !strncmp(cmd, "refilter ", 9)) {
+			int id = atoi(cmd + 9);
+
+			try {
+				s3.RefilterScan(id);
+				std::cout << "Scan " << id << " has been filtered again" << std::endl;
+			}
+			catch (ex_smartScan e) {
+				std::cerr << e.what() << " thrown in function " << e.get_function() << " in file " << e.get_file() << std::endl;
+			}
+			catch (ex_scan e) {
+				std::cerr << e.what() << " thrown in function " << e.get_function() << " in file " << e.get_file() << std::endl;
+			}
+		}
+		// Print the coverage of a specific scan.
+		else if (strlen(cmd) > 9 && !strncmp(cmd, "coverage ", 9)) {
+			int id = atoi(cmd + 9);
+
+			try {
+				ScanCoverage coverage = s3.GetScanCoverage(id);
+				for (int r = 0; r < coverage.filledCells.size(); r++) {
+					std::cout << "Reference point " << r << ": " << coverage.filledCells[r] << " of " << coverage.cellsPerRef << " cells filled" << std::endl;
+				}
+				std::cout << coverage.fillRate << " cells filled and " << coverage.improvementRate << " samples stored per second, " << coverage.improvements << " samples stored in " << coverage.filteredFrames << " frames" << std::endl;
+				if (coverage.converged) {
+					std::cout << "The scan stopped because the coverage no longer grows" << std::endl;
+				}
+			}
+			catch (ex_smartScan e) {
+				std::cerr << e.what() << " thrown in function " << e.get_function() << " in file " << e.get_file() << std::endl;
+			}
+		}
 		// List all the created scans and its options.
 		else if (!strcmp(cmd, "list")) {
 			std::cout << "Scan ID\t\tNumRefs\t\tPrecision\tStopAt\t\tThreshold" << std::endl;
@@ -259,10 +314,10 @@ int main()
 			std::cout << "exporting raw data from scan: " << id << " into file: " << filepath.substr(9) << std::endl;
 
 			try {
-				// Export both the MATLAB format and the Point cloud format.
-				s3.ExportCSV(filepath.substr(9) + ".csv", id);
-                s3.ExportPointCloud(filepath.substr(9) + "_pc.csv", id);
-				std::cout << "Done.\n";
+				// Export both the MATLAB format and the Point cloud format, in the background.
+				exports.push_back(s3.ExportCSVAsync(filepath.substr(9) + ".csv", id));
+				exports.push_back(s3.ExportPointCloudAsync(filepath.substr(9) + "_pc.csv", id));
+				std::cout << "Exporting in the background. (Type exports to see the progress)\n";
 			}
 			catch(ex_export e) {
 				std::cerr << e.what() << std::endl;
@@ -281,10 +336,10 @@ int main()
 			std::cout << "Exporting raw data into file: " << filepath.substr(11) << std::endl;
 
 			try {
-				// Export both the MATLAB format and the Point cloud format.
-				s3.ExportCSV(filepath.substr(11) + ".csv", 0, true);
-                s3.ExportPointCloud(filepath.substr(11) + "_pc.csv", 0, true);
-				std::cout << "Done.\n";
+				// Export both the MATLAB format and the Point cloud format, in the background.
+				exports.push_back(s3.ExportCSVAsync(filepath.substr(11) + ".csv", 0, true));
+				exports.push_back(s3.ExportPointCloudAsync(filepath.substr(11) + "_pc.csv", 0, true));
+				std::cout << "Exporting in the background. (Type exports to see the progress)\n";
 			}
 			catch(ex_export e) {
 				std::cerr << e.what() << std::endl;
@@ -293,6 +348,243 @@ int main()
 				std::cerr << "Could not export csv file" << std::endl;
 			}
 		}
+		// Export a scan or the raw data as a binary point cloud with normals, quality and radius.
+		else if (strlen(cmd) > 13 && !strncmp(cmd, "export-cloud ", 13)) {
+			char format[8], target[16], filename[256];
+			if (sscanf(cmd + 13, "%7s %15s %255s", format, target, filename) != 3 || (strcmp(format, "ply") && strcmp(format, "pcd"))) {
+				std::cout << "Usage: export-cloud [ply|pcd] [id|raw] [filename]" << std::endl;
+			}
+			else {
+				CloudOptions options;
+				options.format = strcmp(format, "pcd") ? cloud_format::PLY : cloud_format::PCD;
+				options.normals = options.quality = options.radius = true;
+				const bool raw = !strcmp(target, "raw");
+				std::string filepath = filename + CloudExport::Extension(options.format);
+				std::cout << "Exporting " << (raw ? "raw data" : "scan " + std::string(target)) << " into file: " << filepath << std::endl;
+
+				try {
+					exports.push_back(s3.ExportBinaryCloudAsync(filepath, raw ? 0 : atoi(target), options, raw));
+					std::cout << "Exporting in the background. (Type exports to see the progress)\n";
+				}
+				catch(ex_export e) {
+					std::cerr << e.what() << std::endl;
+				}
+				catch (...)	{
+					std::cerr << "Could not export point cloud file" << std::endl;
+				}
+			}
+		}
+		// Save the raw data with the configuration and the reference points of the scans in a compact session archive.
+		else if (strlen(cmd) > 13 && !strncmp(cmd, "save-session ", 13)) {
+			std::string filepath = cmd + 13 + SessionArchive::Extension();
+			std::cout << "Saving the session into file: " << filepath << std::endl;
+
+			try {
+				exports.push_back(s3.SaveSessionAsync(filepath));
+				std::cout << "Saving in the background. (Type exports to see the progress)\n";
+			}
+			catch(ex_export e) {
+				std::cerr << e.what() << std::endl;
+			}
+			catch (...)	{
+				std::cerr << "Could not save the session" << std::endl;
+			}
+		}
+		// Journal every acquired frame, so the session can be recovered after a crash.
+		else if (strlen(cmd) > 8 && !strncmp(cmd, "journal ", 8)) {
+			std::string filepath = cmd + 8 + SessionJournal::Extension();
+			try {
+				s3.OpenJournal(filepath);
+				std::cout << "Journaling the session into file: " << filepath << std::endl;
+			}
+			catch (ex_acq e) {
+				std::cerr << e.what() << std::endl;
+			}
+		}
+		// Stop journaling, the journal is kept.
+		else if (!strcmp(cmd, "close-journal")) {
+			try {
+				s3.CloseJournal();
+				std::cout << "The journal is closed" << std::endl;
+			}
+			catch (ex_acq e) {
+				std::cerr << e.what() << std::endl;
+			}
+		}
+		// Recover the session of a journal, for example after a crash, and save it in a session archive.
+		else if (!strncmp(cmd, "recover ", 8)) {
+			char journal[128], filename[128];
+			if (sscanf(cmd + 8, "%127s %127s", journal, filename) != 2) {
+				std::cout << "Usage: recover [journal] [filename]" << std::endl;
+			}
+			else {
+				std::string filepath = filename + SessionArchive::Extension();
+				try {
+					RawStore rawBuff;
+					SessionInfo info = s3.RecoverJournal(journal, &rawBuff);
+					std::cout << "Recovered " << rawBuff.NumFrames() << " frames, saving them into file: " << filepath << std::endl;
+					SessionArchive archive;
+					archive.Save(&rawBuff, info, filepath);
+				}
+				catch (ex_acq e) {
+					std::cerr << e.what() << std::endl;
+				}
+				catch (ex_export e) {
+					std::cerr << e.what() << std::endl;
+				}
+			}
+		}
+		// Print the progress of the exports that are written in the background.
+		else if (!strcmp(cmd, "exports")) {
+			for (const std::shared_ptr<ExportJob>& job : exports) {
+				std::cout << job->GetFilename() << "\t";
+				switch (job->GetState()) {
+				case export_state::QUEUED:
+					std::cout << "queued" << std::endl;
+					break;
+				case export_state::RUNNING:
+					std::cout << (int)(job->GetProgress() * 100) << "%" << std::endl;
+					break;
+				case export_state::DONE:
+					std::cout << "done" << std::endl;
+					break;
+				case export_state::FAILED:
+					try {
+						job->GetFuture().get();
+					}
+					catch (ex_export e) {
+						std::cout << "failed: " << e.what() << std::endl;
+					}
+					catch (...) {
+						std::cout << "failed" << std::endl;
+					}
+					break;
+				}
+			}
+		}
+		// Print how accurately the samples were taken on their deadlines.
+		else if (!strcmp(cmd, "timing")) {
+			SamplingStats stats = s3.GetSamplingStats();
+			std::cout << "Samples taken: " << stats.numSamples << ", missed deadlines: " << stats.missedDeadlines << std::endl;
+			std::cout << "Lateness mean: " << stats.meanLateness * 1e6 << " us, max: " << stats.maxLateness * 1e6 << " us, last: " << stats.lastLateness * 1e6 << " us" << std::endl;
+		}
+		// Benchmark the frame ring that hands frames from data acquisition to the scans.
+		else if (!strncmp(cmd, "benchmark ring", 14)) {
+			int numSensors = strlen(cmd) > 15 ? atoi(cmd + 15) : 8;
+			BenchmarkFrameRing(numSensors > 0 ? numSensors : 8);
+		}
+		// Benchmark loading and acquiring the mock data.
+		else if (!strncmp(cmd, "benchmark mock", 14)) {
+			double rate = strlen(cmd) > 15 ? atof(cmd + 15) : 5000;
+			try {
+				BenchmarkMockDevice(rate > 0 ? rate : 5000);
+			}
+			catch (ex_acq e) {
+				std::cerr << e.what() << std::endl;
+			}
+		}
+		// Benchmark the CPU use of idle and busy scans.
+		else if (!strncmp(cmd, "benchmark scans", 15)) {
+			int numScans = strlen(cmd) > 16 ? atoi(cmd + 16) : 5;
+			try {
+				BenchmarkScanWakeups(numScans > 0 ? numScans : 5);
+			}
+			catch (ex_acq e) {
+				std::cerr << e.what() << std::endl;
+			}
+		}
+		// Benchmark the nearest reference point search.
+		else if (!strcmp(cmd, "benchmark refs")) {
+			BenchmarkRefIndex();
+		}
+		// Benchmark the calculation of the theta and phi bins.
+		else if (!strcmp(cmd, "benchmark angles")) {
+			BenchmarkAngleBins();
+		}
+		// Benchmark filtering a recorded session again on several threads.
+		else if (!strncmp(cmd, "benchmark refilter", 18)) {
+			int numThreads = strlen(cmd) > 19 ? atoi(cmd + 19) : 0;
+			BenchmarkRefilter(numThreads > 0 ? numThreads : 0);
+		}
+		// Benchmark a parameter sweep over a recorded session.
+		else if (!strncmp(cmd, "benchmark sweep", 15)) {
+			int numVariants = strlen(cmd) > 16 ? atoi(cmd + 16) : 12;
+			BenchmarkSweep(numVariants > 0 ? numVariants : 12);
+		}
+		// Benchmark polling a live scan for its changes.
+		else if (!strncmp(cmd, "benchmark delta", 15)) {
+			double seconds = strlen(cmd) > 16 ? atof(cmd + 16) : 5;
+			BenchmarkLiveDelta(seconds > 0 ? seconds : 5);
+		}
+		// Benchmark snapshots of a live scan.
+		else if (!strncmp(cmd, "benchmark snapshot", 18)) {
+			double seconds = strlen(cmd) > 19 ? atof(cmd + 19) : 5;
+			BenchmarkSnapshot(seconds > 0 ? seconds : 5);
+		}
+		// Benchmark dense and sparse cells.
+		else if (!strcmp(cmd, "benchmark sparse")) {
+			BenchmarkSparseCells();
+		}
+		// Benchmark the theta/phi and the equal-area grid.
+		else if (!strcmp(cmd, "benchmark grids")) {
+			BenchmarkGrids();
+		}
+		// Benchmark exporting in the background while acquisition is running.
+		else if (!strncmp(cmd, "benchmark async", 15)) {
+			double seconds = strlen(cmd) > 16 ? atof(cmd + 16) : 20;
+			BenchmarkAsyncExport(seconds > 0 ? seconds : 20);
+		}
+		// Benchmark exporting CSV files.
+		else if (!strncmp(cmd, "benchmark csv", 13)) {
+			double minutes = 30;
+			int threads = 0;
+			sscanf(cmd + 13, "%lf %d", &minutes, &threads);
+			BenchmarkCSVExport(minutes > 0 ? minutes : 30, 4, threads);
+		}
+		// Benchmark exporting binary point clouds.
+		else if (!strncmp(cmd, "benchmark cloud", 15)) {
+			int numFrames = strlen(cmd) > 16 ? atoi(cmd + 16) : 100000;
+			BenchmarkCloudExport(numFrames > 0 ? numFrames : 100000);
+		}
+		// Benchmark saving and loading session archives.
+		else if (!strncmp(cmd, "benchmark archive", 17)) {
+			double minutes = 30;
+			int threads = 0;
+			sscanf(cmd + 17, "%lf %d", &minutes, &threads);
+			BenchmarkSessionArchive(minutes > 0 ? minutes : 30, 4, threads);
+		}
+		// Benchmark journaling a session and recovering it.
+		else if (!strncmp(cmd, "benchmark journal", 17)) {
+			double seconds = strlen(cmd) > 18 ? atof(cmd + 18) : 10;
+			try {
+				BenchmarkSessionJournal(seconds > 0 ? seconds : 10);
+			}
+			catch (ex_acq e) {
+				std::cerr << e.what() << std::endl;
+			}
+		}
+		// Benchmark stopping scans on their coverage.
+		else if (!strncmp(cmd, "benchmark coverage", 18)) {
+			double seconds = strlen(cmd) > 19 ? atof(cmd + 19) : 120;
+			BenchmarkCoverage(seconds > 0 ? seconds : 120);
+		}
+		// Benchmark filtering several scans with the filter engine.
+		else if (!strncmp(cmd, "benchmark engine", 16)) {
+			int numVariants = strlen(cmd) > 17 ? atoi(cmd + 17) : 6;
+			BenchmarkFilterEngine(numVariants > 0 ? numVariants : 6);
+		}
+		// Benchmark acquisition and filtering with the synthetic device.
+		else if (!strncmp(cmd, "benchmark synthetic", 19)) {
+			int numSensors = 16;
+			double rate = 1000;
+			sscanf(cmd + 19, "%d %lf", &numSensors, &rate);
+			try {
+				BenchmarkSynthetic(numSensors > 0 ? numSensors : 16, rate > 0 ? rate : 1000);
+			}
+			catch (ex_acq e) {
+				std::cerr << e.what() << std::endl;
+			}
+		}
 		// Print the help menu.
 		else if (!strcmp(cmd, "help")) {
 			Usage();
@@ -312,8 +604,36 @@ void Usage()
 	std::cout << "\tclear\t\t\t\tClear all recorded data." << std::endl;
 	std::cout << "\tdelete [id]\t\t\tDelete a measurement. Leave id blank to delete all scans" << std::endl << "\t\t\t\t\t" << "and clear the raw data." << std::endl;
 	std::cout << "\tlist\t\t\t\tPrint all the existing Scans to the console." << std::endl;
+	std::cout << "\tcoverage [id]\t\t\tPrint the filled cells and the fill rate of the scan id." << std::endl;
+	std::cout << "\trefilter [id]\t\t\tFilter the recorded data into the scan id again, using all cores." << std::endl;
 	std::cout << "\texport [id] [filename]\t\tExport the processed data of the scan id as a CSV file with" << std::endl << "\t\t\t\t\tthe given filename (no spaces allowed in filename)." << std::endl;
 	std::cout << "\texport-raw [filename]\t\tExport the raw data of all the sensors as a CSV file with" << std::endl << "\t\t\t\t\tthe given filename (no spaces allowed in filename)." << std::endl;
+	std::cout << "\texport-cloud [ply|pcd] [id|raw] [filename]" << std::endl << "\t\t\t\t\tExport a scan or the raw data as a binary point cloud with normals, quality and radius." << std::endl;
+	std::cout << "\tsave-session [filename]\t\tSave the raw data, the configuration and the reference points in a session archive," << std::endl << "\t\t\t\t\twhich the replay backend can replay." << std::endl;
+	std::cout << "\tjournal [filename]\t\tAlso write every acquired frame to a journal, from which the session can be recovered after a crash." << std::endl;
+	std::cout << "\tclose-journal\t\t\tStop journaling, the journal is kept." << std::endl;
+	std::cout << "\trecover [journal] [filename]\tRecover the session of a journal, also after a crash, and save it in a session archive." << std::endl;
+	std::cout << "\texports\t\t\t\tPrint the progress of the exports that are written in the background." << std::endl;
+	std::cout << "\ttiming\t\t\t\tPrint how far the samples were taken from their deadlines." << std::endl;
+	std::cout << "\tbenchmark ring [sensors]\tMeasure the frame ring latency at 255 Hz (8 sensors by default)." << std::endl;
+	std::cout << "\tbenchmark mock [rate]\t\tMeasure loading the mock data and acquiring it at a high rate (5000 Hz by default)." << std::endl;
+	std::cout << "\tbenchmark scans [count]\t\tMeasure the CPU use of idle and busy scans (5 scans by default)." << std::endl;
+	std::cout << "\tbenchmark refs\t\t\tCompare the linear, k-d tree and grid search of the nearest reference point." << std::endl;
+	std::cout << "\tbenchmark angles\t\tCompare the exact and the trigonometry free calculation of the theta and phi bins." << std::endl;
+	std::cout << "\tbenchmark engine [variants]\tCompare filtering parameter variants of a scan in their own threads and with the filter engine (6 variants by default)." << std::endl;
+	std::cout << "\tbenchmark sweep [variants]\tSweep a recorded session with parameter variants of a scan and print their statistics (12 variants by default)." << std::endl;
+	std::cout << "\tbenchmark delta [seconds]\tCompare copying the whole output of a live scan with copying only its changes (5 seconds by default)." << std::endl;
+	std::cout << "\tbenchmark snapshot [seconds]\tTake snapshots of a live scan as fast as possible and check them (5 seconds by default)." << std::endl;
+	std::cout << "\tbenchmark sparse\t\tCompare dense and sparse cells of scans with an increasing number of reference points." << std::endl;
+	std::cout << "\tbenchmark grids\t\t\tCompare the theta/phi grid of a scan with the equal-area grid." << std::endl;
+	std::cout << "\tbenchmark async [seconds]\tExport a running session on the calling thread and in the background (20 s by default)." << std::endl;
+	std::cout << "\tbenchmark csv [minutes] [threads]\tMeasure exporting a 4 sensor session to both CSV formats on 1 up to [threads] threads" << std::endl << "\t\t\t\t\t(30 minutes and one thread per core by default)." << std::endl;
+	std::cout << "\tbenchmark cloud [frames]\tCompare exporting a session as a CSV, PLY and PCD point cloud (100000 frames by default)." << std::endl;
+	std::cout << "\tbenchmark archive [minutes] [threads]\tCompare a 4 sensor session archive with the CSV file, and load it on 1 up to [threads] threads" << std::endl << "\t\t\t\t\t(30 minutes and one thread per core by default)." << std::endl;
+	std::cout << "\tbenchmark journal [seconds]\tMeasure appending frames to a journal, recover damaged journals and acquire with and without a journal (10 s by default)." << std::endl;
+	std::cout << "\tbenchmark coverage [seconds]\tStop scans of a recorded session on their coverage with a few fill rates (120 s by default)." << std::endl;
+	std::cout << "\tbenchmark refilter [threads]\tMeasure filtering a recorded session again on 1 up to the given number of threads (all cores by default)." << std::endl;
+	std::cout << "\tbenchmark synthetic [sensors] [rate]\tAcquire and filter a synthetic foot and check the scan against its ground truth (16 sensors at 1000 Hz by default)." << std::endl;
 	std::cout << "\thelp \t\t\t\tPrint this screen again." << std::endl;
 	std::cout << "\texit \t\t\t\tCleanly exit the application." << std::endl;
 	std::cout << std::endl;
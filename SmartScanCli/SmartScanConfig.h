@@ -5,6 +5,7 @@
 #include <iostream>
 #include <iomanip>
 #include <limits>
+#include <cstring>
 #include <vector>
 
 #include "SmartScanService.h"
@@ -13,6 +14,9 @@
 
 const bool mockMode = __MOCK; 
 
+// Device backend, see DeviceBackend.h. The mock mode uses the recorded MockData files.
+const SmartScan::device_backend deviceBackend = mockMode ? SmartScan::device_backend::MOCK_FILE : SmartScan::device_backend::TRAKSTAR;
+
 #if __MOCK == true
 
 // Glove setup
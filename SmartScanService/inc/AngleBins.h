@@ -0,0 +1,139 @@
+// This is the SmartScan angle bins class.
+// It maps the direction from a reference point to a sample straight to the theta and phi bin of the scan, without full precision trigonometry.
+// Theta and phi are estimated with a polynomial arctangent that is accurate to about 1e-6 degrees.
+// Only when an estimate lies within a small margin of a bin border, the exact atan2() and acos() of Scan::CalcAngle() decide.
+// The bins are therefore always the same as truncating the exact angles, while the exact functions are needed for only a few samples in a hundred thousand.
+// Bins are limited to the grid, so a radius rounded to a float on the Z axis or an angle of exactly 360 or 180 degrees does not give a bin past the end.
+
+#pragma once
+
+#include <cmath>
+#include <algorithm>
+
+#include "Point3.h"
+
+namespace SmartScan
+{
+	class AngleBins
+	{
+	public:
+		// Constructor. Creates an AngleBins object.
+		// Arguments:
+		// - filteringPrecision : Size of the bins in degrees.
+		AngleBins(int filteringPrecision = 1);
+
+		// Estimated direction of a sample, it does not depend on the filtering precision so it can be shared by scans with different bin sizes.
+		struct Direction
+		{
+			double theta;											// Theta in radians, -PI to PI.
+			double phi;												// Phi in radians, 0 to PI. Not a number for samples without a valid radius.
+		};
+
+		// Estimates the direction from a reference point to a sample.
+		// Arguments:
+		// - refPoint : Reference point. Seen as the origin.
+		// - point : The sample, the radius to the reference point has to be filled in.
+		static Direction Estimate(const Point3& refPoint, const Point3& point)
+		{
+			Direction direction;
+			direction.theta = FastAtan2(point.y - refPoint.y, point.x - refPoint.x);
+
+			// acos(c) is the angle of the vector (c, sqrt(1 - c^2)), 1 - c^2 is factored to keep its precision near the poles.
+			// The radius is rounded to a float, so c can lie just outside -1 to 1 near the Z axis.
+			double c = ClampCosine((point.z - refPoint.z) / point.s.r);
+			direction.phi = FastAtan2(sqrt((1 - c) * (1 + c)), c);
+			return direction;
+		}
+
+		// Calculates the theta and phi bin of a sample. The result is equal to truncating the angles of Scan::CalcAngle() divided by the filtering precision,
+		// limited to the bins of the grid.
+		// Arguments:
+		// - refPoint : Reference point. Seen as the origin.
+		// - point : The sample, the radius to the reference point has to be filled in.
+		// - theta : Pointer to an integer in which the theta bin is stored.
+		// - phi : Pointer to an integer in which the phi bin is stored.
+		void Bin(const Point3& refPoint, const Point3& point, int* theta, int* phi) const
+		{
+			this->Bin(Estimate(refPoint, point), refPoint, point, theta, phi);
+		}
+
+		// Same as Bin(), but starts from a direction that has already been estimated.
+		// Arguments:
+		// - direction : Direction of the sample, estimated with Estimate().
+		// - refPoint : Reference point. Seen as the origin.
+		// - point : The sample, the radius to the reference point has to be filled in.
+		// - theta : Pointer to an integer in which the theta bin is stored.
+		// - phi : Pointer to an integer in which the phi bin is stored.
+		void Bin(const Direction& direction, const Point3& refPoint, const Point3& point, int* theta, int* phi) const
+		{
+			// Theta in bins of 0-360 degrees, phi in bins of 0-180 degrees.
+			double thetaBin = direction.theta * mBinsPerRad + mHalfTurn;
+			double phiBin = direction.phi * mBinsPerRad;
+
+			// Fall back to the exact angles near a bin border, and when phi could not be estimated.
+			if (!(thetaBin >= mMargin && phiBin >= mMargin)) {
+				this->BinExact(refPoint, point, theta, phi);
+				return;
+			}
+			*theta = (int)(thetaBin - mMargin);
+			*phi = (int)(phiBin - mMargin);
+			if (*theta != (int)(thetaBin + mMargin) || *phi != (int)(phiBin + mMargin)) {
+				this->BinExact(refPoint, point, theta, phi);
+				return;
+			}
+
+			// The last bin also takes the rest of the circle when the filtering precision does not divide it.
+			*theta = std::min(*theta, mNumTheta - 1);
+			*phi = std::min(*phi, mNumPhi - 1);
+		}
+
+		// Same as Bin(), but always uses the exact angles.
+		void BinExact(const Point3& refPoint, const Point3& point, int* theta, int* phi) const;
+
+		// Returns a cosine limited to -1 to 1, not a number stays not a number.
+		// Arguments:
+		// - c : The cosine.
+		static double ClampCosine(double c)
+		{
+			return c > 1 ? 1 : (c < -1 ? -1 : c);
+		}
+
+		// Returns an approximation of atan2(y, x) in radians. The error is below 1.2e-8 radians.
+		// The result is not defined when both x and y are 0.
+		static double FastAtan2(double y, double x)
+		{
+			// Reduce to an angle between 0 and 45 degrees, the polynomial in a^2 approximates atan(a) / a there.
+			double ax = std::abs(x), ay = std::abs(y);
+			double a = std::min(ax, ay) / std::max(ax, ay);
+			double t = a * a;
+			double r = a * (0.999999984242635 + t * (-0.3333306678068698 + t * (0.19992483578459427 + t * (-0.14202570511545173 + t * (0.10636754097864426
+				+ t * (-0.07495445443168593 + t * (0.042587607465986825 + t * (-0.016005030504602474 + t * 0.002834064299313468))))))));
+
+			// Unfold the octant. The directions of random samples are not predictable, so this is written as selects instead of branches.
+			r = ay > ax ? halfPi - r : r;
+			r = x < 0 ? pi - r : r;
+			return std::copysign(r, y);
+		}
+	private:
+		static constexpr double pi = 3.141592653589793238463;		// Approximation of PI.
+		static constexpr double halfPi = pi / 2;					// Half of PI.
+		static constexpr float toAngle = (float)(180 / pi);			// Radian to Degree conversion, rounded to a float like the one in the Scan class.
+		static constexpr double margin = 1e-5;						// Largest error of the estimated angles in degrees, with plenty of room to spare.
+
+		double mPrecision;											// Size of the bins in degrees.
+		double mBinsPerRad;											// Number of bins per radian.
+		double mHalfTurn;											// Number of bins in 180 degrees.
+		double mMargin;												// Margin in bins, estimates closer than this to a bin border are not trusted.
+		int mNumTheta;												// Number of theta bins of the grid.
+		int mNumPhi;												// Number of phi bins of the grid.
+
+		// Returns the index of a bin, limited to the bins of the grid. Not a number gives the first bin.
+		// Arguments:
+		// - bin : Angle divided by the filtering precision.
+		// - numBins : Number of bins.
+		static int ClampBin(double bin, int numBins)
+		{
+			return bin > 0 ? std::min((int)std::min(bin, (double)numBins), numBins - 1) : 0;
+		}
+	};
+}
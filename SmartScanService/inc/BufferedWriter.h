@@ -0,0 +1,252 @@
+// This is the SmartScan buffered writer class.
+// It collects the bytes of an export in one large buffer and hands them to the file in big chunks, instead of one small write per value.
+// Binary numbers are written little-endian, whatever the byte order of the machine, as the binary point cloud formats expect.
+// Text numbers are formatted with std::to_chars straight into the buffer, in the same shortest %g notation as writing them to a stream.
+//
+// A text buffer formats text the same way into memory. Several threads can each fill their own text buffer, which are then written in order.
+
+#pragma once
+
+#include <string>
+#include <fstream>
+#include <memory>
+#include <cstring>
+#include <cstdint>
+#include <cstddef>
+#include <charconv>
+#include <algorithm>
+#include <vector>
+
+#include "Exceptions.h"
+
+namespace SmartScan
+{
+	class BufferedWriter
+	{
+	public:
+		static const size_t defaultBufferSize = 1 << 20;			// Default size of the buffer in bytes.
+		static const int maxPrecision = 17;							// Largest number of significant digits of a text number, enough for any double.
+
+		// Constructor. Creates a BufferedWriter object without an open file.
+		BufferedWriter();
+
+		BufferedWriter(const BufferedWriter&) = delete;
+		BufferedWriter& operator=(const BufferedWriter&) = delete;
+
+		// Destructor. Flushes the buffer and closes the file, without throwing when that fails.
+		~BufferedWriter();
+
+		// Create or truncate a file and allocate the buffer. Any earlier file is closed first.
+		// Throws ex_export if the file could not be created.
+		// Arguments:
+		// - filename : Name of the file.
+		// - bufferSize : Size of the buffer in bytes.
+		// - text : When set to "true", the file is opened in text mode, so line ends are translated the same way as by std::endl.
+		void Open(const std::string& filename, size_t bufferSize = defaultBufferSize, bool text = false);
+
+		// Flush the buffer and close the file.
+		// Throws ex_export if the file could not be written.
+		void Close();
+
+		// Write bytes as they are.
+		// Arguments:
+		// - data : Pointer to the bytes.
+		// - size : Number of bytes.
+		void Write(const void* data, size_t size)
+		{
+			if (size > mCapacity - mUsed) {
+				this->Flush();
+				if (size > mCapacity) {
+					this->WriteFile(data, size);
+					return;
+				}
+			}
+			memcpy(mBuffer.get() + mUsed, data, size);
+			mUsed += size;
+		}
+
+		// Write a string without its terminating zero.
+		// Arguments:
+		// - text : The string.
+		void Write(const std::string& text)
+		{
+			this->Write(text.data(), text.size());
+		}
+
+		// Write an unsigned 16-bit integer in little-endian byte order.
+		// Arguments:
+		// - value : The integer.
+		void PutUint16(uint16_t value)
+		{
+			unsigned char bytes[2] = { (unsigned char)value, (unsigned char)(value >> 8) };
+			this->Write(bytes, sizeof(bytes));
+		}
+
+		// Write an unsigned 32-bit integer in little-endian byte order.
+		// Arguments:
+		// - value : The integer.
+		void PutUint32(uint32_t value)
+		{
+			unsigned char bytes[4] = { (unsigned char)value, (unsigned char)(value >> 8), (unsigned char)(value >> 16), (unsigned char)(value >> 24) };
+			this->Write(bytes, sizeof(bytes));
+		}
+
+		// Write an unsigned 64-bit integer in little-endian byte order.
+		// Arguments:
+		// - value : The integer.
+		void PutUint64(uint64_t value)
+		{
+			this->PutUint32((uint32_t)value);
+			this->PutUint32((uint32_t)(value >> 32));
+		}
+
+		// Write a 32-bit IEEE float in little-endian byte order.
+		// Arguments:
+		// - value : The float.
+		void PutFloat(float value)
+		{
+			uint32_t bits;
+			memcpy(&bits, &value, sizeof(bits));
+			this->PutUint32(bits);
+		}
+
+		// Write a 64-bit IEEE double in little-endian byte order.
+		// Arguments:
+		// - value : The double.
+		void PutDouble(double value)
+		{
+			uint64_t bits;
+			memcpy(&bits, &value, sizeof(bits));
+			this->PutUint64(bits);
+		}
+
+		// Write a single character.
+		// Arguments:
+		// - c : The character.
+		void PutChar(char c)
+		{
+			if (mUsed == mCapacity) {
+				this->Flush();
+			}
+			mBuffer[mUsed++] = c;
+		}
+
+		// Write an integer as text.
+		// Arguments:
+		// - value : The integer.
+		void PutText(int64_t value)
+		{
+			this->Reserve();
+			mUsed = std::to_chars(mBuffer.get() + mUsed, mBuffer.get() + mCapacity, value).ptr - mBuffer.get();
+		}
+
+		// Write a double as text, the same as a stream with the given precision writes it.
+		// Arguments:
+		// - value : The double.
+		// - precision : Number of significant digits, from 1 up to maxPrecision.
+		void PutText(double value, int precision)
+		{
+			this->Reserve();
+			mUsed = FormatText(mBuffer.get() + mUsed, mBuffer.get() + mCapacity, value, precision) - mBuffer.get();
+		}
+
+		// Format a double the same as std::to_chars in the general format with a precision, which is also what a stream writes.
+		// Numbers that are written without an exponent are formatted with integer arithmetic, the others and numbers that are too close
+		// to halfway between two outputs to round them safely that way go to std::to_chars.
+		// Returns a pointer one past the last character.
+		// Arguments:
+		// - first : Where the characters are written.
+		// - last : End of the room for the characters.
+		// - value : The double.
+		// - precision : Number of significant digits, from 1 up to maxPrecision.
+		static char* FormatText(char* first, char* last, double value, int precision);
+
+		// Hand the buffered bytes to the file.
+		// Throws ex_export if the file could not be written.
+		void Flush();
+
+		// Returns the number of bytes written so far, including the bytes still in the buffer.
+		const uint64_t BytesWritten() const;
+	private:
+		std::ofstream mFile;										// Output file object.
+		std::unique_ptr<char[]> mBuffer;							// Buffered bytes that have not been handed to the file yet.
+		size_t mCapacity = 0;										// Size of the buffer in bytes.
+		size_t mUsed = 0;											// Number of bytes in the buffer.
+		uint64_t mFlushed = 0;										// Number of bytes handed to the file.
+
+		friend class TextBuffer;
+
+		static const size_t maxTextSize = 32;						// Largest number of characters of a text number.
+
+		// Make room in the buffer for a text number.
+		void Reserve()
+		{
+			if (mCapacity - mUsed < maxTextSize) {
+				this->Flush();
+			}
+		}
+
+		// Write bytes straight to the file.
+		// Arguments:
+		// - data : Pointer to the bytes.
+		// - size : Number of bytes.
+		void WriteFile(const void* data, size_t size);
+	};
+
+	class TextBuffer
+	{
+	public:
+		// Constructor. Creates an empty TextBuffer object.
+		TextBuffer();
+
+		// Remove the text, the memory is kept for the next text.
+		void Clear();
+
+		// Write a single character. (See BufferedWriter::PutChar)
+		// Arguments:
+		// - c : The character.
+		void PutChar(char c)
+		{
+			this->Reserve(1);
+			mText[mUsed++] = c;
+		}
+
+		// Write an integer as text. (See BufferedWriter::PutText)
+		// Arguments:
+		// - value : The integer.
+		void PutText(int64_t value)
+		{
+			this->Reserve(BufferedWriter::maxTextSize);
+			mUsed = std::to_chars(mText.data() + mUsed, mText.data() + mText.size(), value).ptr - mText.data();
+		}
+
+		// Write a double as text, the same as a stream with the given precision writes it. (See BufferedWriter::PutText)
+		// Arguments:
+		// - value : The double.
+		// - precision : Number of significant digits, from 1 up to BufferedWriter::maxPrecision.
+		void PutText(double value, int precision)
+		{
+			this->Reserve(BufferedWriter::maxTextSize);
+			mUsed = BufferedWriter::FormatText(mText.data() + mUsed, mText.data() + mText.size(), value, precision) - mText.data();
+		}
+
+		// Returns a pointer to the text.
+		const char* Data() const;
+
+		// Returns the number of characters of the text.
+		const size_t Size() const;
+	private:
+		std::vector<char> mText;									// The text, followed by room for more.
+		size_t mUsed = 0;											// Number of characters of the text.
+
+		// Make room for more characters, by doubling the memory when it is full.
+		// Arguments:
+		// - size : Number of characters that has to fit.
+		void Reserve(size_t size)
+		{
+			if (mText.size() - mUsed < size) {
+				mText.resize(std::max(mText.size() * 2, mUsed + size));
+			}
+		}
+	};
+}
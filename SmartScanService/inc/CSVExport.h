@@ -1,22 +1,52 @@
 // This is the SmartScan CSVexport class.
 // This class handles the CSV file manipulation i.e. import, export, formatting etc.
+// Every row is formatted straight into the buffer of a BufferedWriter, which hands it to the file in large chunks.
+// The numbers are written exactly as a stream with the same precision writes them, so the files are the same as before, only faster.
+// With a thread pool, batches of rows are split into chunks that are formatted on all threads, each into its own text buffer, and then written in order.
 
 #pragma once
 
 #include <vector>
 #include <string>
-#include <fstream>
+#include <atomic>
+#include <cstdint>
 
 #include "Exceptions.h"
 #include "Point3.h"
+#include "RawStore.h"
+#include "BufferedWriter.h"
+#include "ThreadPool.h"
 
 namespace SmartScan
 {
 	class CSVExport
 	{
 	public:
+		static const int defaultPrecision = 6;		// Default number of significant digits, the default precision of a stream.
+
 		// Constructor. Creates a CSVExport object that handles everything exporting related.
-		CSVExport();
+		// Arguments:
+		// - precision : Number of significant digits of the exported numbers.
+		CSVExport(int precision = defaultPrecision);
+
+		// Set the number of significant digits of the exported numbers.
+		// Throws ex_export if the precision is not between 1 and BufferedWriter::maxPrecision.
+		// Arguments:
+		// - precision : Number of significant digits.
+		void SetPrecision(int precision);
+
+		// Returns the number of significant digits of the exported numbers.
+		const int GetPrecision() const;
+
+		// Format the rows of every export on the threads of a pool. The pool must not run another loop during an export.
+		// Arguments:
+		// - pool : The thread pool, nullptr formats on the calling thread.
+		void SetThreadPool(ThreadPool* pool);
+
+		// Count the written rows of every export in an atomic, so another thread can follow the progress.
+		// Arguments:
+		// - progress : Pointer to the counter, nullptr to stop counting.
+		void SetProgress(std::atomic<size_t>* progress);
 
 		// Export a Point3 vector to a CSV file in the MATLAB format (time, position, rotation, quality and button).
 		// Arguments:
@@ -35,14 +65,53 @@ namespace SmartScan
 		// Arguments:
 		// - data : constant pointer to the raw data buffer (Read only). 
 		// - filename : constant string containing the name of the exported file. 
-		void ExportPoint3Raw(const std::vector<std::vector<Point3>>* data, const std::string filename);
+		// - numFrames : Number of frames that are exported. (Default: all frames published when the export starts)
+		void ExportPoint3Raw(const RawStore* data, const std::string filename, size_t numFrames = SIZE_MAX);
 
 		// Export the raw data buffer to a CSV file in the CloudCompare format (position only).
 		// Arguments:
 		// - data : constant pointer to the raw data buffer (Read only). 
 		// - filename : constant string containing the name of the exported file. 
-		void ExportPoint3RawCloud(const std::vector<std::vector<Point3>>* data, const std::string filename);
+		// - numFrames : Number of frames that are exported. (Default: all frames published when the export starts)
+		void ExportPoint3RawCloud(const RawStore* data, const std::string filename, size_t numFrames = SIZE_MAX);
 	private:
-		std::ofstream csvFile;				// Output file object.
+		static const size_t rowsPerChunk = 1024;	// Number of rows that a thread formats at once.
+
+		BufferedWriter csvFile;				// Output file object.
+		int mPrecision;						// Number of significant digits of the exported numbers.
+		std::atomic<size_t>* pProgress = nullptr;	// Counter of the written rows, nullptr when they are not counted.
+		ThreadPool* pThreadPool = nullptr;	// Pool of threads that format the rows, nullptr to format on the calling thread.
+		std::vector<TextBuffer> mChunks;	// Formatted chunks of rows of one batch, kept between exports.
+
+		// Set the progress counter, if there is one.
+		// Arguments:
+		// - rows : Number of rows written so far.
+		void Progress(size_t rows)
+		{
+			if (pProgress) {
+				pProgress->store(rows, std::memory_order_relaxed);
+			}
+		}
+
+		// Write all rows of an export, on the threads of the pool if there is one.
+		// Arguments:
+		// - numRows : Number of rows.
+		// - writeRow : Function that writes a row, called with the BufferedWriter or TextBuffer to write to and the index of the row.
+		template <class RowWriter>
+		void WriteRows(size_t numRows, const RowWriter& writeRow);
+
+		// Write the position, rotation, quality and button state of a sample, without a line end.
+		// Arguments:
+		// - out : The BufferedWriter or TextBuffer to write to.
+		// - p : The sample.
+		template <class Output>
+		void WriteSample(Output* out, const Point3& p) const;
+
+		// Write the position of a sample and a line end.
+		// Arguments:
+		// - out : The BufferedWriter or TextBuffer to write to.
+		// - p : The sample.
+		template <class Output>
+		void WritePosition(Output* out, const Point3& p) const;
 	};
 }
\ No newline at end of file
@@ -0,0 +1,224 @@
+// This is the SmartScan cell grid class.
+// It provides the binning storage of a scan: one compact cell per reference point, theta and phi bin.
+// A cell only holds what the binning needs, the radius of the best sample and an index back to that sample in the raw store.
+//
+// The cells are stored in cache-aligned blocks of 64 consecutive cells, found through a directory with one pointer per block.
+// A grid that fits in the memory budget is dense: all blocks are allocated up front in one contiguous array.
+// A larger grid is sparse: a block is only allocated when one of its cells is filled, the directory entries of the other blocks stay empty.
+// A foot only covers a small part of the sphere around every reference point, so a sparse grid at a fine filtering precision uses a fraction of the memory.
+//
+// A grid can also track changes, so readers can fetch only the cells that changed since they last looked. Every update stamps the cell, and the block
+// of cells it is in, with the current version. Readers close a version with NextVersion() and later ask for the cells stamped with the version that followed it.
+// Looking up the changes only visits the cells of changed blocks, so it costs about as much as what changed, not as the whole grid.
+//
+// Every cell is a single 64-bit atomic, so a reader never sees the radius of one sample together with the index of another, while the writer does not pay for it.
+
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <cfloat>
+#include <memory>
+#include <new>
+#include <vector>
+#include <atomic>
+
+namespace SmartScan
+{
+	// One bin of the cell grid.
+	struct Cell
+	{
+		float r;													// Radius of the stored sample to its reference point, FLT_MAX when the cell is empty.
+		uint32_t sample;											// Index of the stored sample in the raw store, frame * numSensors + sensor.
+	};
+
+	// Enum containing the outcomes of storing a sample in a cell.
+	enum class cell_update
+	{
+		UNCHANGED,						// The cell already holds a sample with a radius that is not larger.
+		IMPROVED,						// The sample replaced a sample with a larger radius.
+		FILLED,							// The cell was empty.
+	};
+
+	static_assert(std::atomic<Cell>::is_always_lock_free, "Cells have to be read and written without locks.");
+
+	class CellGrid
+	{
+	public:
+		static const uint32_t emptySample = UINT32_MAX;			// Sample index of an empty cell.
+		static const size_t defaultMemoryBudget = 16 << 20;		// Default largest number of bytes of a dense grid.
+
+		// Constructor. Creates an empty CellGrid object. Call Init() before using it.
+		CellGrid();
+
+		// Destructor. Frees the blocks of a sparse grid.
+		~CellGrid();
+
+		// Allocate the cells and mark them empty. The cells are ordered by reference point, then theta and then phi.
+		// Arguments:
+		// - numRefs : Number of reference points.
+		// - numTheta : Number of theta bins.
+		// - numPhi : Number of phi bins.
+		// - trackChanges : When set to "true", every update is stamped with the current version. (See ChangedSince)
+		// - memoryBudget : Largest number of bytes of a dense grid. Grids that need more are sparse.
+		void Init(int numRefs, int numTheta, int numPhi, bool trackChanges = false, size_t memoryBudget = defaultMemoryBudget);
+
+		// Store a sample in a cell if its radius is smaller than the radius already stored.
+		// Returns if the cell was filled, improved or left unchanged. Bins outside the grid are left unchanged, so they can not overwrite a cell of another reference point.
+		// Arguments:
+		// - ref : Index of the reference point.
+		// - theta : Index of the theta bin.
+		// - phi : Index of the phi bin.
+		// - r : Radius of the sample to the reference point.
+		// - sample : Index of the sample in the raw store.
+		cell_update Update(int ref, int theta, int phi, float r, uint32_t sample)
+		{
+			// Negative bins become large unsigned ones, so one comparison per bin is enough.
+			if ((unsigned)theta >= (unsigned)mNumTheta || (unsigned)phi >= (unsigned)mNumPhi) {
+				return cell_update::UNCHANGED;
+			}
+			return this->Update(((size_t)ref * mNumTheta + theta) * mNumPhi + phi, r, sample);
+		}
+
+		// Same as Update(), for a cell given by its index. Indexes outside the grid are left unchanged.
+		// Arguments:
+		// - index : Index of the cell, from 0 up to Size().
+		// - r : Radius of the sample to the reference point.
+		// - sample : Index of the sample in the raw store.
+		cell_update Update(size_t index, float r, uint32_t sample)
+		{
+			if (index >= mSize) {
+				return cell_update::UNCHANGED;
+			}
+
+			// There is only one writer, so the cell does not change between the load and the store.
+			Block* block = mBlocks[index >> blockShift].load(std::memory_order_relaxed);
+			if (!block) {
+				block = this->AllocateBlock(index >> blockShift);
+			}
+			std::atomic<Cell>& cell = block->cells[index & blockMask];
+			Cell old = cell.load(std::memory_order_relaxed);
+			if (r < old.r) {
+				cell.store(Cell { r, sample }, std::memory_order_relaxed);
+				if (mTrackChanges) {
+					this->Stamp(block, index);
+				}
+				return old.sample == emptySample ? cell_update::FILLED : cell_update::IMPROVED;
+			}
+			return cell_update::UNCHANGED;
+		}
+
+		// Mark every cell empty. The blocks of a sparse grid stay allocated, readers may still be looking at them.
+		void Clear();
+
+		// Take over the cells of another grid of the same size that hold a smaller radius. On equal radii the cell of this grid is kept,
+		// so merging the grid of later samples into the grid of earlier ones gives the same cells as storing all samples in order.
+		// Several threads can merge different ranges of cells at the same time.
+		// Arguments:
+		// - other : The grid that is merged into this one.
+		// - begin : First cell that is merged.
+		// - end : One past the last cell that is merged.
+		void Merge(const CellGrid& other, size_t begin, size_t end);
+
+		// Close the current version, later updates are stamped with the next one. Only works when the grid tracks changes.
+		// Returns the new version. Passed to ChangedSince() later, it gives every cell that changed after this call. A cell that changed while the version
+		// was closed can also be given again.
+		uint32_t NextVersion() const;
+
+		// Returns "true" if the grid has been cleared after a version was closed, so changes since that version do not tell the whole story.
+		// Arguments:
+		// - version : Version returned by NextVersion().
+		const bool ClearedSince(uint32_t version) const;
+
+		// Collects the cells stamped with a given version or a later one. Only works when the grid tracks changes.
+		// Arguments:
+		// - version : Version returned by NextVersion(), 0 gives every cell that changed since the grid was last cleared.
+		// - cells : Pointer to a vector to which the indices of the changed cells are appended.
+		void ChangedSince(uint32_t version, std::vector<size_t>* cells) const;
+
+		// Returns a cell. It can be called while the grid is being written, the cell is either the old or the new one.
+		// Arguments:
+		// - index : Index of the cell, from 0 up to Size().
+		const Cell At(size_t index) const
+		{
+			const Block* block = mBlocks[index >> blockShift].load(std::memory_order_acquire);
+			return block ? block->cells[index & blockMask].load(std::memory_order_relaxed) : Cell { FLT_MAX, emptySample };
+		}
+
+		// Copies all cells. It can be called while the grid is being written, every cell is either the old or the new one.
+		// Arguments:
+		// - cells : Pointer to a vector that is resized to Size() and filled with the cells.
+		void CopyCells(std::vector<Cell>* cells) const;
+
+		// Returns the total number of cells.
+		const size_t Size() const;
+
+		// Returns the number of theta bins times the number of phi bins, the number of cells per reference point.
+		const size_t CellsPerRef() const;
+
+		// Returns "true" if blocks of cells are only allocated when they are filled.
+		const bool IsSparse() const;
+
+		// Returns the number of bytes used by the cells, the directory and the stamps.
+		const size_t MemoryUsage() const;
+	private:
+		static const int blockShift = 6;							// Log2 of the number of cells in a block.
+		static const size_t blockSize = (size_t)1 << blockShift;	// Number of cells in a block.
+		static const size_t blockMask = blockSize - 1;				// Mask that gives the index of a cell within its block.
+
+		// A block of consecutive cells, on its own cache lines.
+		struct alignas(64) Block
+		{
+			std::atomic<Cell> cells[blockSize];						// The cells.
+			std::atomic<uint32_t> stamps[blockSize];				// Version of the last update of every cell, only used when changes are tracked.
+		};
+
+		std::unique_ptr<std::atomic<Block*>[]> mBlocks;			// Directory with a pointer to every block, nullptr for blocks of a sparse grid that were never filled.
+		std::unique_ptr<Block[]> mDenseBlocks;						// All blocks of a dense grid, nullptr for a sparse grid.
+		std::atomic<size_t> mNumAllocated { 0 };					// Number of blocks allocated by a sparse grid.
+		size_t mNumBlocks = 0;										// Number of blocks in the directory.
+		size_t mSize = 0;											// Number of cells.
+		int mNumTheta = 0;											// Number of theta bins.
+		int mNumPhi = 0;											// Number of phi bins.
+
+		bool mTrackChanges = false;									// Boolean indicating if updates are stamped.
+		std::unique_ptr<std::atomic<uint32_t>[]> mBlockStamps;		// Version of the last update of every block, nullptr when changes are not tracked.
+		mutable std::atomic<uint32_t> mVersion { 1 };				// Version with which updates are stamped.
+		std::atomic<uint32_t> mClearedVersion { 1 };				// First version after the last Clear().
+
+		// Allocate a block of a sparse grid with empty cells and publish it in the directory.
+		// Returns the block. When another thread published the block first, that block is returned.
+		// Arguments:
+		// - index : Index of the block.
+		Block* AllocateBlock(size_t index);
+
+		// Mark the cells of a block empty and clear their stamps.
+		// Arguments:
+		// - block : The block.
+		static void ClearBlock(Block* block);
+
+		// Free the blocks of a sparse grid.
+		void FreeBlocks();
+
+		// Stamp a cell and its block with the current version.
+		// Arguments:
+		// - block : Block of the cell.
+		// - index : Index of the cell.
+		void Stamp(Block* block, size_t index)
+		{
+			// The stamps are stored after the cell, a reader that sees a stamp also sees the cell it belongs to.
+			uint32_t version = mVersion.load(std::memory_order_relaxed);
+			block->stamps[index & blockMask].store(version, std::memory_order_release);
+			mBlockStamps[index >> blockShift].store(version, std::memory_order_release);
+
+			// A reader may have closed the version in the meantime and already passed this cell, then it is stamped again for the next reader.
+			// Together with the fence in NextVersion() either this load sees the new version, or the reader sees the stamp.
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+			uint32_t current = mVersion.load(std::memory_order_relaxed);
+			if (current != version) {
+				block->stamps[index & blockMask].store(current, std::memory_order_release);
+				mBlockStamps[index >> blockShift].store(current, std::memory_order_release);
+			}
+		}
+	};
+}
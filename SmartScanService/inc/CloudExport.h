@@ -0,0 +1,85 @@
+// This is the SmartScan cloud export class.
+// It exports point clouds in the binary PLY and PCD formats, which CloudCompare and PCL load without parsing any text.
+// Every point is written as 32-bit little-endian values through a large buffered writer, so exporting a long raw session is bound by the disk, not by formatting.
+// A binary point takes 12 bytes for its position, against 25 to 30 characters for the same position in a CSV file.
+
+#pragma once
+
+#include <vector>
+#include <string>
+#include <atomic>
+#include <cstdint>
+
+#include "Exceptions.h"
+#include "Point3.h"
+#include "RawStore.h"
+#include "BufferedWriter.h"
+
+namespace SmartScan
+{
+	// Enum containing the binary point cloud formats.
+	enum class cloud_format
+	{
+		PLY,							// Stanford polygon file, binary little-endian.
+		PCD,							// Point Cloud Library file, binary.
+	};
+
+	// Struct containing the format of an exported point cloud and the properties written next to the position of every point.
+	struct CloudOptions
+	{
+		cloud_format format = cloud_format::PLY;				// File format.
+		bool normals = false;									// Write the unit vector from the reference point to the point. Raw samples use the reference sensor.
+		bool quality = false;									// Write the quality of the sample, which indicates magnetic interference.
+		bool radius = false;									// Write the distance from the reference point to the point. Raw samples use the reference sensor.
+	};
+
+	class CloudExport
+	{
+	public:
+		// Constructor. Creates a CloudExport object.
+		CloudExport();
+
+		// Export a Point3 vector, for example a copy of a scan, to a binary point cloud file.
+		// Throws ex_export if the vector is empty or the file could not be written.
+		// Arguments:
+		// - data : constant pointer to the Point3 vector (Read only).
+		// - filename : constant string containing the name of the exported file.
+		// - options : Format of the file and the properties that are written.
+		void ExportCloud(const std::vector<Point3>* data, const std::string filename, const CloudOptions& options);
+
+		// Export the raw data buffer to a binary point cloud file, sensor by sensor just like CSVExport::ExportPoint3RawCloud().
+		// The samples are read straight from the store, only the frames published when the export starts are written.
+		// Throws ex_export if the buffer is empty or the file could not be written.
+		// Arguments:
+		// - data : constant pointer to the raw data buffer (Read only).
+		// - filename : constant string containing the name of the exported file.
+		// - options : Format of the file and the properties that are written.
+		// - numFrames : Number of frames that are exported. (Default: all frames published when the export starts)
+		void ExportRawCloud(const RawStore* data, const std::string filename, const CloudOptions& options, size_t numFrames = SIZE_MAX);
+
+		// Count the written points of every export in an atomic, so another thread can follow the progress.
+		// Arguments:
+		// - progress : Pointer to the counter, nullptr to stop counting.
+		void SetProgress(std::atomic<size_t>* progress);
+
+		// Returns the file extension of a format, including the dot.
+		// Arguments:
+		// - format : The format.
+		static const std::string Extension(cloud_format format);
+	private:
+		BufferedWriter mWriter;									// Buffered output file.
+		std::atomic<size_t>* pProgress = nullptr;				// Counter of the written points, nullptr when they are not counted.
+
+		// Write the header of the file.
+		// Arguments:
+		// - numPoints : Number of points in the file.
+		// - options : Format of the file and the properties that are written.
+		void WriteHeader(size_t numPoints, const CloudOptions& options);
+
+		// Write one point with the selected properties.
+		// Arguments:
+		// - point : The point. For a sample without a radius the reference sensor is taken as the reference point.
+		// - options : The properties that are written.
+		void WritePoint(const Point3& point, const CloudOptions& options);
+	};
+}
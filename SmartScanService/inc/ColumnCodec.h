@@ -0,0 +1,41 @@
+// This is the SmartScan column codec class.
+// It compresses a column of integers, such as the quantized X positions of one sensor, into a stream of bytes that can be decoded on its own.
+// Every value is predicted from the values before it: either the previous value, or the line through the previous two for smooth signals like
+// positions and time stamps. The difference is zigzag encoded, so small negative numbers become small positive numbers. Small differences are a
+// token of their own, larger ones are a token for their length and highest bits followed by the lower bits as they are. The tokens are entropy
+// coded with a static rANS coder, which spends a fraction of a bit on a value of a column that hardly changes.
+// The codec is lossless for any 64-bit integer, it has no dependencies and decodes one column without touching any other.
+
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+namespace SmartScan
+{
+	class ColumnCodec
+	{
+	public:
+		static const int maxOrder = 2;							// Highest order of the prediction, the line through the previous two values.
+
+		// Encode a column and append its stream to a vector. The order of the prediction that gives the smallest differences is picked by itself.
+		// Arguments:
+		// - values : Pointer to the values.
+		// - count : Number of values.
+		// - stream : Pointer to the vector to which the stream is appended.
+		static void Encode(const int64_t* values, size_t count, std::vector<uint8_t>* stream);
+
+		// Decode a stream that was written by Encode().
+		// Returns "false" if the stream is damaged or does not hold exactly count values.
+		// Arguments:
+		// - stream : Pointer to the first byte of the stream.
+		// - size : Size of the stream in bytes.
+		// - values : Pointer to room for count values.
+		// - count : Number of values in the stream.
+		static bool Decode(const uint8_t* stream, size_t size, int64_t* values, size_t count);
+	private:
+		static const int scaleBits = 12;						// The symbol frequencies add up to 2^scaleBits.
+		static const uint32_t lowerBound = 1u << 23;			// Lower bound of the normalized rANS state, the state is renormalized a byte at a time.
+	};
+}
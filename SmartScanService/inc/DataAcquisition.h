@@ -1,5 +1,5 @@
 // This is the SmartSCan data acquisition class.
-// It provides an abstraction layer for gathering and storing sensor data from the TrakStar device.
+// It provides an abstraction layer for gathering and storing sensor data from the TrakStar device or one of the other device backends.
 
 #pragma once
 
@@ -10,38 +10,48 @@
 #include <chrono>
 #include <functional>
 #include <cmath>
+#include <atomic>
+#include <memory>
+#include <string>
+#include <variant>
 
 #include "Point3.h"
+#include "FrameRing.h"
+#include "RawStore.h"
+#include "SessionJournal.h"
+#include "SampleScheduler.h"
+#include "DeviceBackend.h"
 #include "TrakStarController.h"
+#include "MockFileDevice.h"
+#include "SyntheticDevice.h"
+#include "ReplayDevice.h"
 #include "Trigger.h"
 
 namespace SmartScan
 {
-    struct DataAcqConfig
-    {
-        short int transmitterID = 0;                    // Port of the transmitter, is usually 0 with one trakStar device.
-        double measurementRate = 50;                    // Between 20.0 and 255.0.
-        double powerLineFrequency = 50.0;               // Either 50.0 or 60.0.
-        double maximumRange = 36.0;                     // Either 36.0 (914,4 mm), 72.0 and 144.0.
-		int refSensorSerial = -1;						// Serial number of the reference sensor, set as -1 when no reference sensor is used.
-		double frameRotations[3] = {0, 0, 0};			// Set the rotation of the measurement frame, azimuth, elevation and roll. (0, 0, 0) is default.
-
-		DataAcqConfig();
-		DataAcqConfig(short int transmitterID, double measurementRate, double powerLineFrequency, double maximumRange, int refSensorSerial, double frameRotations[3]);
-    };
+	// Variant that holds the device backend picked by DataAcq. Only backends that are available in this build are part of it.
+#ifdef SMARTSCAN_TRAKSTAR
+	typedef std::variant<TrakStarController, MockFileDevice, SyntheticDevice, ReplayDevice> DeviceVariant;
+#else
+	typedef std::variant<MockFileDevice, SyntheticDevice, ReplayDevice> DeviceVariant;
+#endif
 
 	class DataAcq 
 	{
 	public:
-		// Constructor. Creates a DataAcquisition object that handles data storage and a TrakStarController abstraction layer.
+		// Constructor. Creates a DataAcquisition object that handles data storage and a device abstraction layer.
 		// Arguments:
-		// - useMockData : When set to "true", a mock trakSTAR device is used. It will try to use the real thing otherwise.
+		// - useMockData : When set to "true", the mock data files are used. It will try to use the real TrakStar device otherwise.
+		// - backend : Device backend that is used to acquire samples.
+		// - source : File name of the session that is replayed, only used by the REPLAY backend.
 		DataAcq(bool useMockData);
+		DataAcq(device_backend backend, const std::string source = "");
 
 		// Destructor. Is here to make sure the data is cleaned up if the DataAcquisition object is removed.
 		~DataAcq();
 
 		// Initialise the SmartScan data acquisition. Call this before starting scans.
+		// Throws ex_acq while a journal is open, close it first.
 		// Arguments:
 		// - acquistionConfig : Configuration struct that specifies the settings with which the TrakStar device is initalized. 
 		void Init();
@@ -63,8 +73,32 @@ namespace SmartScan
         // Returns a boolean indicating if the DataAcquisition thread is running.
 		const bool IsRunning() const;
 
+		// Write every acquired frame to a journal as well, so the session can be recovered after a crash. (See SessionJournal.h)
+		// The frames that were already recorded are written first. Clearing the data also clears the journal.
+		// Throws ex_acq if data acquisition is not initialised, is running or the journal could not be created.
+		// Arguments:
+		// - filename : Name of the journal.
+		// - minutes : Number of minutes of frames for which the journal is allocated.
+		void OpenJournal(const std::string filename, double minutes = SessionJournal::defaultMinutes);
+
+		// Stop journaling. The journal is flushed to disk and kept.
+		// Throws ex_acq if data acquisition is running or the journal could not be written.
+		void CloseJournal();
+
+		// Returns the journal of the acquired frames, for read-only access.
+		const SessionJournal* GetJournal() const;
+
         // Returns a pointer to the raw data buffer, for read-only access.
-		const std::vector<std::vector<Point3>>* GetRawBuffer();
+		const RawStore* GetRawBuffer();
+
+		// Returns a pointer to the frame ring in which every acquired frame is published, for read-only access.
+		const FrameRing* GetFrameRing() const;
+
+		// Returns the configuration with which data acquisition was initialised.
+		const DataAcqConfig& GetConfig() const;
+
+		// Returns the serial numbers of the sensors, excluding the reference sensor, in the order of the samples in a frame.
+		const std::vector<int>& GetSerials() const;
 
 		// Acquire a single sample from a specific sensor.
 		// Returns a Point3 object.
@@ -73,6 +107,9 @@ namespace SmartScan
 		// - raw : When set to "True", the acquired sample will not be corrected for the reference sensor.
 		Point3 GetSingleSample(int serialNumber, bool raw);
 
+		// Returns the timing statistics of the current or last acquisition run, such as how late samples were taken compared to their deadline.
+		const SamplingStats GetSamplingStats() const;
+
 		// Returns the number of attached boards to this PC.
 		const int NumAttachedBoards() const;
 
@@ -87,18 +124,21 @@ namespace SmartScan
 		// - callback : Contains the function that is executed. The function should take a vector of points as an argument.
 		void RegisterRawDataCallback(std::function<void(const std::vector<Point3>&)> callback);
 	private:
-		const bool mUseMockData;											// Boolean indicating if Mock data is used.
+		const device_backend mBackend;										// Device backend in use.
 		DataAcqConfig mConfig;                    							// DataAcquisition configuration obj.
 
-		bool mRunning = false;                          					// Boolean indicating if the DataAcquisition thread is running.
+		std::atomic<bool> mRunning { false };								// Boolean indicating if the DataAcquisition thread is running.
 
-		TrakStarController mTSCtrl;                     					// TrackStar controller obj.
+		DeviceVariant mDevice;                     							// Device backend obj.
 		Trigger button_obj;													// Trigger obj.
 
 		int refSensorPort = -1;												// Port number of the reference sensor.
 		std::vector<int> mPortNumBuff;										// Vector containing the sensor port numbers.
 		std::vector<int> mSerialBuff;										// Vector containing sensor serial numbers.
-		std::vector<std::vector<Point3>> mRawBuff;      					// Raw data vector.
+		RawStore mRawBuff;      											// Raw data store, keeps every acquired frame.
+		SessionJournal mJournal;											// Journal on disk of every acquired frame, when one is open.
+		FrameRing mFrameRing;												// Ring through which frames are handed to the scans.
+		SampleScheduler mScheduler;											// Paces the acquisition loop.
 
 		std::unique_ptr<std::thread> pAcquisitionThread;					// Data acquisition thread.
 		
@@ -106,6 +146,7 @@ namespace SmartScan
 
 		const double toRad = 3.14159265/180;								// Store degree to rad constant for easier acces later.
         const double zCaseOffset = 45.72;                                   // Distance from bottom face of the transmitter to zero point.
+		const double ringBufferTime = 8.0;									// Number of seconds of frames the frame ring can hold.
 
 		// Return the port number of a sensor based on its serial number. 
 		// Arguments:
@@ -121,6 +162,12 @@ namespace SmartScan
 		// This function is run in a seperate thread.
 		void DataAcquisition();
 
+		// The acquisition loop, instantiated for every device backend so samples are read without virtual dispatch.
+		// Arguments:
+		// - device : The device backend from which the samples are read.
+		template <class Device>
+		void AcquisitionLoop(Device& device);
+
 		// Correct a point for the rotation of a refernce sensor.
 		// Arguments:
 		// - refPoint : Pointer to the Point3Ref containing the position and rotation of the reference sensor.
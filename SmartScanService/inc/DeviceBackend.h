@@ -0,0 +1,64 @@
+// This is the SmartScan device backend definition.
+// Data acquisition talks to the tracking hardware through a device backend. Every backend is a separate class with the same set of member functions:
+//
+//   void Configure(const DataAcqConfig& config);                              Initialise the device and apply the acquisition configuration.
+//   void SetReferenceSensor(int id);                                          Prepare a sensor port to be used as reference sensor.
+//   void SetSensorOffset(int id, Point3 offset);                              Set the X, Y and Z offset of a sensor port.
+//   const int NumAttachedBoards() const;                                      Status: number of attached boards.
+//   const int NumAttachedTransmitters() const;                                Status: number of attached transmitters.
+//   std::vector<int> GetAttachedPorts() const;                                Status: ports where a sensor is attached.
+//   std::vector<int> GetAttachedSerials() const;                              Status: serial numbers of the attached sensors.
+//   Point3 GetRecord(int id);                                                 Read a single sensor.
+//   Point3Ref GetRefRecord(int id);                                           Read a single sensor as reference record.
+//   void GetFrame(std::vector<Point3>* records, Point3Ref* refRecord, int refId);   Batch read of all sensors, indexed by port.
+//
+// The backend is picked once when the DataAcq object is created. The acquisition loop is instantiated for each backend type,
+// so reading samples is a direct call without virtual dispatch.
+
+#pragma once
+
+// The TrakStar backend needs the ATC3DG driver, which is only available on Windows.
+// Define SMARTSCAN_NO_TRAKSTAR to build without it, for example to profile with the mock backends.
+#if defined(_WIN32) && !defined(SMARTSCAN_NO_TRAKSTAR)
+#define SMARTSCAN_TRAKSTAR
+#endif
+
+namespace SmartScan
+{
+	// Enum containing all the device backends.
+	enum class device_backend
+	{
+		TRAKSTAR,							// The real TrakStar device through the ATC3DG driver.
+		MOCK_FILE,							// Recorded samples from the MockData csv files.
+		SYNTHETIC,							// Samples generated on a parametric foot surface, no files or hardware needed.
+		REPLAY,								// Replay of a raw session exported with CSVExport::ExportPoint3Raw.
+	};
+
+	// Settings of the synthetic device backend. (See SyntheticDevice.h)
+	struct SyntheticConfig
+	{
+		int numSensors = 2;								// Number of sensors that stroke the foot, the reference sensor comes on top of these.
+		double noise = 0.1;								// Standard deviation of the position noise in mm.
+		unsigned short quality = 0;						// Quality value reported with every sample.
+		double strokeFrequency = 0.5;					// Number of back and forth strokes per second of every sensor.
+		double footLength = 250.0;						// Length of the foot surface in mm.
+		double footWidth = 100.0;						// Largest width of the foot surface in mm.
+		double footHeight = 80.0;						// Largest height of the foot surface in mm.
+		bool moveReference = true;						// Move and rotate the reference sensor, the foot moves along with it.
+		unsigned int seed = 1;							// Seed of the noise generator, the same seed gives the same samples.
+	};
+
+    struct DataAcqConfig
+    {
+        short int transmitterID = 0;                    // Port of the transmitter, is usually 0 with one trakStar device.
+        double measurementRate = 50;                    // Between 20.0 and 255.0.
+        double powerLineFrequency = 50.0;               // Either 50.0 or 60.0.
+        double maximumRange = 36.0;                     // Either 36.0 (914,4 mm), 72.0 and 144.0.
+		int refSensorSerial = -1;						// Serial number of the reference sensor, set as -1 when no reference sensor is used.
+		double frameRotations[3] = {0, 0, 0};			// Set the rotation of the measurement frame, azimuth, elevation and roll. (0, 0, 0) is default.
+		SyntheticConfig synthetic;						// Settings of the synthetic device, only used by the SYNTHETIC backend.
+
+		DataAcqConfig();
+		DataAcqConfig(short int transmitterID, double measurementRate, double powerLineFrequency, double maximumRange, int refSensorSerial, double frameRotations[3]);
+    };
+}
@@ -0,0 +1,108 @@
+// This is the SmartScan equal-area bins class.
+// It divides the sphere around a reference point into cells of equal area, with the equal-area octahedral mapping of Clarberg (2008).
+// The mapping unfolds the sphere onto a square without distorting areas, so a regular grid on the square gives cells of exactly the same solid angle.
+// Theta/phi bins waste cells near the poles, here every cell covers as much of the foot as any other.
+//
+// The square is divided into tiles of 8 by 8 cells. The tiles are stored row by row, and the cells within a tile in Morton order.
+// The cells of a parent cell, 2 by 2 cells one level up, are therefore consecutive, and the index of the parent is the index of a cell shifted by two bits per level.
+// Level 3 is a whole tile, which is also exactly one block of the cell grid.
+
+#pragma once
+
+#include <cmath>
+#include <algorithm>
+
+#include "Point3.h"
+#include "AngleBins.h"
+
+namespace SmartScan
+{
+	class EqualAreaBins
+	{
+	public:
+		static const int tileShift = 3;								// Log2 of the number of cells along the side of a tile.
+		static const int maxLevel = tileShift;						// Highest level of parent cells, a whole tile.
+
+		// Constructor. Creates an EqualAreaBins object.
+		// Arguments:
+		// - filteringPrecision : Size of the theta/phi bins in degrees. The cells get at most the area of a theta/phi bin at the equator.
+		EqualAreaBins(int filteringPrecision = 1);
+
+		// Returns the cell of a sample.
+		// Arguments:
+		// - refPoint : Reference point. Seen as the origin.
+		// - point : The sample, the radius to the reference point has to be filled in.
+		int Bin(const Point3& refPoint, const Point3& point) const
+		{
+			// Unit vector from the reference point to the sample. A sample on the reference point ends up in a corner cell.
+			double scale = point.s.r > 0 ? 1 / point.s.r : 0;
+			double x = (point.x - refPoint.x) * scale, y = (point.y - refPoint.y) * scale, z = (point.z - refPoint.z) * scale;
+
+			// Distance from the centre of the square, it only depends on z.
+			double r = sqrt(std::max(1 - std::abs(z), 0.0));
+
+			// Angle around the Z axis within the quadrant, as a fraction of 90 degrees.
+			double ax = std::abs(x), ay = std::abs(y);
+			double a = std::max(ax, ay);
+			double f = a > 0 ? AngleBins::FastAtan2(std::min(ax, ay), a) * (2 / pi) : 0;
+			f = ax < ay ? 1 - f : f;
+
+			// Position on the square, the lower hemisphere is folded onto the corners.
+			double v = f * r;
+			double u = r - v;
+			if (z < 0) {
+				double t = u;
+				u = 1 - v;
+				v = 1 - t;
+			}
+			u = std::copysign(u, x);
+			v = std::copysign(v, y);
+
+			int cu = std::min(std::max((int)((u + 1) * mHalfSide), 0), mSide - 1);
+			int cv = std::min(std::max((int)((v + 1) * mHalfSide), 0), mSide - 1);
+			return this->Cell(cu, cv);
+		}
+
+		// Returns the index of the parent cell of a cell.
+		// Arguments:
+		// - cell : Index of the cell.
+		// - level : Number of levels up, from 0 for the cell itself to maxLevel for its tile.
+		static int Parent(int cell, int level)
+		{
+			return cell >> (2 * level);
+		}
+
+		// Returns the number of cells on the sphere.
+		const int NumCells() const;
+
+		// Returns the number of cells along the side of the square.
+		const int Side() const;
+
+		// Returns the solid angle of a cell in steradians.
+		const double CellArea() const;
+	private:
+		static constexpr double pi = 3.141592653589793238463;		// Approximation of PI.
+
+		int mSide;													// Number of cells along the side of the square, a multiple of the tile size.
+		int mTilesPerSide;											// Number of tiles along the side of the square.
+		double mHalfSide;											// Half of the number of cells along the side, the scale from [-1, 1] to cells.
+
+		// Returns the index of the cell at a position on the square.
+		// Arguments:
+		// - u, v : Position of the cell along the sides of the square.
+		int Cell(int u, int v) const
+		{
+			const int tileMask = (1 << tileShift) - 1;
+			int tile = (v >> tileShift) * mTilesPerSide + (u >> tileShift);
+			return (tile << (2 * tileShift)) | Spread(u & tileMask) | (Spread(v & tileMask) << 1);
+		}
+
+		// Spread the bits of a position within a tile over the even bits, for the Morton order.
+		// Arguments:
+		// - x : Position within a tile, 0 to 7.
+		static int Spread(int x)
+		{
+			return (x & 1) | ((x & 2) << 1) | ((x & 4) << 2);
+		}
+	};
+}
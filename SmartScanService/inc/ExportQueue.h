@@ -0,0 +1,103 @@
+// This is the SmartScan export queue class.
+// It writes exports on a background thread, one after the other, so the caller and data acquisition never wait for the disk.
+// Every export is a job: the caller takes a consistent snapshot of what is exported, queues the job and gets a handle back.
+// The handle tells how far the export is, and holds a future that becomes ready when the file has been written.
+
+#pragma once
+
+#include <string>
+#include <deque>
+#include <memory>
+#include <functional>
+#include <future>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+
+#include "ThreadPool.h"
+
+namespace SmartScan
+{
+	// Enum containing the states of an export job.
+	enum class export_state
+	{
+		QUEUED,							// Waiting for earlier exports to finish.
+		RUNNING,						// Being written.
+		DONE,							// The file has been written.
+		FAILED,							// The export threw an exception, the future throws it again.
+	};
+
+	class ExportJob
+	{
+	public:
+		// Function that writes the file. It counts the rows it has written in the given counter, and can spread its work over the threads of the given pool.
+		typedef std::function<void(std::atomic<size_t>*, ThreadPool*)> Writer;
+
+		// Constructor. Creates a queued ExportJob object.
+		// Arguments:
+		// - filename : Name of the exported file.
+		// - numRows : Number of rows that the writer writes, used for the progress.
+		// - write : Function that writes the file.
+		ExportJob(const std::string filename, size_t numRows, Writer write);
+
+		// Returns the state of the export.
+		const export_state GetState() const;
+
+		// Returns the fraction of the rows that has been written, from 0 to 1.
+		const double GetProgress() const;
+
+		// Returns the name of the exported file.
+		const std::string& GetFilename() const;
+
+		// Returns a future that becomes ready when the export has finished. Its get() throws the exception of a failed export again.
+		std::shared_future<void> GetFuture() const;
+	private:
+		friend class ExportQueue;
+
+		const std::string mFilename;								// Name of the exported file.
+		const size_t mNumRows;										// Number of rows that the writer writes.
+		Writer mWrite;												// Function that writes the file.
+		std::atomic<size_t> mRowsWritten { 0 };						// Number of rows written so far.
+		std::atomic<export_state> mState { export_state::QUEUED };	// State of the export.
+		std::promise<void> mDone;									// Promise that is fulfilled when the export has finished.
+		std::shared_future<void> mFuture;							// Future of mDone.
+	};
+
+	class ExportQueue
+	{
+	public:
+		// Constructor. Creates an empty ExportQueue object. The writing thread and its thread pool are started by the first export.
+		ExportQueue();
+
+		// Destructor. Finishes the queued exports and stops the writing thread.
+		~ExportQueue();
+
+		ExportQueue(const ExportQueue&) = delete;
+		ExportQueue& operator=(const ExportQueue&) = delete;
+
+		// Queue an export. The writer runs on the writing thread, so everything it reads has to stay valid until the export has finished.
+		// Returns the handle of the export.
+		// Arguments:
+		// - filename : Name of the exported file.
+		// - numRows : Number of rows that the writer writes, used for the progress.
+		// - write : Function that writes the file.
+		std::shared_ptr<ExportJob> Push(const std::string filename, size_t numRows, ExportJob::Writer write);
+
+		// Block until all queued exports have finished.
+		void Wait();
+
+		// Returns the number of exports that are queued or being written.
+		const int NumPending() const;
+	private:
+		std::deque<std::shared_ptr<ExportJob>> mJobs;				// Queued exports, the first one is being written.
+		mutable std::mutex mMutex;									// Mutex protecting the queue.
+		std::condition_variable mChanged;							// Condition variable signalled when an export is queued or has finished.
+		std::unique_ptr<std::thread> pWritingThread;				// Writing thread.
+		std::unique_ptr<ThreadPool> pThreadPool;					// Thread pool of the writing thread, apart from the pool of the service so exports and filtering do not wait for each other.
+		bool mExit = false;											// Set by the destructor to end the writing thread.
+
+		// Function that writes the queued exports. This function is run in a seperate thread.
+		void Writing();
+	};
+}
@@ -0,0 +1,109 @@
+// This is the SmartScan filter engine class.
+// It filters the frames of data acquisition into all scans of a SmartScanService in a single thread, instead of one thread per scan.
+// Every frame is read from the frame ring once. Scans with the same reference points form a group, and the nearest reference point,
+// the radius and the direction of every sample are calculated once per group. Every scan then only applies its own outlier threshold and bin size.
+// Comparing a few parameter variants of a scan therefore costs about as much as a single scan.
+//
+// Scans can be started, stopped and caught up independently: the engine always filters the oldest frame that a scan still needs,
+// for all scans that need that frame. Scans that are behind catch up first, after that all scans move through the frames together.
+
+#pragma once
+
+#include <vector>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+
+#include "Point3.h"
+#include "FrameRing.h"
+#include "RefIndex.h"
+#include "Scan.h"
+
+namespace SmartScan
+{
+	class FilterEngine
+	{
+	public:
+		// Constructor. Creates a FilterEngine object.
+		// Arguments:
+		// - inBuff : Frame ring in which data acquisition publishes the raw frames.
+		FilterEngine(const FrameRing* inBuff);
+
+		// Destructor. Stops the filtering thread, also when scans have not caught up yet.
+		~FilterEngine();
+
+		// Add a scan to the engine. The scan is filtered once it is started with Scan::Run().
+		// Arguments:
+		// - scan : The scan, it has to be created with a pointer to this engine.
+		void Add(std::shared_ptr<Scan> scan);
+
+		// Remove a scan from the engine. Does nothing if the scan was not added.
+		// Arguments:
+		// - scan : The scan that is removed.
+		void Remove(const Scan* scan);
+
+		// Start filtering a scan, and the filtering thread if it is not running. Called by Scan::Run().
+		// Arguments:
+		// - scan : The scan that is started.
+		void Start(Scan* scan);
+
+		// Wake the filtering thread so it notices that a scan was stopped. Called by Scan::Stop().
+		void Wake();
+
+		// Returns "true" if the engine still filters a scan, because it is running or has not caught up yet.
+		// Arguments:
+		// - scan : The scan.
+		const bool IsFiltering(const Scan* scan) const;
+
+		// Block until the engine no longer filters a scan, because it was stopped and caught up. Called by Scan::Stop() before the scan is cleared.
+		// Arguments:
+		// - scan : The scan.
+		void WaitForScan(const Scan* scan);
+
+		// Block until the filtering thread has finished. It finishes when no scan is running and all stopped scans have caught up.
+		void Wait();
+
+		// Returns the number of groups of scans with the same reference points.
+		const int NumGroups() const;
+	private:
+		// Scans with the same reference points, and the per sample results they share.
+		struct Group
+		{
+			std::vector<Point3> refPoints;							// Reference points of all scans in the group.
+			RefIndex refIndex;										// Index used to find the nearest reference point.
+			std::vector<std::shared_ptr<Scan>> scans;				// Scans in the group.
+			std::vector<Point3> frame;								// Frame with the radius of every sample to its nearest reference point filled in.
+			std::vector<SharedSample> samples;						// Nearest reference point and direction of every sample in the frame.
+		};
+
+		const FrameRing* mInBuff;									// Frame ring in which data acquisition publishes the raw frames.
+
+		std::vector<std::unique_ptr<Group>> mGroups;				// Groups of scans with the same reference points.
+		std::vector<Point3> mFrame;									// Local copy of the frame that is being filtered.
+		std::vector<Scan*> mNeedFrame;								// Scans of one group that need the frame that is being filtered.
+
+		mutable std::mutex mMutex;									// Mutex protecting the groups and the state of the filtering thread.
+		std::condition_variable mIdle;								// Condition variable on which Wait() and WaitForScan() wait for the thread or a scan to finish.
+		std::unique_ptr<std::thread> pFilteringThread;				// Filtering thread.
+		bool mThreadActive = false;									// Boolean indicating if the filtering thread is running.
+		std::atomic<bool> mKeepWaiting { false };					// Cleared to wake the filtering thread while it waits for a frame.
+		std::atomic<bool> mExit { false };							// Set by the destructor to end the filtering thread.
+
+		// Function that filters the frames of the frame ring into the scans. This function is run in a seperate thread.
+		void Filtering();
+
+		// Returns "true" if the engine still has to filter frames into a scan, because it is running or has not caught up yet.
+		// Arguments:
+		// - scan : The scan.
+		// - committed : Number of frames committed to the frame ring.
+		bool IsActive(const Scan& scan, uint64_t committed) const;
+
+		// Filter a frame into all scans of a group that need it.
+		// Arguments:
+		// - group : The group.
+		// - index : Index of the frame, it has already been copied into mFrame.
+		void FilterGroup(Group* group, int index);
+	};
+}
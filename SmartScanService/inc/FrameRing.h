@@ -0,0 +1,81 @@
+// This is the SmartScan frame ring class.
+// It provides a lock-free single-producer/multi-consumer ring buffer through which the data acquisition thread hands whole frames to the scan threads.
+// A frame contains one sample of every sensor. Frames are published with a commit index, every consumer reads at its own cursor.
+// Consumers that have caught up block in WaitForFrame() until the producer commits the next frame, so idle consumers do not use any CPU.
+
+#pragma once
+
+#include <vector>
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <condition_variable>
+
+#include "Point3.h"
+
+namespace SmartScan
+{
+	class FrameRing
+	{
+	public:
+		// Constructor. Creates an empty FrameRing object. Call Init() before producing or consuming frames.
+		FrameRing();
+
+		// Allocate the ring storage. Not thread safe, only call this while there is no producer or consumer running.
+		// Arguments:
+		// - numSensors : Number of samples in one frame.
+		// - minCapacity : Minimum number of frames the ring can hold. Rounded up to a power of two.
+		void Init(int numSensors, int minCapacity);
+
+		// Returns a pointer to the slot of the next frame, in which the producer writes numSensors samples.
+		// The frame is not visible to the consumers until CommitFrame() is called.
+		Point3* BeginFrame();
+
+		// Publish the frame written through BeginFrame() to the consumers, and wake the consumers that are waiting for it.
+		void CommitFrame();
+
+		// Block until a frame has been committed or the consumer is told to stop.
+		// Returns "true" if the frame has been committed.
+		// Arguments:
+		// - index : Index of the frame to wait for.
+		// - keepWaiting : Flag of the consumer, the wait ends when it is cleared and WakeAll() is called.
+		bool WaitForFrame(uint64_t index, const std::atomic<bool>& keepWaiting) const;
+
+		// Wake all waiting consumers so they can check their flag again. Call this after clearing the flag of a waiting consumer.
+		void WakeAll() const;
+
+		// Copy a committed frame into a consumer owned buffer.
+		// Returns "false" if the frame has not been committed yet or has already been overwritten by the producer.
+		// Arguments:
+		// - index : Index of the frame that needs to be read.
+		// - frame : Pointer to a buffer that can hold at least numSensors samples.
+		bool ReadFrame(uint64_t index, Point3* frame) const;
+
+		// Returns the commit index. This is the number of frames published since the last Clear().
+		uint64_t Committed() const;
+
+		// Returns the index of the oldest frame that can still be read.
+		uint64_t Oldest() const;
+
+		// Reset the commit index to zero. Only call this while the producer is stopped.
+		void Clear();
+
+		// Returns the number of samples in one frame.
+		const int NumSensors() const;
+
+		// Returns the number of frames the ring can hold.
+		const int Capacity() const;
+	private:
+		int mNumSensors = 0;										// Number of samples per frame.
+		uint64_t mCapacity = 0;										// Number of frame slots, always a power of two.
+		uint64_t mMask = 0;											// Mask used to map a frame index to a slot.
+
+		std::vector<Point3> mSlots;									// Frame storage, mCapacity * mNumSensors samples.
+
+		std::atomic<uint64_t> mCommitIndex { 0 };					// Number of published frames, only written by the producer.
+
+		mutable std::mutex mWaitMutex;								// Mutex protecting the wait of the consumers.
+		mutable std::condition_variable mWaitCondition;				// Condition variable on which caught up consumers wait.
+		mutable std::atomic<int> mNumWaiting { 0 };					// Number of waiting consumers, the producer only notifies when there are any.
+	};
+}
@@ -0,0 +1,47 @@
+// This is the SmartScan mapped file class.
+// It provides read-only access to a whole file through a memory mapping, so the file can be parsed without copying it into a buffer first.
+
+#pragma once
+
+#include <string>
+#include <cstddef>
+
+namespace SmartScan
+{
+	class MappedFile
+	{
+	public:
+		// Constructor. Creates a MappedFile object without an open file.
+		MappedFile();
+
+		MappedFile(const MappedFile&) = delete;
+		MappedFile& operator=(const MappedFile&) = delete;
+
+		// Destructor. Unmaps and closes the file.
+		~MappedFile();
+
+		// Map a file into memory. Any earlier file is closed first.
+		// Returns "false" if the file does not exist or could not be mapped.
+		// Arguments:
+		// - path : File name of the file that is mapped.
+		bool Open(const std::string& path);
+
+		// Unmap and close the file.
+		void Close();
+
+		// Returns a pointer to the first byte of the file, nullptr when no file is mapped or the file is empty.
+		const char* Data() const;
+
+		// Returns the size of the file in bytes.
+		size_t Size() const;
+	private:
+		const char* mData = nullptr;						// Start of the mapped view.
+		size_t mSize = 0;									// Size of the mapped view in bytes.
+#ifdef _WIN32
+		void* mFile = nullptr;								// Windows file handle.
+		void* mMapping = nullptr;							// Windows file mapping handle.
+#else
+		int mFile = -1;										// POSIX file descriptor.
+#endif
+	};
+}
@@ -0,0 +1,86 @@
+// This is the SmartScan mock file device backend.
+// It replays the recorded samples of the MockData csv files, one file per sensor. When the end of a file is reached it starts over.
+// The files are memory mapped and parsed once when the device is configured, after that samples are served from memory by index.
+
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "Point3.h"
+#include "DeviceBackend.h"
+
+namespace SmartScan
+{
+	class MockFileDevice
+	{
+	public:
+		// Constructor. Creates a MockFileDevice object that reads the mock data files.
+		// Arguments:
+		// - directory : Folder containing the mock data files s0.csv, s1.csv, ...
+		MockFileDevice(const std::string directory = "MockData/");
+
+		// Load and parse all mock data files. Files are loaded in order, starting at s0.csv, until a file does not exist.
+		// Arguments:
+		// - config : Not used, the mock device needs no configuration.
+		void Configure(const DataAcqConfig& config);
+
+		// Does nothing, the mock device has no data formats.
+		void SetReferenceSensor(int id);
+
+		// Does nothing, the recorded samples already contain the offsets.
+		void SetSensorOffset(int id, Point3 offset);
+
+		// Returns 1, the mock device acts as one board.
+		const int NumAttachedBoards() const;
+
+		// Returns 1, the mock device acts as one transmitter.
+		const int NumAttachedTransmitters() const;
+
+		// Return one port per mock data file, starting at 0.
+		std::vector<int> GetAttachedPorts() const;
+
+		// Return one serial per mock data file, equal to the port number.
+		std::vector<int> GetAttachedSerials() const;
+
+		// Returns the next sample of a sensor, starting over after the last one.
+		// Arguments:
+		// - id : Mock sensor port number.
+		Point3 GetRecord(int id);
+
+		// Returns a reference record without translation or rotation.
+		// Arguments:
+		// - id : Mock sensor port number.
+		Point3Ref GetRefRecord(int id);
+
+		// Get the next sample of every mock data file.
+		// Arguments:
+		// - records : Pointer to a vector that is filled with one Point3 per sensor port.
+		// - refRecord : Pointer to the Point3Ref in which the reference sensor record is stored.
+		// - refId : Port number of the reference sensor, -1 when no reference sensor is used.
+		void GetFrame(std::vector<Point3>* records, Point3Ref* refRecord, int refId = -1);
+
+		// Returns the number of samples loaded for a sensor.
+		// Arguments:
+		// - id : Mock sensor port number.
+		const size_t NumSamples(int id) const;
+
+		// Returns a loaded sample by index.
+		// Arguments:
+		// - id : Mock sensor port number.
+		// - index : Index of the sample, must be below NumSamples(id).
+		const Point3& Sample(int id, size_t index) const;
+	private:
+		const std::string mDirectory;							// Folder containing the mock data files.
+
+		std::vector<std::vector<Point3>> mSamples;				// Parsed samples, one contiguous array per sensor.
+		std::vector<size_t> mCursor;							// Index of the next sample, per sensor.
+
+		// Parse the text of a mock data file. Every line contains x, y, z, azimuth, elevation and roll separated by commas.
+		// Arguments:
+		// - begin : First character of the file.
+		// - end : One past the last character of the file.
+		// - samples : Vector to which the parsed samples are appended.
+		static void ParseFile(const char* begin, const char* end, std::vector<Point3>& samples);
+	};
+}
@@ -0,0 +1,63 @@
+// This is the SmartScan raw store class.
+// It keeps the complete history of an acquisition session. Every sensor has its own segmented buffer, so recording never copies earlier samples.
+// Data acquisition appends whole frames and publishes them with a frame count. Samples below that count never change or move.
+
+#pragma once
+
+#include <vector>
+#include <memory>
+#include <atomic>
+
+#include "Point3.h"
+#include "SegmentedBuffer.h"
+
+namespace SmartScan
+{
+	class RawStore
+	{
+	public:
+		// Constructor. Creates an empty RawStore object. Call Init() before appending frames.
+		RawStore();
+
+		// Allocate the segment directories. Not thread safe, only call this while nothing is appended or read.
+		// Arguments:
+		// - numSensors : Number of samples in one frame.
+		// - measurementRate : Rate in Hz at which frames are appended. Used to size the segments.
+		void Init(int numSensors, double measurementRate);
+
+		// Append one frame and publish it. Only called by the data acquisition thread.
+		// Returns "false" if the store is full.
+		// Arguments:
+		// - frame : Pointer to numSensors samples.
+		bool AppendFrame(const Point3* frame);
+
+		// Returns the number of published frames.
+		const size_t NumFrames() const;
+
+		// Returns the number of sensors in one frame.
+		const int NumSensors() const;
+
+		// Returns the rate in Hz at which frames are appended.
+		const double MeasurementRate() const;
+
+		// Returns the maximum number of frames that can be stored.
+		const size_t Capacity() const;
+
+		// Returns a published sample.
+		// Arguments:
+		// - sensor : Index of the sensor in the frame.
+		// - frame : Index of the frame, must be below NumFrames().
+		const Point3& At(int sensor, size_t frame) const;
+
+		// Remove all frames. The segments stay allocated and are reused. Only call this while nothing is appended.
+		void Clear();
+	private:
+		const double segmentTime = 60.0;							// Number of seconds of samples in one segment.
+		const size_t maxSegments = 2048;							// Number of segments per sensor, limits a session to about 34 hours.
+
+		int mNumSensors = 0;										// Number of samples in one frame.
+		double mMeasurementRate = 0;								// Rate in Hz at which frames are appended.
+		std::unique_ptr<SegmentedBuffer<Point3>[]> mSensors;		// One segmented buffer per sensor.
+		std::atomic<size_t> mNumFrames { 0 };						// Number of published frames.
+	};
+}
@@ -0,0 +1,87 @@
+// This is the SmartScan reference index class.
+// It finds the reference point nearest to a sample. Small sets of reference points are searched linearly.
+// Larger sets get a uniform grid around the reference points, every grid cell lists the few reference points that can be nearest to anything in it.
+// Samples in the grid are then matched in about constant time. Samples outside the grid, which are far away from the foot, are searched in a k-d tree.
+// Distances are compared squared, the square root is only taken by the caller for the nearest point.
+
+#pragma once
+
+#include <vector>
+
+#include "Point3.h"
+
+namespace SmartScan
+{
+	class RefIndex
+	{
+	public:
+		static const int linearLimit = 32;							// Up to this many reference points a linear search is faster than the grid.
+
+		// Constructor. Creates an empty RefIndex object.
+		RefIndex();
+
+		// Build the index. Up to linearLimit reference points no grid and tree are built.
+		// Arguments:
+		// - refPoints : The reference points.
+		void Build(const std::vector<Point3>& refPoints);
+
+		// Returns the index of the nearest reference point, -1 if there are none. Of equally near points the lowest index is returned.
+		// Arguments:
+		// - x, y, z : Position of the sample.
+		// - squaredDistance : Pointer to a double in which the squared distance to the nearest reference point is stored.
+		int Nearest(double x, double y, double z, double* squaredDistance) const;
+
+		// Same as Nearest(), but always searches linearly.
+		int NearestLinear(double x, double y, double z, double* squaredDistance) const;
+
+		// Same as Nearest(), but always searches the tree.
+		int NearestTree(double x, double y, double z, double* squaredDistance) const;
+
+		// Same as Nearest(), but always uses the grid, and the tree for samples outside of it.
+		int NearestGrid(double x, double y, double z, double* squaredDistance) const;
+
+		// Returns the number of reference points.
+		const int Size() const;
+	private:
+		static const int leafSize = 16;								// Maximum number of reference points in a leaf of the tree.
+		const double gridMargin = 0.25;								// Space around the reference points covered by the grid, relative to their largest extent.
+		const double cellsPerRef = 2;								// Number of grid cells per reference point.
+
+		// A reference point.
+		struct RefPoint
+		{
+			double p[3];											// Position of the reference point.
+			int index;												// Index of the reference point in the original vector.
+		};
+
+		// A node of the tree. Inner nodes split space on one axis, leaves hold a range of reference points.
+		struct Node
+		{
+			int axis;												// Axis on which this node splits space, -1 for a leaf.
+			double split;											// Position of the splitting plane on the axis.
+			int first;												// Inner node: index of the child below the plane. Leaf: first reference point.
+			int second;												// Inner node: index of the child above the plane. Leaf: one past the last reference point.
+		};
+
+		std::vector<RefPoint> mLinear;								// Reference points, in original order.
+
+		std::vector<RefPoint> mTreePoints;							// Reference points, grouped per leaf.
+		std::vector<Node> mNodes;									// Nodes of the tree, the root is the first node.
+
+		double mGridOrigin[3] = { 0, 0, 0 };						// Lowest corner of the grid.
+		double mCellScale[3] = { 0, 0, 0 };							// Number of cells per mm, per axis.
+		int mGridSize[3] = { 0, 0, 0 };								// Number of cells per axis.
+		std::vector<int> mCellStart;								// Per cell the first candidate in mCandidates, one extra entry marks the end.
+		std::vector<RefPoint> mCandidates;							// Candidate reference points of all cells, in ascending index order per cell.
+
+		// Build the subtree of a range of reference points.
+		// Returns the index of the node of the subtree.
+		// Arguments:
+		// - begin : First reference point of the range.
+		// - end : One past the last reference point of the range.
+		int BuildNode(int begin, int end);
+
+		// Build the grid and the candidate list of every cell.
+		void BuildGrid();
+	};
+}
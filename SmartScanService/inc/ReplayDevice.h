@@ -0,0 +1,71 @@
+// This is the SmartScan replay device backend.
+// It replays a raw session that was exported in the MATLAB format by CSVExport::ExportPoint3Raw, or saved in a session archive, frame by frame.
+// The exported samples are already corrected for the reference sensor, so a replayed session has no reference sensor.
+// The samples keep the button state they were recorded with, data acquisition does not classify them again.
+
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "Point3.h"
+#include "DeviceBackend.h"
+
+namespace SmartScan
+{
+	class ReplayDevice
+	{
+	public:
+		// Constructor. Creates a ReplayDevice object. The session is loaded in Configure().
+		// Arguments:
+		// - filename : Name of the raw session csv file or session archive that is replayed.
+		ReplayDevice(const std::string filename = "");
+
+		// Load the session file.
+		// Arguments:
+		// - config : Acquisition configuration. Not used, the session is replayed at the rate of data acquisition.
+		void Configure(const DataAcqConfig& config);
+
+		// Does nothing, a replayed session has no data formats.
+		void SetReferenceSensor(int id);
+
+		// Does nothing, the replayed samples already contain the offsets.
+		void SetSensorOffset(int id, Point3 offset);
+
+		// Returns 1, the replay device acts as one board.
+		const int NumAttachedBoards() const;
+
+		// Returns 1, the replay device acts as one transmitter.
+		const int NumAttachedTransmitters() const;
+
+		// Return one port for every sensor in the session, starting at 0.
+		std::vector<int> GetAttachedPorts() const;
+
+		// Return one serial for every sensor in the session, these are equal to the ports.
+		std::vector<int> GetAttachedSerials() const;
+
+		// Returns the sample of a sensor in the current frame.
+		// Arguments:
+		// - id : Sensor port number.
+		Point3 GetRecord(int id);
+
+		// Returns a reference record without translation or rotation.
+		// Arguments:
+		// - id : Sensor port number.
+		Point3Ref GetRefRecord(int id);
+
+		// Get the next frame of the session. After the last frame it starts over.
+		// Arguments:
+		// - records : Pointer to a vector that is filled with one Point3 per sensor port.
+		// - refRecord : Pointer to the Point3Ref in which the reference sensor record is stored.
+		// - refId : Not used, a replayed session has no reference sensor.
+		void GetFrame(std::vector<Point3>* records, Point3Ref* refRecord, int refId = -1);
+	private:
+		std::string mFilename;									// Name of the session file.
+
+		int mNumSensors = 0;									// Number of sensors in the session.
+		size_t mNumFrames = 0;									// Number of frames in the session.
+		size_t mFrame = 0;										// Index of the next frame that is replayed.
+		std::vector<Point3> mSamples;							// All samples of the session, frame by frame.
+	};
+}
@@ -0,0 +1,81 @@
+// This is the SmartScan sample scheduler class.
+// It paces the data acquisition loop with absolute deadlines on a drift-free timebase: sample n is due exactly n / measurementRate seconds after the start.
+// Waiting is done by sleeping until shortly before the deadline followed by a short spin, so the acquisition thread does not occupy a whole core.
+// On Windows the sleep uses a high resolution waitable timer where the system provides one, otherwise the timer resolution is raised to 1 ms.
+
+#pragma once
+
+#include <chrono>
+#include <atomic>
+#include <cstdint>
+
+namespace SmartScan
+{
+	// Timing statistics of the samples taken since the scheduler was started.
+	struct SamplingStats
+	{
+		uint64_t numSamples = 0;				// Number of samples taken.
+		uint64_t missedDeadlines = 0;			// Number of deadlines that were skipped because the loop fell more than a period behind.
+		double lastLateness = 0;				// Time between the deadline and the wake up of the last sample, in seconds.
+		double meanLateness = 0;				// Mean time between deadline and wake up, in seconds.
+		double maxLateness = 0;					// Largest time between deadline and wake up, in seconds.
+	};
+
+	class SampleScheduler
+	{
+	public:
+		// Constructor. Creates a SampleScheduler object. Call Start() before waiting for samples.
+		SampleScheduler();
+
+		// Start a new timebase. The first sample is due one period after this call.
+		// Arguments:
+		// - measurementRate : Sample rate in Hz.
+		void Start(double measurementRate);
+
+		// Stop the timebase. Releases the high resolution timer, or the raised timer resolution.
+		void Stop();
+
+		// Block until the deadline of the next sample has passed.
+		// When the caller fell more than a period behind, the missed deadlines are skipped so the timebase stays on the same grid.
+		// Returns the index of the sample that is due, starting at 1.
+		uint64_t WaitForNextSample();
+
+		// Returns the time of the current sample in seconds since Start(), taken from the drift-free timebase.
+		const double SampleTime() const;
+
+		// Returns the timing statistics since the last Start().
+		const SamplingStats GetStats() const;
+	private:
+		typedef std::chrono::steady_clock clock;
+
+#ifdef _WIN32
+		const std::chrono::microseconds spinTime { 300 };			// Sleeping stops this long before a deadline, the rest is spent spinning. 
+#else
+		const std::chrono::microseconds spinTime { 200 };			// Sleeping stops this long before a deadline, the rest is spent spinning. 
+#endif
+
+		double mPeriod = 0;											// Sample period in seconds.
+		clock::time_point mStart;									// Start of the timebase.
+		uint64_t mSampleIndex = 0;									// Index of the current sample.
+		bool mTimerRequested = false;								// Boolean indicating if the 1 ms timer resolution was requested.
+#ifdef _WIN32
+		void* mTimer = nullptr;										// High resolution waitable timer, nullptr when the system does not provide one.
+#endif
+
+		std::atomic<uint64_t> mNumSamples { 0 };					// Number of samples taken.
+		std::atomic<uint64_t> mMissedDeadlines { 0 };				// Number of skipped deadlines.
+		std::atomic<double> mLastLateness { 0 };					// Lateness of the last sample in seconds.
+		std::atomic<double> mMaxLateness { 0 };						// Largest lateness in seconds.
+		std::atomic<double> mSumLateness { 0 };						// Sum of all latenesses in seconds.
+
+		// Sleep until a point in time, or return at once when it has passed.
+		// Arguments:
+		// - wakeUp : Point in time until which the thread sleeps.
+		void SleepUntil(clock::time_point wakeUp);
+
+		// Returns the deadline of a sample.
+		// Arguments:
+		// - index : Index of the sample.
+		clock::time_point Deadline(uint64_t index) const;
+	};
+}
@@ -10,22 +10,66 @@
 #include <thread> 
 #include <functional>
 #include <cmath>
+#include <memory>
+#include <atomic>
 
 #include "Point3.h"
+#include "FrameRing.h"
+#include "RawStore.h"
+#include "CellGrid.h"
+#include "RefIndex.h"
+#include "AngleBins.h"
+#include "EqualAreaBins.h"
+#include "ThreadPool.h"
 
 namespace SmartScan
 {
+	class FilterEngine;
+
+	// Enum containing the ways a scan divides the sphere around a reference point into cells.
+	enum class grid_type
+	{
+		THETA_PHI,						// Bins of the filtering precision in theta and phi. The cells near the poles are much smaller than the ones at the equator.
+		EQUAL_AREA,						// Cells of equal area, each at most the size of a theta/phi bin at the equator. Supports coarse copies. (See EqualAreaBins.h)
+	};
+
     struct ScanConfig
     {
-		const std::vector<std::vector<Point3>>* inBuff;    			// Raw data vector.
+		const FrameRing* inBuff;    								// Frame ring in which data acquisition publishes the raw frames.
+		const RawStore* rawBuff;									// Raw store with all frames, the cells refer to their samples in here.
 		std::vector<Point3> refPoints;              				// Reference point vector.
 		int filteringPrecision;										// Filtering precision.
 		int stopAtSample;											// Stop scanning after a certain sample is reached.
 		float outlierThreshold;										// Do not store points if their distance from the reference points are larger than this value.
+		size_t cellMemoryBudget = CellGrid::defaultMemoryBudget;	// Largest number of bytes of dense cells, larger scans only allocate the blocks of cells that are filled.
+		grid_type gridType = grid_type::THETA_PHI;					// The way the sphere around every reference point is divided into cells.
+		double stopBelowFillRate = 0;								// Stop once fewer cells than this are newly filled per second, 0 to only stop at the stopAtSample.
+		double coverageWindow = 2;									// Time in seconds over which the fill rate and the improvement rate are averaged.
     };
 
+	// Nearest reference point and direction of a sample. These only depend on the reference points, so scans with the same reference points can share them.
+	struct SharedSample
+	{
+		int ref;													// Index of the nearest reference point.
+		AngleBins::Direction direction;								// Estimated direction from the nearest reference point, only set when the sample is not an outlier.
+	};
+
+	// Coverage of the cells of a scan. (See Scan::GetCoverage)
+	struct ScanCoverage
+	{
+		std::vector<int> filledCells;								// Number of filled cells per reference point.
+		size_t cellsPerRef;											// Number of cells per reference point.
+		uint64_t improvements;										// Number of samples stored in a cell, either filling it or replacing a sample with a larger radius.
+		double fillRate;											// Number of newly filled cells per second, averaged over the coverage window.
+		double improvementRate;										// Number of samples stored per second, averaged over the coverage window.
+		int filteredFrames;											// Number of filtered frames.
+		bool converged;												// "true" if the scan stopped because the fill rate dropped below the stopBelowFillRate.
+	};
+
 	class Scan
 	{
+		friend class FilterEngine;									// The filter engine fills the cells of scans that are started through it.
+
 	public:
 		const int mId;                                  			// Scan identifier.
 
@@ -33,33 +77,84 @@ namespace SmartScan
 		// Arguments:
 		// - id : Unique scan identifier. Used for exporting and deleting individual scans. 
 		// - config : Configuration options of this particular scan.
-		Scan(const int id, ScanConfig config);
+		// - engine : Filter engine that filters this scan together with other scans. When set to nullptr, the scan runs its own thread.
+		Scan(const int id, ScanConfig config, FilterEngine* engine = nullptr);
 
 		// Destructor. Is here to make sure the data is cleaned up if the Scan object is removed.
 		~Scan();
 
         // Start a Scan thread that will continuously filter the raw buffer values into a sorted buffer.
+		// Scans created with a filter engine are filtered by the thread of the engine instead.
 		void Run();
 
         // Stop the Scan thread. It will continue to filter until it either reached the stopAtSample value or the raw buffer size.
         // Arguments: 
-		// - clearData : When set to "True", it will erase all recorded data after stopping the thread.
+		// - clearData : When set to "True", it waits for the thread to catch up and then erases all recorded data.
 		void Stop(bool clearData = false);
 
+		// Filter all frames of the raw store into the cells again, up to the stopAtSample. The cells that were filtered before are replaced.
+		// The frames are split in one range per thread of the pool, every thread fills its own cells, and these are merged per cell afterwards.
+		// The cells are exactly the same as when the frames are filtered in order by a single thread. Can not be called while the scan is running.
+		// Scans with a stopBelowFillRate are filtered in order by the calling thread, so they stop at the same frame as when they were running.
+		// Otherwise the fill rate and the improvement rate are 0 afterwards, and every filled cell counts as one improvement.
+		// Arguments:
+		// - pool : Thread pool that filters the ranges. When set to nullptr, all frames are filtered by the calling thread.
+		void Refilter(ThreadPool* pool = nullptr);
+
         // Returns a boolean indicating if the Scan thread is running.
 		const bool IsRunning() const;
 
-		// Copies the sorted buffer into a single vector.
+		// Copies the sorted buffer into a single vector. The copy is a snapshot, so it can be taken while the scan is running. (See CopySnapshot)
 		// Arguments:
 		// - buffer : pointer to a Point3 vector in which the sorted buffer needs to be copied.
 		void CopyOutputBuffer(std::vector<Point3>* buffer) const;
 
+		// Copies the sorted buffer as it was after a number of filtered frames, while the scan may still be filtering.
+		// The cells are copied in between two frames without ever blocking the filter. When the filter stored a frame during the copy, the cells are copied again.
+		// Returns the number of filtered frames in the snapshot.
+		// Arguments:
+		// - buffer : pointer to a Point3 vector to which the samples of the snapshot are appended.
+		// - consistent : pointer to a boolean that is set to "true" when the snapshot holds exactly the returned number of frames. It is "false" when the filter
+		//                stored a frame during every copy. The last copy is used then, it holds all returned frames and some of the frames that came after.
+		//                Every cell is still a single sample.
+		const int CopySnapshot(std::vector<Point3>* buffer, bool* consistent = nullptr) const;
+
+		// Copies only the samples of the cells that changed since an earlier call, so a live view costs as much as what changed instead of the whole buffer.
+		// Returns the version to pass to the next call.
+		// Arguments:
+		// - since : Version returned by the previous call, 0 for the first call.
+		// - buffer : pointer to a Point3 vector to which the samples of the changed cells are appended.
+		// - cells : pointer to a vector to which the index of the cell of every appended sample is appended, can be nullptr.
+		// - reset : pointer to a boolean that is set to "true" when the scan was cleared since the previous call. Everything the caller kept is gone then,
+		//           and the appended samples are all samples of the scan.
+		const uint32_t CopyChanges(uint32_t since, std::vector<Point3>* buffer, std::vector<size_t>* cells = nullptr, bool* reset = nullptr) const;
+
+		// Copies a coarse version of the sorted buffer, with the sample of the smallest radius of every parent cell. Only for scans with an equal-area grid.
+		// The cells of a parent are consecutive, so this is a single sweep over the cells. It is a snapshot, just like CopySnapshot().
+		// Returns the number of filtered frames in the snapshot.
+		// Arguments:
+		// - level : Number of levels up, 0 gives the same samples as CopyOutputBuffer(), every level up has a quarter of the cells, up to EqualAreaBins::maxLevel.
+		// - buffer : pointer to a Point3 vector to which the samples are appended.
+		const int CopyCoarse(int level, std::vector<Point3>* buffer) const;
+
+		// Returns the coverage of the cells. The counters are kept up to date while filtering, so this is cheap to call while the scan is running.
+		const ScanCoverage GetCoverage() const;
+
+		// Returns the number of cells of the sorted buffer, one per reference point and direction bin.
+		const size_t NumCells() const;
+
+		// Returns the number of bytes used by the cells of the sorted buffer.
+		const size_t MemoryUsage() const;
+
 		// Returns the number of sensors in the raw data buffer.
 		const int NumUsedSensors() const;
 
 		// Returns the number of reference points defined in the configuration options.
 		const int NumRefPoints() const;
 
+		// Returns the reference points defined in the configuration options.
+		const std::vector<Point3>& GetRefPoints() const;
+
 		// Returns the filtering precision defined in the configuration options.
 		const int GetFilteringPrecision() const;
 
@@ -68,17 +163,38 @@ namespace SmartScan
 
 		// Returns the outlier threshold parameter defined in the configuration options.
 		const double GetOutlierThreshold() const;
+
+		// Returns the number of frames that were skipped because this scan fell too far behind data acquisition.
+		const int NumDroppedFrames() const;
 	private:
 		const double pi = 3.141592653589793238463;					// Approximation of PI.
 		const float toAngle = 180/pi;								// Radian to Degree conversion.
 
-		bool mRunning = false;										// Boolean indicating if the scan thread is running.
+		std::atomic<bool> mRunning { false };						// Boolean indicating if the scan thread is running.
 
 		const ScanConfig mConfig;									// Scan configuration object.
 
-		std::vector<std::vector<std::vector<Point3>>> mSortedBuff;	// Vector containing ther sorted points.
+		static const int maxSnapshotAttempts = 8;					// Number of times a snapshot is copied before an inconsistent copy is used.
 
-		int mLastFilteredSample = 0;								// Last filtered sample. Needed to know when to stop.
+		CellGrid mSortedBuff;										// Cells containing the sorted points, indexed by [refPoint][theta][phi].
+		std::atomic<uint64_t> mSequence { 0 };						// Odd while the cells are written, incremented before and after every write.
+		std::atomic<int> mPublishedFrames { 0 };					// Number of filtered frames in the cells while mSequence is even.
+		RefIndex mRefIndex;											// Index used to find the nearest reference point.
+		AngleBins mAngleBins;										// Maps the direction of a sample to its theta and phi bin.
+		EqualAreaBins mEqualAreaBins;								// Maps the direction of a sample to its equal-area cell.
+
+		int mLastFilteredSample = 0;								// Last filtered sample. Needed to know when to stop, also the read cursor in the frame ring.
+
+		std::unique_ptr<std::atomic<int>[]> mFilledCells;			// Number of filled cells per reference point.
+		std::atomic<uint64_t> mImprovements { 0 };					// Number of samples stored in a cell.
+		std::atomic<double> mFillRate { 0 };						// Number of newly filled cells per second, averaged over the coverage window.
+		std::atomic<double> mImprovementRate { 0 };					// Number of samples stored per second, averaged over the coverage window.
+		std::atomic<int> mCoverageStart { -1 };						// Frame from which the auto-stop waits one coverage window, -1 until a cell is filled.
+		std::atomic<bool> mConverged { false };						// Boolean indicating if the fill rate dropped below the stopBelowFillRate.
+		int mDroppedFrames = 0;										// Number of frames overwritten before this scan could read them.
+
+		FilterEngine* const mEngine;								// Filter engine that filters this scan, nullptr when the scan runs its own thread.
+		bool mFiltering = false;									// Boolean indicating if the filter engine still filters this scan, guarded by the mutex of the engine.
 
 		std::unique_ptr<std::thread> pScanningThread;				// Scanning thread.
 		
@@ -86,15 +202,88 @@ namespace SmartScan
 		// This function is run in a seperate thread.
 		void DataFiltering();
 
+		// Number of cells that one frame filled and improved.
+		struct FrameCoverage
+		{
+			int filled;												// Number of cells that were empty.
+			int improved;											// Number of samples stored, including the ones that filled a cell.
+		};
+
+		// Store the samples of the frame at mLastFilteredSample in the cells, and move on to the next frame.
+		// Arguments:
+		// - frame : The samples of the frame, with the radius to their nearest reference point filled in.
+		// - samples : Nearest reference point and direction of every sample, calculated with PrepareSample().
+		void StoreFrame(const Point3* frame, const SharedSample* samples);
+
+		// Returns the radius below which PrepareSample() has to estimate the direction of a sample. Only the theta/phi grid needs it, the equal-area grid bins by itself.
+		float DirectionThreshold() const;
+
+		// Allocate a cell grid for the grid type of the scan.
+		// Arguments:
+		// - cells : The cell grid.
+		// - trackChanges : When set to "true", the cell grid tracks changes. (See CellGrid::ChangedSince)
+		void InitCells(CellGrid* cells, bool trackChanges) const;
+
+		// Copy the cells of the sorted buffer in between two frames. (See CopySnapshot)
+		// Returns the number of filtered frames in the copy.
+		// Arguments:
+		// - cells : Pointer to a vector in which the cells are copied.
+		// - consistent : Pointer to a boolean that is set to "true" when the copy holds exactly the returned number of frames.
+		int SnapshotCells(std::vector<Cell>* cells, bool* consistent) const;
+
+		// Mark the start of a write to the cells, snapshots taken during the write are copied again.
+		void BeginWrite();
+
+		// Mark the end of a write to the cells, and publish the number of filtered frames in them.
+		void EndWrite();
+
+		// Store the samples of a frame in a cell grid.
+		// Arguments:
+		// - index : Index of the frame in the raw store.
+		// - numSensors : Number of samples in the frame.
+		// - frame : The samples of the frame, with the radius to their nearest reference point filled in.
+		// - samples : Nearest reference point and direction of every sample, calculated with PrepareSample().
+		// - cells : The cell grid in which the samples are stored.
+		// - filledCells : Counters of the filled cells per reference point that are updated, nullptr to not count them.
+		// Returns the number of cells that were filled and improved.
+		FrameCoverage FillCells(int index, int numSensors, const Point3* frame, const SharedSample* samples, CellGrid* cells, std::atomic<int>* filledCells = nullptr) const;
+
+		// Update the fill rate and the improvement rate with a filtered frame, and check whether the scan converged.
+		// Arguments:
+		// - index : Index of the frame.
+		// - coverage : Cells that the frame filled and improved.
+		void UpdateCoverage(int index, const FrameCoverage& coverage);
+
+		// Reset the coverage counters, for empty cells.
+		void ResetCoverage();
+
+		// Finds the nearest reference point of a sample and calculates its radius, and its direction if it is not an outlier.
+		// Arguments:
+		// - refIndex : Index of the reference points.
+		// - refPoints : The reference points.
+		// - outlierThreshold : The direction is only estimated for samples with a radius below this value.
+		// - point : Pointer to the sensor data Point3 that needs to be evaluated. (Will fill in the radius in that point).
+		// - sample : Pointer to the SharedSample in which the nearest reference point and the direction are stored.
+		static void PrepareSample(const RefIndex& refIndex, const std::vector<Point3>& refPoints, float outlierThreshold, Point3* point, SharedSample* sample);
+
 		// Returns the index of the nearest reference point and calculates the radius between the sensor point and this reference point.
 		// Arguments:
+		// - refIndex : Index of the reference points.
 		// - point : Pointer to the sensor data Point3 that needs to be evaluated. (Will fill in the radius in that point).
-		int CalcNearestRef(Point3* point);
+		static int CalcNearestRef(const RefIndex& refIndex, Point3* point);
 
 		// Calculates the theta and phi between two points and stores the result in point.
 		// Arguments:
 		// - refPoint : Reference point. Seen as the origin.
 		// - point : Pointer to the sensor data Point3 in which the theta and phi parameters are stored. 
-		void CalcAngle(Point3 refPoint, Point3* point);
+		void CalcAngle(Point3 refPoint, Point3* point) const;
+
+		// Restore the sample of a cell out of the raw store, with the radius, theta and phi that were calculated while filtering.
+		// Returns "false" if the cell is empty, or its sample belongs to raw data that has been cleared in the meantime.
+		// Arguments:
+		// - index : Index of the cell.
+		// - cell : The cell, as read from the sorted buffer.
+		// - point : Pointer to a Point3 in which the sample is stored.
+		bool CellSample(size_t index, const Cell& cell, Point3* point) const;
 	};
 }
\ No newline at end of file
@@ -0,0 +1,151 @@
+// This is the SmartScan segmented buffer class.
+// It provides an append-only container made of fixed-size segments that never move once allocated.
+// Appending never copies existing elements, and pointers and indices stay valid for as long as the buffer exists.
+// There can be one writer and any number of readers. Readers only access elements below the published size.
+
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <new>
+#include <cstddef>
+#include <type_traits>
+
+namespace SmartScan
+{
+	template <class T>
+	class SegmentedBuffer
+	{
+		static_assert(std::is_trivially_copyable<T>::value && std::is_trivially_destructible<T>::value, "SegmentedBuffer elements are stored in raw memory.");
+
+	public:
+		// Constructor. Creates an empty SegmentedBuffer object. Call Init() before appending.
+		SegmentedBuffer() { }
+
+		SegmentedBuffer(const SegmentedBuffer&) = delete;
+		SegmentedBuffer& operator=(const SegmentedBuffer&) = delete;
+
+		// Destructor. Frees all allocated segments.
+		~SegmentedBuffer()
+		{
+			this->Release();
+		}
+
+		// Set the segment size and the maximum number of segments. Frees all earlier data.
+		// Arguments:
+		// - minSegmentSize : Minimum number of elements in one segment. Rounded up to a power of two.
+		// - maxSegments : Maximum number of segments, this limits the total capacity.
+		void Init(size_t minSegmentSize, size_t maxSegments)
+		{
+			this->Release();
+
+			mShift = 0;
+			while (((size_t)1 << mShift) < minSegmentSize) {
+				mShift++;
+			}
+			mMask = ((size_t)1 << mShift) - 1;
+			mMaxSegments = maxSegments;
+
+			// The segment directory is allocated once, so readers never see it move either.
+			mSegments.reset(new std::atomic<T*>[mMaxSegments]);
+			for (size_t i = 0; i < mMaxSegments; i++) {
+				mSegments[i].store(nullptr, std::memory_order_relaxed);
+			}
+			mSize.store(0, std::memory_order_release);
+		}
+
+		// Returns a pointer to the storage of an element, allocating its segment when needed. Only called by the writer.
+		// The element is not visible to readers until the size is published past it.
+		// Returns nullptr if the index is beyond the capacity.
+		// Arguments:
+		// - index : Index of the element.
+		T* Write(size_t index)
+		{
+			size_t segment = index >> mShift;
+			if (segment >= mMaxSegments) {
+				return nullptr;
+			}
+
+			T* data = mSegments[segment].load(std::memory_order_relaxed);
+			if (!data) {
+				// Raw memory is enough since elements are trivially copyable, this keeps the allocation from touching every page up front.
+				data = static_cast<T*>(::operator new(sizeof(T) << mShift));
+				mSegments[segment].store(data, std::memory_order_release);
+			}
+			return data + (index & mMask);
+		}
+
+		// Append an element and publish it. Only called by the writer.
+		// Returns "false" if the buffer is full.
+		// Arguments:
+		// - value : The element that is appended.
+		bool PushBack(const T& value)
+		{
+			size_t size = mSize.load(std::memory_order_relaxed);
+			T* slot = this->Write(size);
+			if (!slot) {
+				return false;
+			}
+			*slot = value;
+			mSize.store(size + 1, std::memory_order_release);
+			return true;
+		}
+
+		// Make all elements below size visible to the readers. Only called by the writer.
+		// Arguments:
+		// - size : New number of published elements.
+		void Publish(size_t size)
+		{
+			mSize.store(size, std::memory_order_release);
+		}
+
+		// Returns the number of published elements.
+		size_t Size() const
+		{
+			return mSize.load(std::memory_order_acquire);
+		}
+
+		// Returns a published element.
+		// Arguments:
+		// - index : Index of the element, must be below Size().
+		const T& operator[](size_t index) const
+		{
+			return mSegments[index >> mShift].load(std::memory_order_relaxed)[index & mMask];
+		}
+
+		// Returns the number of elements in one segment.
+		size_t SegmentSize() const
+		{
+			return mMask + 1;
+		}
+
+		// Returns the maximum number of elements.
+		size_t Capacity() const
+		{
+			return mMaxSegments << mShift;
+		}
+
+		// Reset the size to zero. The segments stay allocated and are reused by the next appends.
+		void Clear()
+		{
+			mSize.store(0, std::memory_order_release);
+		}
+	private:
+		std::unique_ptr<std::atomic<T*>[]> mSegments;				// Segment directory, allocated once in Init().
+		size_t mMaxSegments = 0;									// Number of entries in the segment directory.
+		size_t mShift = 0;											// Log2 of the segment size.
+		size_t mMask = 0;											// Mask used to get the index inside a segment.
+		std::atomic<size_t> mSize { 0 };							// Number of published elements.
+
+		// Free all segments.
+		void Release()
+		{
+			for (size_t i = 0; mSegments && i < mMaxSegments; i++) {
+				::operator delete(mSegments[i].load(std::memory_order_relaxed));
+			}
+			mSegments.reset();
+			mMaxSegments = 0;
+			mSize.store(0, std::memory_order_relaxed);
+		}
+	};
+}
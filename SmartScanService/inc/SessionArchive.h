@@ -0,0 +1,95 @@
+// This is the SmartScan session archive class.
+// It saves a recorded session in a compact binary file and loads it back into a raw store, to archive every session and filter it again later.
+// The header describes the session: the acquisition configuration, the serial numbers of the sensors and the reference points of the scans.
+// The samples are stored in blocks of frames. In every block each sensor has a column per field: time, X, Y, Z, the three angles, quality,
+// button and button state. The time stamps, positions and angles are rounded to a fixed step and every column is compressed by the ColumnCodec,
+// so an archive takes about a tenth of the raw csv file. Every column can be decoded on its own, the sensors of a block are decoded on all cores.
+//
+// Time stamps are kept to a microsecond, positions to a micrometre and angles to a thousandth of a degree, far below what the sensors resolve.
+// The other fields are kept exactly.
+
+#pragma once
+
+#include <vector>
+#include <string>
+#include <atomic>
+#include <functional>
+#include <cstdint>
+
+#include "Exceptions.h"
+#include "Point3.h"
+#include "DeviceBackend.h"
+#include "RawStore.h"
+#include "ThreadPool.h"
+#include "BufferedWriter.h"
+
+namespace SmartScan
+{
+	// Struct containing the description of an archived session.
+	struct SessionInfo
+	{
+		DataAcqConfig config;									// Acquisition configuration of the session.
+		std::vector<int> serials;								// Serial numbers of the sensors, in the order of the samples in a frame.
+		std::vector<std::vector<Point3>> refPoints;				// Reference points of every scan, so the session can be filtered again into the same scans.
+	};
+
+	class SessionArchive
+	{
+	public:
+		static const size_t framesPerBlock = 16384;				// Number of frames in a block, about a minute at the highest measurement rate.
+
+		// Constructor. Creates a SessionArchive object.
+		SessionArchive();
+
+		// Save the raw data buffer with a description of the session.
+		// Only the frames that are published when the save starts are written.
+		// Throws ex_export if the buffer is empty, a sample cannot be stored or the file could not be written.
+		// Arguments:
+		// - data : constant pointer to the raw data buffer (Read only).
+		// - info : Description of the session. Without serial numbers the sensors are numbered from 0.
+		// - filename : constant string containing the name of the archive.
+		// - numFrames : Number of frames that are saved. (Default: all frames published when the save starts)
+		void Save(const RawStore* data, const SessionInfo& info, const std::string filename, size_t numFrames = SIZE_MAX);
+
+		// Load an archive into a raw store. The store is initialised for the sensors and measurement rate of the session.
+		// Throws ex_export if the file could not be opened, is not a session archive or is damaged.
+		// Returns the description of the session.
+		// Arguments:
+		// - filename : constant string containing the name of the archive.
+		// - data : Pointer to the raw store that is filled. Nothing may be appended to it or read from it while loading.
+		SessionInfo Load(const std::string filename, RawStore* data);
+
+		// Spread the compression and decompression of the sensors of a block over the threads of a pool.
+		// Arguments:
+		// - pool : Pointer to the thread pool, nullptr to work on the calling thread only.
+		void SetThreadPool(ThreadPool* pool);
+
+		// Count the frames that are saved in an atomic, so another thread can follow the progress.
+		// Arguments:
+		// - progress : Pointer to the counter, nullptr to stop counting.
+		void SetProgress(std::atomic<size_t>* progress);
+
+		// Returns "true" if a file starts like a session archive.
+		// Arguments:
+		// - filename : Name of the file.
+		static const bool IsArchive(const std::string filename);
+
+		// Returns the file extension of an archive, including the dot.
+		static const std::string Extension();
+	private:
+		static const int numColumns = 10;						// Number of columns of every sensor in a block.
+
+		BufferedWriter mFile;									// Buffered archive file that is saved.
+		ThreadPool* pThreadPool = nullptr;						// Thread pool over which the sensors of a block are spread, nullptr to use the calling thread only.
+		std::atomic<size_t>* pProgress = nullptr;				// Counter of the saved frames, nullptr when they are not counted.
+		std::vector<int64_t> mValues;							// Values of one column of every sensor of a block.
+		std::vector<std::vector<uint8_t>> mStreams;				// Compressed columns of every sensor of a block.
+		std::vector<Point3> mSamples;							// Decompressed samples of every sensor of a block.
+
+		// Run a task for every sensor, on the thread pool if there is one.
+		// Arguments:
+		// - numSensors : Number of sensors.
+		// - task : Function that is called with the index of every sensor.
+		void ForEachSensor(int numSensors, const std::function<void(int)>& task);
+	};
+}
@@ -0,0 +1,109 @@
+// This is the SmartScan session journal class.
+// It writes every acquired frame to a memory mapped file while a session is recorded, so the session survives a crash of the application.
+// The file is allocated for a number of minutes of frames when it is opened. Appending a frame copies it into the mapping and moves the
+// commit watermark in the header up, without a system call: the operating system writes the dirty pages back to the file by itself,
+// also when the application crashes. The file is allocated on the disk up front, so a full disk is noticed when the journal is opened.
+// Closing the journal flushes it and cuts the file to the committed frames.
+//
+// Every frame carries its index and a checksum, so recovery finds where a journal is torn when the machine went down before all pages
+// reached the disk. Recover() reads the frames below the watermark up to the first torn frame back into a raw store.
+// The journal is written in the byte order of the machine, it is meant to be recovered on the machine that recorded it.
+
+#pragma once
+
+#include <vector>
+#include <string>
+#include <cstdint>
+#include <cstddef>
+
+#include "Exceptions.h"
+#include "Point3.h"
+#include "DeviceBackend.h"
+#include "RawStore.h"
+#include "SessionArchive.h"
+
+namespace SmartScan
+{
+	class SessionJournal
+	{
+	public:
+		static constexpr double defaultMinutes = 60.0;			// Default number of minutes of frames for which a journal is allocated.
+
+		// Constructor. Creates a SessionJournal object without an open journal.
+		SessionJournal();
+
+		SessionJournal(const SessionJournal&) = delete;
+		SessionJournal& operator=(const SessionJournal&) = delete;
+
+		// Destructor. Closes the journal, without throwing when that fails.
+		~SessionJournal();
+
+		// Create or truncate a journal and allocate it for a number of minutes of frames. Any earlier journal is closed first.
+		// Throws ex_acq if the file could not be created, allocated or mapped.
+		// Arguments:
+		// - filename : Name of the journal.
+		// - config : Acquisition configuration, the measurement rate and the reference sensor are kept in the journal.
+		// - serials : Serial numbers of the sensors, in the order of the samples in a frame.
+		// - minutes : Number of minutes of frames at the measurement rate for which the journal is allocated.
+		void Open(const std::string filename, const DataAcqConfig& config, const std::vector<int>& serials, double minutes = defaultMinutes);
+
+		// Flush the journal to disk, cut the file to the committed frames and close it.
+		// Throws ex_acq if the journal could not be written.
+		void Close();
+
+		// Append one frame and commit it. Only called by the data acquisition thread.
+		// Returns "false" if no journal is open, the journal is full or the frame has another number of sensors than the journal.
+		// Arguments:
+		// - frame : Pointer to a sample of every sensor.
+		// - numSensors : Number of samples in the frame.
+		bool Append(const Point3* frame, int numSensors);
+
+		// Remove all frames, for example when the raw data is cleared. The frames that are still in the file are never recovered.
+		void Reset();
+
+		// Returns "true" if a journal is open.
+		const bool IsOpen() const;
+
+		// Returns the number of committed frames.
+		const size_t NumFrames() const;
+
+		// Returns the number of frames for which the journal is allocated.
+		const size_t Capacity() const;
+
+		// Read the committed frames of a journal into a raw store, also of a journal that was never closed. The raw store is initialised for
+		// the sensors and measurement rate of the session. Frames after the first frame that did not fully reach the disk are left out.
+		// Throws ex_acq if the file could not be opened or is not a journal.
+		// Returns the description of the session, without reference points.
+		// Arguments:
+		// - filename : Name of the journal.
+		// - data : Pointer to the raw store that is filled. Nothing may be appended to it or read from it while recovering.
+		static SessionInfo Recover(const std::string filename, RawStore* data);
+
+		// Returns the file extension of a journal, including the dot.
+		static const std::string Extension();
+	private:
+		uint8_t* pView = nullptr;								// Start of the mapped journal, the header.
+		size_t mViewSize = 0;									// Size of the mapped journal in bytes.
+		int mNumSensors = 0;									// Number of samples in a frame.
+		size_t mFrameSize = 0;									// Size of a frame record in bytes.
+		size_t mCapacity = 0;									// Number of frames for which the journal is allocated.
+		size_t mNumFrames = 0;									// Number of committed frames.
+		uint32_t mGeneration = 0;								// Number of times the journal has been reset, part of the frame checksums.
+		std::vector<uint8_t> mRecord;							// Frame record that is put together before it is copied into the mapping.
+#ifdef _WIN32
+		void* mFile = nullptr;									// Windows file handle.
+		void* mMapping = nullptr;								// Windows file mapping handle.
+#else
+		int mFile = -1;											// POSIX file descriptor.
+#endif
+
+		// Write the checksum of the header after changing it.
+		void SealHeader();
+
+		// Unmap the journal and close the file, optionally after cutting it to a size.
+		// Returns "false" if flushing or cutting the file failed.
+		// Arguments:
+		// - size : Size to which the file is cut, 0 to leave it as it is.
+		bool Unmap(uint64_t size);
+	};
+}
@@ -8,26 +8,47 @@
 #include <vector>
 #include <thread>
 #include <chrono>
+#include <memory>
+#include <string>
 
 #include "Point3.h"
 #include "Scan.h"
 #include "DataAcquisition.h"
+#include "FilterEngine.h"
+#include "ThreadPool.h"
 #include "CSVExport.h"
+#include "CloudExport.h"
+#include "SessionArchive.h"
+#include "SessionJournal.h"
+#include "ExportQueue.h"
 
 namespace SmartScan
 {
+	// Result of one scan configuration of a parameter sweep. (See SmartScanService::SweepScans)
+	struct SweepResult
+	{
+		ScanConfig config;								// The scan configuration.
+		std::vector<Point3> cloud;						// The filtered points, one per filled cell.
+		size_t numCells;								// Total number of cells of the configuration.
+		size_t filledCells;								// Number of cells that hold a point.
+		double meanRadius;								// Mean radius of the points to their reference point in mm, 0 without points.
+	};
+
 	class SmartScanService
 	{
 	public:
 		// Constructor. Creates a SmartScanService object that handles everything SmartScan related.
 		// Arguments:
-		// - useMockData : When set to "true", a mock trakSTAR device is used. It will try to use the real thing otherwise.
+		// - useMockData : When set to "true", the mock data files are used. It will try to use the real TrakStar device otherwise.
+		// - backend : Device backend that is used to acquire samples. (See DeviceBackend.h)
+		// - source : File name of the session that is replayed, only used by the REPLAY backend.
 		SmartScanService(bool useMockData = false);
+		SmartScanService(device_backend backend, const std::string source = "");
 
 		// Destructor. Is here to make sure the data is cleaned up if the SmartScan object is removed.
 		~SmartScanService();
 
-		// Initialise the SmartScan data acquisition. Call this before starting scans.
+		// Initialise the SmartScan data acquisition. Call this before starting scans. Close the journal first, if one is open.
 		// Arguments:
 		// - acquistionConfig : Configuration struct that specifies the settings with which the TrakStar device is initalized. 
 		void Init();
@@ -38,7 +59,7 @@ namespace SmartScan
 		// - serialNumber : Serial number of the sensor where the Z offset will be changed.
 		void CorrectZOffset(int serialNumber);
 
-		// Creates a new scan and adds it to the scan list.
+		// Creates a new scan and adds it to the scan list. All scans are filtered together by one filter engine. (See FilterEngine.h)
 		// Arguments:
 		// - config : Configuration struct that specifies the settings of this particular scan.
 		void NewScan(ScanConfig config);
@@ -49,6 +70,20 @@ namespace SmartScan
 		void DeleteScan();
 		void DeleteScan(int id);
 
+		// Filter the whole recorded session into a scan again, spread over all cores. Use this after StopScan(), for example
+		// to fill a scan that was created after the recording. The result is the same as filtering the session with a single thread.
+		// Arguments:
+		// - id : The id of the scan that is filtered again.
+		void RefilterScan(int id);
+
+		// Filter a recorded session with several scan configurations, for example to try other filtering precisions, outlier thresholds or reference points
+		// without scanning the foot again. The configurations are filtered in parallel on all cores, the scan list is not changed.
+		// Returns one result per configuration, in the same order.
+		// Arguments:
+		// - configs : The scan configurations. Their frame ring and raw store are filled in by this function.
+		// - rawBuff : Raw store with the recorded session. When set to nullptr, the raw data recorded by this service is used.
+		std::vector<SweepResult> SweepScans(std::vector<ScanConfig> configs, const RawStore* rawBuff = nullptr);
+
 		// Start the data acquistion and all the scans in the scan list. 
 		void StartScan();
 
@@ -65,10 +100,18 @@ namespace SmartScan
 		// Stop the data acquisition and with that all the scans. The scans will conitnue to filter until caught up with data acquisition.
 		void StopScan();
 
+		// Returns the coverage of a scan: the filled cells per reference point and how fast they are filled and improved. (See Scan::GetCoverage)
+		// Arguments:
+		// - id : The id of the scan.
+		const ScanCoverage GetScanCoverage(int id) const;
+
 		// Get a list of all the scan objects. Returned as const so no changes can be made to it. This is meant mostly for accessing the data.
 		// Returns a vector containing Scan objects by reference.
 		const std::vector<std::shared_ptr<Scan>>& GetScansList() const;
 
+		// Returns the timing statistics of the current or last acquisition run, such as how late samples were taken compared to their deadline.
+		const SamplingStats GetSamplingStats() const;
+
 		// Returns the number of attached boards to this PC.
 		const int NumAttachedBoards() const;
 
@@ -94,17 +137,98 @@ namespace SmartScan
 		// - raw : When set to "True", the raw data (corrected for a reference sensor) will be exported instead.
 		void ExportPointCloud(const std::string filename, int scanId, const bool raw = false);
 
+		// Export the Point3 array as a binary PLY or PCD point cloud, which is smaller and much faster to write and load than a csv file.
+		// Arguments:
+		// - filename : Name of the exported file.
+		// - scanId : Id of the scan that needs to be exported. (Does nothing if exporting raw data)
+		// - options : Format of the file and the properties that are written next to the positions.
+		// - raw : When set to "True", the raw data (corrected for a reference sensor) will be exported instead.
+		void ExportBinaryCloud(const std::string filename, int scanId, const CloudOptions& options, const bool raw = false);
+
+		// Same as ExportCSV(), but the file is written on a background thread and this returns right away.
+		// The export is a snapshot: the frames of the raw data published right now, or a consistent copy of the scan.
+		// Data acquisition and the scans keep running while the file is written. ClearData() and Init() wait for queued exports.
+		// Returns the handle of the export, with its progress and a future that becomes ready when the file has been written.
+		// Arguments:
+		// - filename : Name of the exported file.
+		// - scanId : Id of the scan that needs to be exported. (Does nothing if exporting raw data)
+		// - raw : When set to "True", the raw data (corrected for a reference sensor) will be exported instead.
+		std::shared_ptr<ExportJob> ExportCSVAsync(const std::string filename, int scanId, const bool raw = false);
+
+		// Same as ExportPointCloud(), but the file is written on a background thread. (See ExportCSVAsync)
+		// Arguments:
+		// - filename : Name of the exported file.
+		// - scanId : Id of the scan that needs to be exported. (Does nothing if exporting raw data)
+		// - raw : When set to "True", the raw data (corrected for a reference sensor) will be exported instead.
+		std::shared_ptr<ExportJob> ExportPointCloudAsync(const std::string filename, int scanId, const bool raw = false);
+
+		// Same as ExportBinaryCloud(), but the file is written on a background thread. (See ExportCSVAsync)
+		// Arguments:
+		// - filename : Name of the exported file.
+		// - scanId : Id of the scan that needs to be exported. (Does nothing if exporting raw data)
+		// - options : Format of the file and the properties that are written next to the positions.
+		// - raw : When set to "True", the raw data (corrected for a reference sensor) will be exported instead.
+		std::shared_ptr<ExportJob> ExportBinaryCloudAsync(const std::string filename, int scanId, const CloudOptions& options, const bool raw = false);
+
+		// Save the raw data in a session archive, with the acquisition configuration, the serial numbers of the sensors and the reference points of the scans.
+		// An archive takes about a tenth of the raw csv file and loads much faster. (See SessionArchive.h)
+		// Arguments:
+		// - filename : Name of the archive.
+		void SaveSession(const std::string filename);
+
+		// Same as SaveSession(), but the archive is written on a background thread. (See ExportCSVAsync)
+		// Arguments:
+		// - filename : Name of the archive.
+		std::shared_ptr<ExportJob> SaveSessionAsync(const std::string filename);
+
+		// Load a session archive into a raw store, for example to sweep it with SweepScans() using the reference points it was scanned with.
+		// Returns the description of the session.
+		// Arguments:
+		// - filename : Name of the archive.
+		// - rawBuff : Pointer to the raw store that is filled, not the raw data recorded by this service.
+		SessionInfo LoadSession(const std::string filename, RawStore* rawBuff);
+
+		// Write every acquired frame to a journal on disk as well, so the session can be recovered after a crash of the application.
+		// Only call this while no scan is running. The frames recorded so far are written first, clearing the data also clears the journal.
+		// Arguments:
+		// - filename : Name of the journal.
+		// - minutes : Number of minutes of frames for which the journal is allocated.
+		void OpenJournal(const std::string filename, double minutes = SessionJournal::defaultMinutes);
+
+		// Stop journaling. The journal is flushed to disk and kept. Only call this while no scan is running.
+		void CloseJournal();
+
+		// Read the frames of a journal into a raw store, also of a journal that was left behind by a crash. (See SessionJournal::Recover)
+		// Returns the description of the session, without reference points.
+		// Arguments:
+		// - filename : Name of the journal.
+		// - rawBuff : Pointer to the raw store that is filled, not the raw data recorded by this service.
+		SessionInfo RecoverJournal(const std::string filename, RawStore* rawBuff);
+
+		// Block until all exports queued with the asynchronous export functions have finished.
+		void WaitForExports();
+
 		// Register a new callback function to be called whenever new raw data is available.
 		// Arguments:
 		// - callback : Contains the function that is executed. The function should take a vector of points as an argument.
 		void RegisterRawDataCallback(std::function<void(const std::vector<Point3>&)> callback);
 	private:
-		const bool mUseMockData;						// Boolean indicating if Mock data is used.	
+		const bool mUseMockData;						// Boolean indicating if a backend other than the TrakStar device is used.
 
 		DataAcq mDataAcq;								// Data acquisition obj.
+		FilterEngine mFilterEngine;						// Filters the frames into all the scans in a single thread.
 		std::vector<std::shared_ptr<Scan>> scans;       // Vector containing all the scans. 
 
 		CSVExport csvExport;                           	// CSVexport obj
+		CloudExport cloudExport;						// Binary point cloud export obj.
+		SessionArchive sessionArchive;					// Session archive obj.
+
+		std::unique_ptr<ThreadPool> pThreadPool;		// Thread pool used to filter sessions again, created when it is first needed.
+
+		ExportQueue mExportQueue;						// Writes the asynchronous exports, declared last so it finishes them before anything else is destroyed.
+
+		// Returns the description of the recorded session that is saved with it: the acquisition configuration, the sensors and the reference points of the scans.
+		const SessionInfo DescribeSession() const;
 
 		// Looks at the scan list and returns the first unused id.
 		// Returns a unique, unused, id.
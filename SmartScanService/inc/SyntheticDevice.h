@@ -0,0 +1,126 @@
+// This is the SmartScan synthetic device backend.
+// It generates samples without any hardware or files. A parametric foot surface is stroked by a configurable number of virtual sensors,
+// while a reference sensor moves and rotates the foot through the measurement frame.
+// Samples only depend on the frame number, the measurement rate and the SyntheticConfig, so the ground truth of every sample is known.
+//
+// Port 0 is the reference sensor, ports 1 to numSensors are the stroking sensors. Serial numbers are equal to the port numbers.
+// The foot surface is defined in the reference sensor frame, with the length along the X axis and the centre of the foot in the origin.
+
+#pragma once
+
+#include <vector>
+#include <random>
+#include <cstdint>
+
+#include "Point3.h"
+#include "DeviceBackend.h"
+
+namespace SmartScan
+{
+	class SyntheticDevice
+	{
+	public:
+		// Constructor. Creates a SyntheticDevice object.
+		// Arguments:
+		// - config : Shape of the foot, number of sensors, noise and quality of the synthetic samples.
+		SyntheticDevice(SyntheticConfig config = SyntheticConfig());
+
+		// Apply the synthetic settings and the measurement rate of the acquisition configuration, and restart at the first frame.
+		// Arguments:
+		// - config : Acquisition configuration, the synthetic settings are taken from config.synthetic.
+		void Configure(const DataAcqConfig& config);
+
+		// Does nothing, the synthetic device has no data formats.
+		void SetReferenceSensor(int id);
+
+		// Does nothing, the synthetic device has no offsets.
+		void SetSensorOffset(int id, Point3 offset);
+
+		// Returns 1, the synthetic device acts as one board.
+		const int NumAttachedBoards() const;
+
+		// Returns 1, the synthetic device acts as one transmitter.
+		const int NumAttachedTransmitters() const;
+
+		// Return port 0 for the reference sensor and ports 1 to numSensors for the stroking sensors.
+		std::vector<int> GetAttachedPorts() const;
+
+		// Return the serial numbers, which are equal to the port numbers.
+		std::vector<int> GetAttachedSerials() const;
+
+		// Returns the sample of a sensor at the current frame.
+		// Arguments:
+		// - id : Synthetic sensor port number.
+		Point3 GetRecord(int id);
+
+		// Returns the position and rotation matrix of the reference sensor at the current frame.
+		// Arguments:
+		// - id : Synthetic sensor port number, not used since port 0 is always the reference sensor.
+		Point3Ref GetRefRecord(int id);
+
+		// Generate the samples of all sensors at the current frame and move on to the next frame.
+		// Arguments:
+		// - records : Pointer to a vector that is filled with one Point3 per sensor port.
+		// - refRecord : Pointer to the Point3Ref in which the reference sensor record is stored.
+		// - refId : Port number of the reference sensor, -1 when no reference sensor is used.
+		void GetFrame(std::vector<Point3>* records, Point3Ref* refRecord, int refId = -1);
+
+		// Returns the point on the foot surface, in the reference sensor frame.
+		// Arguments:
+		// - u : Position along the length of the foot, 0 is the heel and 1 the toes.
+		// - v : Angle around the length axis in radians.
+		Point3 SurfacePoint(double u, double v) const;
+
+		// Returns the noise-free position of a stroking sensor in the last generated frame, in the reference sensor frame.
+		// This is where a perfect scan would put the sample after reference correction.
+		// Arguments:
+		// - id : Synthetic sensor port number.
+		Point3 GroundTruth(int id) const;
+
+		// Returns the distance from a point inside the foot to the foot surface in a direction.
+		// The direction uses the same theta and phi definition as the Scan class, so this is what a perfect scan stores in the cell of that direction.
+		// Arguments:
+		// - center : Point inside the foot, in the reference sensor frame.
+		// - theta : Angle around the Z axis in degrees, 0 to 360.
+		// - phi : Angle from the Z axis in degrees, 0 to 180.
+		double GroundTruthRadius(const Point3& center, double theta, double phi) const;
+	private:
+		const double pi = 3.141592653589793238463;				// Approximation of PI.
+		const double toRad = pi / 180;							// Degree to Radian conversion.
+		const double toAngle = 180 / pi;						// Radian to Degree conversion.
+
+		SyntheticConfig mConfig;								// Synthetic settings.
+		double mMeasurementRate = 50;							// Rate in Hz at which frames are generated.
+		uint64_t mFrame = 0;									// Number of the next frame.
+
+		std::mt19937 mRandom;									// Random generator for the position noise.
+		std::normal_distribution<double> mNoise;				// Normal distribution of the position noise.
+
+		std::vector<Point3> mGroundTruth;						// Noise-free positions of the last generated frame, per port.
+
+		// Returns the pose of the reference sensor at a given time.
+		// Arguments:
+		// - time : Time since the first frame in seconds.
+		// - angles : Rotation3 in which the euler angles of the reference sensor are stored.
+		Point3Ref ReferencePose(double time, Rotation3* angles) const;
+
+		// Returns the noise-free sample of a stroking sensor at a given time, in the reference sensor frame.
+		// The rotation member holds the unit surface normal instead of euler angles.
+		// Arguments:
+		// - sensor : Index of the stroking sensor, 0 to numSensors - 1.
+		// - time : Time since the first frame in seconds.
+		Point3 StrokePoint(int sensor, double time) const;
+
+		// Returns "true" if a point in the reference sensor frame is inside the foot.
+		// Arguments:
+		// - x, y, z : The point.
+		bool Inside(double x, double y, double z) const;
+
+		// Calculates the half width and the half height of the elliptic cross-section of the foot at a position along its length.
+		// Arguments:
+		// - u : Position along the length of the foot, 0 to 1.
+		// - a : Half width of the cross-section.
+		// - b : Half height of the cross-section.
+		void CrossSection(double u, double* a, double* b) const;
+	};
+}
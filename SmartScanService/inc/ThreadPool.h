@@ -0,0 +1,60 @@
+// This is the SmartScan thread pool class.
+// It keeps a fixed set of worker threads that run the parts of a parallel loop. The workers sleep while there is no work.
+// The thread that starts a loop works on it as well, and waits until every part is done.
+
+#pragma once
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <atomic>
+#include <exception>
+
+namespace SmartScan
+{
+	class ThreadPool
+	{
+	public:
+		// Constructor. Creates a ThreadPool object and starts the worker threads.
+		// Arguments:
+		// - numThreads : Number of threads that work on a loop, including the calling thread. 0 uses one thread per core.
+		ThreadPool(int numThreads = 0);
+
+		// Destructor. Stops and joins the worker threads.
+		~ThreadPool();
+
+		ThreadPool(const ThreadPool&) = delete;
+		ThreadPool& operator=(const ThreadPool&) = delete;
+
+		// Run a task for every index from 0 to count - 1, spread over the threads, and wait until all are done.
+		// An exception thrown by a task is thrown again here, after all running tasks have finished. Only one loop can run at a time.
+		// Arguments:
+		// - count : Number of times the task is run.
+		// - task : Function that is called with the index of the part it has to do.
+		void ParallelFor(int count, const std::function<void(int)>& task);
+
+		// Returns the number of threads that work on a loop, including the calling thread.
+		const int NumThreads() const;
+	private:
+		std::vector<std::thread> mWorkers;							// Worker threads.
+
+		std::mutex mMutex;											// Mutex protecting the state of the current loop.
+		std::condition_variable mWorkAvailable;						// Condition variable on which the workers wait for a loop.
+		std::condition_variable mWorkDone;							// Condition variable on which ParallelFor() waits for the workers.
+		const std::function<void(int)>* pTask = nullptr;			// Task of the current loop.
+		int mCount = 0;												// Number of parts of the current loop.
+		std::atomic<int> mNext { 0 };								// Next part that is handed out.
+		int mBusy = 0;												// Number of workers that are working on the current loop.
+		unsigned int mGeneration = 0;								// Incremented for every loop, so a worker joins every loop once.
+		bool mExit = false;											// Set by the destructor to end the workers.
+		std::exception_ptr mError;									// First exception thrown by a task of the current loop.
+
+		// Function run by every worker thread.
+		void Worker();
+
+		// Run parts of the current loop until all have been handed out.
+		void RunParts();
+	};
+}
@@ -1,11 +1,14 @@
 // This is the SmartScan TrakStarController class.
 // Here the communication with the TrakSTAR hardware is handled for example, configration settings and acquiring samples.
+// It is the device backend for the real hardware and is only available when SMARTSCAN_TRAKSTAR is defined. (See DeviceBackend.h)
 
 #pragma once
 
-#include <time.h>
+#include "DeviceBackend.h"
+
+#ifdef SMARTSCAN_TRAKSTAR
+
 #include <string>
-#include <fstream>
 #include <vector>
 
 #include "Point3.h"
@@ -38,9 +41,7 @@ namespace SmartScan
 	{
 	public:
 		// Constructor. Creates a TrakStarController object that handles communication with the TrakStar device.
-		// Arguments:
-		// - mock : When set to "true", a mock trakSTAR device is used. It will try to use the real thing otherwise.
-		TrakStarController(bool mock = false);
+		TrakStarController();
 
 		// Destructor. Is here to make sure the transmitter is turned off when the TrakStar object is removed.
 		~TrakStarController();
@@ -48,6 +49,11 @@ namespace SmartScan
 		// Initialize the system and acquires system, transmitter and sensor configuration. Call this before making a measurement.
 		void Init();
 
+		// Initialize the system and apply all the settings of the acquisition configuration.
+		// Arguments:
+		// - config : Configuration struct with the transmitter, measurement rate, powerline frequency, range and frame rotation settings.
+		void Configure(const DataAcqConfig& config);
+
 		// Turn off the transmitter.
 		void StopTransmit();
 
@@ -80,14 +86,21 @@ namespace SmartScan
 		// - angles : Array of 3 angles with which the axis are rotated. (Azimuth, Elevation, Roll)
 		void SetReferenceFrame(short int id, double angles[3]);
 
-		// Set all available sensors to use the DOUBLE_POSITION_ANGLES_TIME_Q_BUTTON format.
+		// Set all available sensors to use the DOUBLE_POSITION_ANGLES_MATRIX_QUATERNION_TIME_Q_BUTTON format.
+		// All sensors share one format so they can be read with a single ALL_SENSORS record, the reference sensor takes the rotation matrix from it.
 		void SetSensorFormat();
 
-		// Set one sensor to use the DOUBLE_POSITION_MATRIX format. Used for reference sensor data since it requires rotation matrices.
+		// Set one sensor to use the format needed for reference sensor data, which requires rotation matrices.
+		// This is the same format as all other sensors use, so the sensor can still be read in the batched frame.
 		// Arguments:
 		// - id : Port number of the sensor which its format needs to be changed.
 		void SetRefSensorFormat(int id);
 
+		// Prepare a sensor port to be used as reference sensor.
+		// Arguments:
+		// - id : Port number of the reference sensor.
+		void SetReferenceSensor(int id);
+
 		// Set the X, Y and Z offset of a sensor. Used to correct for finger t h i c c n e s s.
 		// Arguments:
 		// - id : Port number of the sensor which its offset needs to be changed.
@@ -106,37 +119,33 @@ namespace SmartScan
 		// Return a vector containing the sensor serial numbers of all attached sensors.
 		std::vector<int> GetAttachedSerials() const;
 
-		// Get the latest record for a specific sensor using the DOUBLE_POSITION_ANGLES_TIME_Q_BUTTON format.
+		// Get the latest record for a specific sensor using the DOUBLE_POSITION_ANGLES_MATRIX_QUATERNION_TIME_Q_BUTTON format.
 		// Arguments:
 		// - id : The ID of the sensor from which the record will be returned.
 		Point3 GetRecord(int id);
 
-		// Get the latest record for a specific sensor using the DOUBLE_POSITION_MATRIX format.
+		// Get the latest record for a specific sensor as a reference record containing the rotation matrix.
 		// Arguments:
 		// - id : The ID of the sensor from which the record will be returned.
 		Point3Ref GetRefRecord(int id);
+
+		// Get the records of all sensors and the reference sensor of one measurement cycle with a single synchronous ALL_SENSORS driver call.
+		// This replaces a status and record call per sensor, and all records come from the same measurement cycle.
+		// Arguments:
+		// - records : Pointer to a vector that is filled with one Point3 per sensor port. Ports without a valid record get an empty Point3.
+		// - refRecord : Pointer to the Point3Ref in which the reference sensor record is stored.
+		// - refId : Port number of the reference sensor, -1 when no reference sensor is used.
+		void GetFrame(std::vector<Point3>* records, Point3Ref* refRecord, int refId = -1);
 	private:
 		const double toInch = 0.03937008;						// Constant for converting millimetres to inches.
 
-		const bool mUseMockData;								// Boolean indicating if Mock data is used.	
+		bool mInitialized = false;								// Boolean indicating if the system has been initialized.
 
 		CSystem	ATC3DG;											// System configuration.
 		std::vector<CXmtr> pXmtr;								// Vector of transmitter configurations.
 		std::vector<CSensor> pSensor;							// Vector of sensor configurations.
 
-		std::string s0MockDataFilePath = "MockData/s0.csv";		// File name of the first mock data file.
-		std::string s1MockDataFilePath = "MockData/s1.csv";		// File name of the second mock data file.
-		std::string s2MockDataFilePath = "MockData/s2.csv";		// File name of the third mock data file.
-
-		std::ifstream s0MockDataFile;							// Input stream object for first mock data file.
-		std::ifstream s1MockDataFile;							// Input stream object for second mock data file.
-		std::ifstream s2MockDataFile;							// Input stream object for third mock data file.
-
-		long mockDataFileLine = 0;								// Current mock data file line.
-		long mockDataFileNOfLines;								// Total number of mock data file lines.
-
-		// Keep track of the last mock record so that the movement is realistic.
-		Point3 mPrevMockRecord;
+		std::vector<DOUBLE_POSITION_ANGLES_MATRIX_QUATERNION_TIME_Q_BUTTON_RECORD> mFrameRecords;	// Record buffer for the ALL_SENSORS reads.
 
 		// Validate a device status and check which error has occurred if not valid.
 		// Arguments:
@@ -153,12 +162,16 @@ namespace SmartScan
 		// - error : The error value that needs to be checked.
 		const std::string GetErrorString(int error);
 		
-		// Randomly returns a point on the edge of a sphere at a reasonable distance from the previous point.
-		Point3 GetMockRecord();
+		// Convert a driver record into a Point3.
+		// Arguments:
+		// - record : The record that needs to be converted.
+		Point3 ToPoint3(const DOUBLE_POSITION_ANGLES_MATRIX_QUATERNION_TIME_Q_BUTTON_RECORD& record) const;
 
-		// Goes through the specified file and returns consecutive samples as Point3.
+		// Convert a driver record into a Point3Ref.
 		// Arguments:
-		// -sensorId : Mock sensor port number.
-		Point3 GetMockRecordFromFile(int sensorId = 0);
+		// - record : The record that needs to be converted.
+		Point3Ref ToPoint3Ref(DOUBLE_POSITION_ANGLES_MATRIX_QUATERNION_TIME_Q_BUTTON_RECORD& record) const;
 	};
-}
\ No newline at end of file
+}
+
+#endif
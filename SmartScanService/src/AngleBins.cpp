@@ -0,0 +1,19 @@
+#include "AngleBins.h"
+
+using namespace SmartScan;
+
+AngleBins::AngleBins(int filteringPrecision)
+	: mPrecision { (double)filteringPrecision }, mBinsPerRad { toAngle / mPrecision }, mHalfTurn { 180 / mPrecision }, mMargin { margin / mPrecision },
+	  mNumTheta { 360 / filteringPrecision }, mNumPhi { 180 / filteringPrecision }
+{
+
+}
+
+void AngleBins::BinExact(const Point3& refPoint, const Point3& point, int* theta, int* phi) const
+{
+	// The same calculation as Scan::CalcAngle(), followed by the truncation to a bin.
+	double exactTheta = (atan2(point.y - refPoint.y, point.x - refPoint.x) * toAngle) + 180;
+	double exactPhi = acos(ClampCosine((point.z - refPoint.z) / point.s.r)) * toAngle;
+	*theta = ClampBin(exactTheta / mPrecision, mNumTheta);
+	*phi = ClampBin(exactPhi / mPrecision, mNumPhi);
+}
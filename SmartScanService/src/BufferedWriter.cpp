@@ -0,0 +1,197 @@
+#include <cmath>
+
+#include "BufferedWriter.h"
+
+using namespace SmartScan;
+
+namespace
+{
+	// Powers of ten from 1e-5 up to 1e22, the doubles nearest to them. From 1e0 on they are exact.
+	const double powersOfTen[] = {
+		1e-5, 1e-4, 1e-3, 1e-2, 1e-1, 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+		1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+	};
+	const int lowestPower = -5;										// Exponent of the first power in the table.
+	const int fastPrecision = 15;									// Largest precision of which every rounded value is an exact double.
+
+	// Returns the power of ten, the exponent has to be in the table.
+	inline double PowerOfTen(int exponent)
+	{
+		return powersOfTen[exponent - lowestPower];
+	}
+}
+
+BufferedWriter::BufferedWriter()
+{
+
+}
+
+BufferedWriter::~BufferedWriter()
+{
+	try {
+		this->Close();
+	}
+	catch (ex_export&) {
+		// Nothing can be reported from a destructor, callers that care call Close() themselves.
+	}
+}
+
+void BufferedWriter::Open(const std::string& filename, size_t bufferSize, bool text)
+{
+	this->Close();
+
+	// The stream does not need a buffer of its own, everything reaches it in large chunks.
+	mFile.rdbuf()->pubsetbuf(nullptr, 0);
+	mFile.open(filename, text ? std::ios::out | std::ios::trunc : std::ios::out | std::ios::binary | std::ios::trunc);
+	if (!mFile.is_open()) {
+		throw ex_export("Could not create the export file.", __func__, __FILE__);
+	}
+
+	// The buffer always has room for at least one text number.
+	bufferSize = std::max(bufferSize, (size_t)maxTextSize);
+	if (bufferSize != mCapacity || !mBuffer) {
+		mBuffer.reset(new char[bufferSize]);
+		mCapacity = bufferSize;
+	}
+	mUsed = 0;
+	mFlushed = 0;
+}
+
+void BufferedWriter::Close()
+{
+	if (!mFile.is_open()) {
+		return;
+	}
+
+	// Close the file also when flushing fails, so the writer can be opened again.
+	bool written = true;
+	try {
+		this->Flush();
+	}
+	catch (ex_export&) {
+		written = false;
+	}
+	mFile.close();
+	if (!written || mFile.fail()) {
+		mFile.clear();
+		throw ex_export("Could not write the export file.", __func__, __FILE__);
+	}
+}
+
+void BufferedWriter::Flush()
+{
+	if (mUsed) {
+		size_t used = mUsed;
+		mUsed = 0;
+		this->WriteFile(mBuffer.get(), used);
+	}
+}
+
+char* BufferedWriter::FormatText(char* first, char* last, double value, int precision)
+{
+	// Without an exponent the general format writes numbers from 1e-4 up to 10^precision, only those take the fast path.
+	double a = std::abs(value);
+	if (!(a >= 1e-4) || precision > fastPrecision || a >= PowerOfTen(precision)) {
+		return std::to_chars(first, last, value, std::chars_format::general, precision).ptr;
+	}
+
+	// Decimal exponent of the first digit. The binary exponent times log10(2) is the exponent, or one less.
+	uint64_t bits;
+	memcpy(&bits, &a, sizeof(bits));
+	int exponent = (((int)((bits >> 52) & 0x7ff) - 1023) * 78913) >> 18;
+	if (a >= PowerOfTen(exponent + 1)) {
+		exponent++;
+	}
+
+	// Scale to an integer of precision digits. Multiplying or dividing by an exact power of ten rounds only once,
+	// so the scaled value is off by at most half an ulp. Values within a few ulp of halfway may round either way, leave those to std::to_chars.
+	int shift = precision - 1 - exponent;
+	double scaled = shift >= 0 ? a * PowerOfTen(shift) : a / PowerOfTen(-shift);
+	uint64_t digits = (uint64_t)scaled;
+	double fraction = scaled - (double)digits;
+	if (std::abs(fraction - 0.5) <= scaled * 0x1p-50) {
+		return std::to_chars(first, last, value, std::chars_format::general, precision).ptr;
+	}
+	digits += fraction > 0.5 ? 1 : 0;
+
+	// Rounding up may add a digit, 9.9999996 becomes 10.0000. A wrong exponent shows as too few digits.
+	uint64_t limit = (uint64_t)PowerOfTen(precision);
+	if (digits == limit) {
+		digits /= 10;
+		exponent++;
+	}
+	if (digits < limit / 10 || exponent >= precision) {
+		return std::to_chars(first, last, value, std::chars_format::general, precision).ptr;
+	}
+
+	// Drop the trailing zeros after the decimal point.
+	int decimals = precision - 1 - exponent;
+	while (decimals > 0 && digits % 10 == 0) {
+		digits /= 10;
+		decimals--;
+	}
+
+	// Write the digits back to front, with the decimal point and the zeros in front of the first digit.
+	char text[maxTextSize];
+	char* end = text + maxTextSize;
+	char* p = end;
+	for (int i = 0; i < decimals; i++) {
+		if (exponent >= 0 || digits) {
+			*--p = (char)('0' + digits % 10);
+			digits /= 10;
+		}
+		else {
+			*--p = '0';
+		}
+	}
+	if (decimals > 0) {
+		*--p = '.';
+	}
+	do {
+		*--p = (char)('0' + digits % 10);
+		digits /= 10;
+	} while (digits);
+	if (value < 0) {
+		*--p = '-';
+	}
+
+	if (last - first < end - p) {
+		return std::to_chars(first, last, value, std::chars_format::general, precision).ptr;
+	}
+	memcpy(first, p, end - p);
+	return first + (end - p);
+}
+
+const uint64_t BufferedWriter::BytesWritten() const
+{
+	return mFlushed + mUsed;
+}
+
+void BufferedWriter::WriteFile(const void* data, size_t size)
+{
+	mFile.write((const char*)data, size);
+	if (!mFile) {
+		throw ex_export("Could not write the export file.", __func__, __FILE__);
+	}
+	mFlushed += size;
+}
+
+TextBuffer::TextBuffer()
+{
+
+}
+
+void TextBuffer::Clear()
+{
+	mUsed = 0;
+}
+
+const char* TextBuffer::Data() const
+{
+	return mText.data();
+}
+
+const size_t TextBuffer::Size() const
+{
+	return mUsed;
+}
@@ -1,94 +1,195 @@
-#include <iostream>
-#include <chrono>
-
 #include "CSVExport.h"
 
 using namespace SmartScan;
 
-CSVExport::CSVExport()
+CSVExport::CSVExport(int precision)
+{
+	this->SetPrecision(precision);
+}
+
+void CSVExport::SetPrecision(int precision)
+{
+	if (precision < 1 || precision > BufferedWriter::maxPrecision) {
+		throw ex_export("Precision is out of range.", __func__, __FILE__);
+	}
+	mPrecision = precision;
+}
+
+const int CSVExport::GetPrecision() const
+{
+	return mPrecision;
+}
+
+void CSVExport::SetThreadPool(ThreadPool* pool)
 {
+	pThreadPool = pool;
+}
 
+void CSVExport::SetProgress(std::atomic<size_t>* progress)
+{
+	pProgress = progress;
 }
 
 void CSVExport::ExportPoint3(const std::vector<Point3>* data, const std::string filename)
 {
-	csvFile.open(filename);
+	csvFile.Open(filename, BufferedWriter::defaultBufferSize, true);
 
 	// Print the amount of rows on the top row.
-	csvFile << data->size() << std::endl;
+	csvFile.PutText((int64_t)data->size());
+	csvFile.PutChar('\n');
 
 	// Loop through and Write data unless data is empty.
 	if (!data->empty())	{
-		for (int i = 0; i < data->size(); i = i++) {
-			csvFile << data->at(i).time << "," << data->at(i).x << "," << data->at(i).y << "," << data->at(i).z << "," << data->at(i).r.x << "," << data->at(i).r.y << "," << data->at(i).r.z << "," << data->at(i).quality << "," << (int)data->at(i).buttonState << std::endl;
-		}
+		this->WriteRows(data->size(), [this, data](auto* out, size_t i) {
+			this->WriteSample(out, (*data)[i]);
+			out->PutChar('\n');
+		});
 	}
 	else {
+		csvFile.Close();
 		throw ex_export("Raw buffer is empty.", __func__, __FILE__);
 	}
-	csvFile.close();
+	csvFile.Close();
 }
 
 void CSVExport::ExportPoint3Cloud(const std::vector<Point3>* data, const std::string filename)
 {
-	csvFile.open(filename);
+	csvFile.Open(filename, BufferedWriter::defaultBufferSize, true);
 
 	// Print the column names on the top row.
-	csvFile << 'X' << ',' << 'Y' << ',' << 'Z' << std::endl;
+	csvFile.Write("X,Y,Z\n", 6);
 
 	// Loop through and Write data unless data is empty.
 	if (!data->empty())	{
-		for (int i = 0; i < data->size(); i = i++) {
-			csvFile << data->at(i).x << "," << data->at(i).y << "," << data->at(i).z << std::endl;
-		}
+		this->WriteRows(data->size(), [this, data](auto* out, size_t i) {
+			this->WritePosition(out, (*data)[i]);
+		});
 	}
 	else {
+		csvFile.Close();
 		throw ex_export("Raw buffer is empty.", __func__, __FILE__);
 	}
-	csvFile.close();
+	csvFile.Close();
 }
 
-void CSVExport::ExportPoint3Raw(const std::vector<std::vector<Point3>>* data, const std::string filename)
+void CSVExport::ExportPoint3Raw(const RawStore* data, const std::string filename, size_t numFrames)
 {
-	csvFile.open(filename);
+	// Only export the frames that are published right now, acquisition may still be appending.
+	numFrames = std::min(numFrames, data->NumFrames());
 
-	// Print the amount of rows and the amount of sensors used (excluding reference sensor) on the top row.
-	csvFile << data->at(0).size() << "," << data->size() << std::endl;
+	csvFile.Open(filename, BufferedWriter::defaultBufferSize, true);
 
-	// Loop through and Write data unless data is empty.
-	if (!data->at(0).empty()) {
-		for (int i = 0; i < data->at(0).size(); i++) {
-			for (int j = 0; j < data->size(); j++) {
-				csvFile << data->at(j).at(i).time << "," << data->at(j).at(i).x << "," << data->at(j).at(i).y << "," << data->at(j).at(i).z << "," << data->at(j).at(i).r.x << "," << data->at(j).at(i).r.y << "," << data->at(j).at(i).r.z << "," << data->at(j).at(i).quality << "," << (int)data->at(j).at(i).buttonState << ",";
+	// Print the amount of rows and the amount of sensors used (excluding reference sensor) on the top row.
+	csvFile.PutText((int64_t)numFrames);
+	csvFile.PutChar(',');
+	csvFile.PutText((int64_t)data->NumSensors());
+	csvFile.PutChar('\n');
+
+	// Loop through and Write data unless data is empty. Every row holds one frame.
+	if (numFrames && data->NumSensors()) {
+		this->WriteRows(numFrames, [this, data](auto* out, size_t i) {
+			for (int j = 0; j < data->NumSensors(); j++) {
+				this->WriteSample(out, data->At(j, i));
+				out->PutChar(',');
 			}
-			csvFile << std::endl;
-		}
+			out->PutChar('\n');
+		});
 	}
 	else {
+		csvFile.Close();
 		throw ex_export("Raw buffer is empty.", __func__, __FILE__);
 	}
 
-	csvFile.close();
+	csvFile.Close();
 }
 
-void CSVExport::ExportPoint3RawCloud(const std::vector<std::vector<Point3>>* data, const std::string filename)
+void CSVExport::ExportPoint3RawCloud(const RawStore* data, const std::string filename, size_t numFrames)
 {
-	csvFile.open(filename);
+	// Only export the frames that are published right now, acquisition may still be appending.
+	numFrames = std::min(numFrames, data->NumFrames());
+
+	csvFile.Open(filename, BufferedWriter::defaultBufferSize, true);
 
 	// Print the column names on the top row.
-	csvFile << 'X' << ',' << 'Y' << ',' << 'Z' << std::endl;
+	csvFile.Write("X,Y,Z\n", 6);
 
-	// Loop through and Write data unless data is empty.
-	if (!data->at(0).empty()) {
-		for (int j = 0; j < data->size(); j++) {
-			for (int i = 0; i < data->at(j).size(); i++) {
-				csvFile << data->at(j).at(i).x << "," << data->at(j).at(i).y << "," << data->at(j).at(i).z << std::endl; 
-			}
-		}
+	// Loop through and Write data unless data is empty. The rows go sensor by sensor.
+	if (numFrames && data->NumSensors()) {
+		this->WriteRows(numFrames * data->NumSensors(), [this, data, numFrames](auto* out, size_t i) {
+			this->WritePosition(out, data->At((int)(i / numFrames), i % numFrames));
+		});
 	}
 	else {
+		csvFile.Close();
 		throw ex_export("Raw buffer is empty.", __func__, __FILE__);
 	}
 
-	csvFile.close();
-}
\ No newline at end of file
+	csvFile.Close();
+}
+
+template <class RowWriter>
+void CSVExport::WriteRows(size_t numRows, const RowWriter& writeRow)
+{
+	// Without threads to spread the rows over, they go straight into the file.
+	if (!pThreadPool || pThreadPool->NumThreads() < 2 || numRows <= rowsPerChunk) {
+		for (size_t i = 0; i < numRows; i++) {
+			writeRow(&csvFile, i);
+			this->Progress(i + 1);
+		}
+		return;
+	}
+
+	// Two chunks per thread keep the threads busy when some chunks take longer. Only one batch is in memory at a time.
+	const size_t numChunks = 2 * pThreadPool->NumThreads();
+	const size_t rowsPerBatch = numChunks * rowsPerChunk;
+	mChunks.resize(numChunks);
+	for (size_t batch = 0; batch < numRows; batch += rowsPerBatch) {
+		pThreadPool->ParallelFor((int)numChunks, [&](int c) {
+			TextBuffer& chunk = mChunks[c];
+			chunk.Clear();
+			size_t end = std::min(batch + (c + 1) * rowsPerChunk, numRows);
+			for (size_t i = batch + c * rowsPerChunk; i < end; i++) {
+				writeRow(&chunk, i);
+			}
+		});
+
+		// Write the chunks in order, the file is the same as when it is written on one thread.
+		for (const TextBuffer& chunk : mChunks) {
+			csvFile.Write(chunk.Data(), chunk.Size());
+		}
+		this->Progress(std::min(batch + rowsPerBatch, numRows));
+	}
+}
+
+template <class Output>
+void CSVExport::WriteSample(Output* out, const Point3& p) const
+{
+	out->PutText(p.time, mPrecision);
+	out->PutChar(',');
+	out->PutText(p.x, mPrecision);
+	out->PutChar(',');
+	out->PutText(p.y, mPrecision);
+	out->PutChar(',');
+	out->PutText(p.z, mPrecision);
+	out->PutChar(',');
+	out->PutText(p.r.x, mPrecision);
+	out->PutChar(',');
+	out->PutText(p.r.y, mPrecision);
+	out->PutChar(',');
+	out->PutText(p.r.z, mPrecision);
+	out->PutChar(',');
+	out->PutText((int64_t)p.quality);
+	out->PutChar(',');
+	out->PutText((int64_t)p.buttonState);
+}
+
+template <class Output>
+void CSVExport::WritePosition(Output* out, const Point3& p) const
+{
+	out->PutText(p.x, mPrecision);
+	out->PutChar(',');
+	out->PutText(p.y, mPrecision);
+	out->PutChar(',');
+	out->PutText(p.z, mPrecision);
+	out->PutChar('\n');
+}
@@ -0,0 +1,194 @@
+#include <float.h>
+#include <algorithm>
+
+#include "CellGrid.h"
+
+using namespace SmartScan;
+
+CellGrid::CellGrid()
+{
+
+}
+
+CellGrid::~CellGrid()
+{
+	this->FreeBlocks();
+}
+
+void CellGrid::Init(int numRefs, int numTheta, int numPhi, bool trackChanges, size_t memoryBudget)
+{
+	this->FreeBlocks();
+	mNumTheta = numTheta;
+	mNumPhi = numPhi;
+	mSize = (size_t)numRefs * numTheta * numPhi;
+	mNumBlocks = (mSize + blockMask) >> blockShift;
+	mTrackChanges = trackChanges;
+
+	// Without a block stamp per block, a grid that does not track changes uses less memory.
+	mBlockStamps.reset();
+	if (trackChanges) {
+		mBlockStamps.reset(new std::atomic<uint32_t>[mNumBlocks + 1]);
+	}
+
+	// Point the directory at one array of all blocks if it fits in the budget, otherwise every block is allocated when it is first filled.
+	mBlocks.reset(new std::atomic<Block*>[mNumBlocks + 1]);
+	mDenseBlocks.reset();
+	if (mNumBlocks * sizeof(Block) <= memoryBudget) {
+		mDenseBlocks.reset(new Block[mNumBlocks]);
+	}
+	for (size_t b = 0; b < mNumBlocks; b++) {
+		mBlocks[b].store(mDenseBlocks ? &mDenseBlocks[b] : nullptr, std::memory_order_relaxed);
+	}
+	this->Clear();
+}
+
+void CellGrid::Clear()
+{
+	for (size_t b = 0; b < mNumBlocks; b++) {
+		Block* block = mBlocks[b].load(std::memory_order_relaxed);
+		if (block) {
+			ClearBlock(block);
+		}
+	}
+
+	// Start a new version, so readers holding an older one know their cells are gone.
+	if (mTrackChanges) {
+		for (size_t b = 0; b < mNumBlocks; b++) {
+			mBlockStamps[b].store(0, std::memory_order_relaxed);
+		}
+		mClearedVersion.store(mVersion.fetch_add(1) + 1);
+	}
+}
+
+void CellGrid::Merge(const CellGrid& other, size_t begin, size_t end)
+{
+	for (size_t b = begin >> blockShift; b < mNumBlocks && (b << blockShift) < end; b++) {
+		// Blocks that were never filled in the other grid have nothing to merge.
+		const Block* otherBlock = other.mBlocks[b].load(std::memory_order_acquire);
+		if (!otherBlock) {
+			continue;
+		}
+
+		// The block may be shared with a thread that merges the neighbouring range, it publishes the blocks it allocates as well.
+		Block* block = mBlocks[b].load(std::memory_order_acquire);
+		for (size_t c = std::max(begin, b << blockShift); c < std::min(end, (b + 1) << blockShift); c++) {
+			Cell otherCell = otherBlock->cells[c & blockMask].load(std::memory_order_relaxed);
+			if (otherCell.sample == emptySample) {
+				continue;
+			}
+			if (!block) {
+				block = this->AllocateBlock(b);
+			}
+			if (otherCell.r < block->cells[c & blockMask].load(std::memory_order_relaxed).r) {
+				block->cells[c & blockMask].store(otherCell, std::memory_order_relaxed);
+				if (mTrackChanges) {
+					this->Stamp(block, c);
+				}
+			}
+		}
+	}
+}
+
+uint32_t CellGrid::NextVersion() const
+{
+	uint32_t version = mVersion.fetch_add(1) + 1;
+
+	// Pairs with the fence in Stamp(), so a cell that is stamped with the closed version while the caller looks for changes is not missed.
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	return version;
+}
+
+const bool CellGrid::ClearedSince(uint32_t version) const
+{
+	return version < mClearedVersion.load();
+}
+
+void CellGrid::ChangedSince(uint32_t version, std::vector<size_t>* cells) const
+{
+	if (!mTrackChanges) {
+		return;
+	}
+
+	// Only look at the cells of blocks that changed. The stamp of a block is at least as new as the stamps of its cells.
+	// Cleared stamps are 0, so they never match.
+	version = std::max(version, (uint32_t)1);
+	for (size_t b = 0; b < mNumBlocks; b++) {
+		if (mBlockStamps[b].load(std::memory_order_acquire) < version) {
+			continue;
+		}
+		const Block* block = mBlocks[b].load(std::memory_order_acquire);
+		for (size_t c = b << blockShift; c < std::min((b + 1) << blockShift, mSize); c++) {
+			if (block->stamps[c & blockMask].load(std::memory_order_acquire) >= version) {
+				cells->push_back(c);
+			}
+		}
+	}
+}
+
+void CellGrid::CopyCells(std::vector<Cell>* cells) const
+{
+	cells->resize(mSize);
+	for (size_t b = 0; b < mNumBlocks; b++) {
+		const Block* block = mBlocks[b].load(std::memory_order_acquire);
+		for (size_t c = b << blockShift; c < std::min((b + 1) << blockShift, mSize); c++) {
+			(*cells)[c] = block ? block->cells[c & blockMask].load(std::memory_order_relaxed) : Cell { FLT_MAX, emptySample };
+		}
+	}
+}
+
+const size_t CellGrid::Size() const
+{
+	return mSize;
+}
+
+const size_t CellGrid::CellsPerRef() const
+{
+	return (size_t)mNumTheta * mNumPhi;
+}
+
+const bool CellGrid::IsSparse() const
+{
+	return !mDenseBlocks;
+}
+
+const size_t CellGrid::MemoryUsage() const
+{
+	size_t numBlocks = mDenseBlocks ? mNumBlocks : mNumAllocated.load();
+	size_t directory = (mNumBlocks + 1) * sizeof(std::atomic<Block*>);
+	size_t stamps = mTrackChanges ? (mNumBlocks + 1) * sizeof(uint32_t) : 0;
+	return numBlocks * sizeof(Block) + directory + stamps;
+}
+
+CellGrid::Block* CellGrid::AllocateBlock(size_t index)
+{
+	Block* block = new Block;
+	ClearBlock(block);
+
+	// Publish the block, unless another thread merging into this grid was first.
+	Block* expected = nullptr;
+	if (!mBlocks[index].compare_exchange_strong(expected, block, std::memory_order_acq_rel)) {
+		delete block;
+		return expected;
+	}
+	mNumAllocated++;
+	return block;
+}
+
+void CellGrid::ClearBlock(Block* block)
+{
+	for (size_t c = 0; c < blockSize; c++) {
+		block->cells[c].store(Cell { FLT_MAX, emptySample }, std::memory_order_relaxed);
+		block->stamps[c].store(0, std::memory_order_relaxed);
+	}
+}
+
+void CellGrid::FreeBlocks()
+{
+	if (mBlocks && !mDenseBlocks) {
+		for (size_t b = 0; b < mNumBlocks; b++) {
+			delete mBlocks[b].load(std::memory_order_relaxed);
+		}
+	}
+	mBlocks.reset();
+	mNumAllocated = 0;
+}
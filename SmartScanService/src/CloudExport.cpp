@@ -0,0 +1,147 @@
+#include <cmath>
+#include <cfloat>
+
+#include "CloudExport.h"
+
+using namespace SmartScan;
+
+namespace
+{
+	const double toRadians = 3.141592653589793238463 / 180;		// Conversion from degrees to radians.
+}
+
+CloudExport::CloudExport()
+{
+
+}
+
+void CloudExport::ExportCloud(const std::vector<Point3>* data, const std::string filename, const CloudOptions& options)
+{
+	if (data->empty()) {
+		throw ex_export("Scan buffer is empty.", __func__, __FILE__);
+	}
+
+	mWriter.Open(filename);
+	this->WriteHeader(data->size(), options);
+	for (size_t i = 0; i < data->size(); i++) {
+		this->WritePoint((*data)[i], options);
+		if (pProgress) {
+			pProgress->store(i + 1, std::memory_order_relaxed);
+		}
+	}
+	mWriter.Close();
+}
+
+void CloudExport::ExportRawCloud(const RawStore* data, const std::string filename, const CloudOptions& options, size_t numFrames)
+{
+	// Only export the frames that are published right now, acquisition may still be appending.
+	numFrames = std::min(numFrames, data->NumFrames());
+	if (!numFrames || !data->NumSensors()) {
+		throw ex_export("Raw buffer is empty.", __func__, __FILE__);
+	}
+
+	mWriter.Open(filename);
+	this->WriteHeader(numFrames * data->NumSensors(), options);
+	for (int j = 0; j < data->NumSensors(); j++) {
+		for (size_t i = 0; i < numFrames; i++) {
+			this->WritePoint(data->At(j, i), options);
+			if (pProgress) {
+				pProgress->store(j * numFrames + i + 1, std::memory_order_relaxed);
+			}
+		}
+	}
+	mWriter.Close();
+}
+
+void CloudExport::SetProgress(std::atomic<size_t>* progress)
+{
+	pProgress = progress;
+}
+
+const std::string CloudExport::Extension(cloud_format format)
+{
+	return format == cloud_format::PCD ? ".pcd" : ".ply";
+}
+
+void CloudExport::WriteHeader(size_t numPoints, const CloudOptions& options)
+{
+	const std::string count = std::to_string(numPoints);
+	std::string header;
+	if (options.format == cloud_format::PLY) {
+		header = "ply\nformat binary_little_endian 1.0\ncomment SmartScan point cloud\nelement vertex " + count + "\n";
+		header += "property float x\nproperty float y\nproperty float z\n";
+		if (options.normals) {
+			header += "property float nx\nproperty float ny\nproperty float nz\n";
+		}
+		if (options.quality) {
+			header += "property ushort quality\n";
+		}
+		if (options.radius) {
+			header += "property float radius\n";
+		}
+		header += "end_header\n";
+	}
+	else {
+		// Every field gets its name, size in bytes, type and count in four separate lines.
+		std::string fields = "x y z", sizes = "4 4 4", types = "F F F", counts = "1 1 1";
+		if (options.normals) {
+			fields += " normal_x normal_y normal_z";
+			sizes += " 4 4 4";
+			types += " F F F";
+			counts += " 1 1 1";
+		}
+		if (options.quality) {
+			fields += " quality";
+			sizes += " 2";
+			types += " U";
+			counts += " 1";
+		}
+		if (options.radius) {
+			fields += " radius";
+			sizes += " 4";
+			types += " F";
+			counts += " 1";
+		}
+		header = "# .PCD v0.7 - Point Cloud Data file format\nVERSION 0.7\n";
+		header += "FIELDS " + fields + "\nSIZE " + sizes + "\nTYPE " + types + "\nCOUNT " + counts + "\n";
+		header += "WIDTH " + count + "\nHEIGHT 1\nVIEWPOINT 0 0 0 1 0 0 0\nPOINTS " + count + "\nDATA binary\n";
+	}
+	mWriter.Write(header);
+}
+
+void CloudExport::WritePoint(const Point3& point, const CloudOptions& options)
+{
+	mWriter.PutFloat((float)point.x);
+	mWriter.PutFloat((float)point.y);
+	mWriter.PutFloat((float)point.z);
+
+	// Samples of a scan carry their radius and angles to the reference point of their cell, raw samples are relative to the reference sensor.
+	const bool hasRadius = point.s.r != DBL_MAX;
+	if (options.normals) {
+		double nx, ny, nz;
+		if (hasRadius) {
+			// Undo Scan::CalcAngle(), theta is shifted by 180 degrees and phi is measured from the Z axis.
+			double theta = point.s.theta * toRadians, phi = point.s.phi * toRadians;
+			nx = -cos(theta) * sin(phi);
+			ny = -sin(theta) * sin(phi);
+			nz = cos(phi);
+		}
+		else {
+			double length = sqrt(point.x * point.x + point.y * point.y + point.z * point.z);
+			double scale = length > 0 ? 1 / length : 0;
+			nx = point.x * scale;
+			ny = point.y * scale;
+			nz = point.z * scale;
+		}
+		mWriter.PutFloat((float)nx);
+		mWriter.PutFloat((float)ny);
+		mWriter.PutFloat((float)nz);
+	}
+	if (options.quality) {
+		mWriter.PutUint16(point.quality);
+	}
+	if (options.radius) {
+		double r = hasRadius ? point.s.r : sqrt(point.x * point.x + point.y * point.y + point.z * point.z);
+		mWriter.PutFloat((float)r);
+	}
+}
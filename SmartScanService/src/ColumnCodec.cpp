@@ -0,0 +1,419 @@
+#include <algorithm>
+
+#include "ColumnCodec.h"
+
+using namespace SmartScan;
+
+namespace
+{
+	const uint64_t numDirect = 16;								// Values below this are a token of their own, larger ones are a token for their highest two bits and the lower bits as they are.
+	const int maxSymbols = 136;									// Number of tokens, enough for any 64-bit value.
+
+	// Returns the difference of a value with its prediction from the values before it.
+	// The arithmetic is done on unsigned integers, so it wraps around instead of overflowing and the decoder undoes it exactly.
+	inline uint64_t Residual(const int64_t* values, size_t i, int order)
+	{
+		uint64_t value = (uint64_t)values[i];
+		if (order == 0 || i == 0) {
+			return value;
+		}
+		if (order == 1 || i == 1) {
+			return value - (uint64_t)values[i - 1];
+		}
+		return value - 2 * (uint64_t)values[i - 1] + (uint64_t)values[i - 2];
+	}
+
+	// Map a signed difference to an unsigned one, 0, -1, 1, -2, 2 and so on become 0, 1, 2, 3, 4.
+	inline uint64_t ZigZag(uint64_t residual)
+	{
+		return (residual << 1) ^ (uint64_t)((int64_t)residual >> 63);
+	}
+
+	// Undo ZigZag().
+	inline uint64_t UnZigZag(uint64_t value)
+	{
+		return (value >> 1) ^ (0 - (value & 1));
+	}
+
+	// Returns the number of bits up to and including the highest set bit.
+	inline int BitLength(uint64_t value)
+	{
+		int length = 0;
+		for (int shift = 32; shift > 0; shift >>= 1) {
+			int step = (value >> shift) ? shift : 0;
+			value >>= step;
+			length += step;
+		}
+		return length + (int)value;
+	}
+
+	// Append a value as a varint, seven bits per byte starting with the lowest, the high bit of a byte tells that another byte follows.
+	inline void PutVarint(uint64_t value, std::vector<uint8_t>* bytes)
+	{
+		while (value >= 0x80) {
+			bytes->push_back((uint8_t)(value | 0x80));
+			value >>= 7;
+		}
+		bytes->push_back((uint8_t)value);
+	}
+
+	// Read a varint that was written by PutVarint().
+	// Returns "false" if the varint runs past the end or does not fit in 64 bits.
+	inline bool GetVarint(const uint8_t** p, const uint8_t* end, uint64_t* value)
+	{
+		*value = 0;
+		for (int shift = 0; shift < 64; shift += 7) {
+			if (*p == end) {
+				return false;
+			}
+			uint8_t byte = *(*p)++;
+			*value |= (uint64_t)(byte & 0x7f) << shift;
+			if (!(byte & 0x80)) {
+				return true;
+			}
+		}
+		return false;
+	}
+
+	// Writes values of up to 64 bits into a stream of bytes, lowest bits first.
+	class BitWriter
+	{
+	public:
+		BitWriter(std::vector<uint8_t>* bytes) : pBytes { bytes }
+		{
+
+		}
+
+		void Put(uint64_t value, int numBits)
+		{
+			if (numBits > 32) {
+				this->Put(value & 0xffffffff, 32);
+				value >>= 32;
+				numBits -= 32;
+			}
+			mBits |= (value & ((1ull << numBits) - 1)) << mUsed;
+			mUsed += numBits;
+			while (mUsed >= 8) {
+				pBytes->push_back((uint8_t)mBits);
+				mBits >>= 8;
+				mUsed -= 8;
+			}
+		}
+
+		// Write the last bits, padded with zeros to a whole byte.
+		void Flush()
+		{
+			if (mUsed) {
+				pBytes->push_back((uint8_t)mBits);
+				mBits = 0;
+				mUsed = 0;
+			}
+		}
+	private:
+		std::vector<uint8_t>* pBytes;							// Stream the bytes are appended to.
+		uint64_t mBits = 0;										// Bits that do not fill a byte yet.
+		int mUsed = 0;											// Number of bits in mBits.
+	};
+
+	// Reads the values written by a BitWriter.
+	class BitReader
+	{
+	public:
+		BitReader(const uint8_t* data, const uint8_t* end) : pData { data }, pEnd { end }
+		{
+
+		}
+
+		// Read a value. Returns "false" if the stream ends too early.
+		bool Get(int numBits, uint64_t* value)
+		{
+			if (numBits > mAvailable) {
+				return this->Refill(numBits, value);
+			}
+			*value = mBits & ((1ull << numBits) - 1);
+			mBits >>= numBits;
+			mAvailable -= numBits;
+			return true;
+		}
+
+		// Returns "true" if every byte has been read and only zero padding is left.
+		bool AtEnd() const
+		{
+			return pData == pEnd && mAvailable < 8 && !mBits;
+		}
+	private:
+		const uint8_t* pData;									// Next byte that is read.
+		const uint8_t* pEnd;									// End of the bytes.
+		uint64_t mBits = 0;										// Bits that have been read from the bytes but not returned yet.
+		int mAvailable = 0;										// Number of bits in mBits.
+
+		// Take in more bytes and read a value, also values of more bits than fit in at once.
+		bool Refill(int numBits, uint64_t* value)
+		{
+			if (numBits > 32) {
+				uint64_t low, high;
+				if (!this->Get(32, &low) || !this->Get(numBits - 32, &high)) {
+					return false;
+				}
+				*value = low | (high << 32);
+				return true;
+			}
+			while (mAvailable < numBits) {
+				if (pEnd - pData >= 8) {
+					// Take in whole bytes up to 56 bits at once. The bits of the next byte that come along are
+					// the same bits that the byte puts there when it is taken in later.
+					uint64_t word = 0;
+					for (int b = 0; b < 8; b++) {
+						word |= (uint64_t)pData[b] << (8 * b);
+					}
+					mBits |= word << mAvailable;
+					pData += (63 - mAvailable) >> 3;
+					mAvailable |= 56;
+				}
+				else if (pData == pEnd) {
+					return false;
+				}
+				else {
+					mBits |= (uint64_t)*pData++ << mAvailable;
+					mAvailable += 8;
+				}
+			}
+			return this->Get(numBits, value);
+		}
+	};
+
+	// Frequency of a token prepared for the encoder.
+	struct EncodeSymbol
+	{
+		uint32_t maxState;										// The state is renormalized until it is below this.
+		uint32_t reciprocal;									// Fixed point reciprocal of the frequency.
+		uint32_t shift;											// Shift after multiplying with the reciprocal.
+		uint32_t bias;											// Start of the slots of the token, corrected for a frequency of 1.
+		uint32_t complement;									// Number of slots of the other tokens.
+	};
+
+	// Entry of the decoding table for one slot of the rANS state.
+	struct DecodeSlot
+	{
+		uint16_t freq;											// Frequency of the token.
+		uint16_t bias;											// Position of the slot within the slots of the token.
+		uint8_t token;											// The token.
+	};
+}
+
+void ColumnCodec::Encode(const int64_t* values, size_t count, std::vector<uint8_t>* stream)
+{
+	// Pick the order with the fewest bits in its differences. Noise favours the previous value, smooth motion the line through the previous two.
+	int order = 1;
+	uint64_t bestBits = UINT64_MAX;
+	for (int o = 1; o <= maxOrder; o++) {
+		uint64_t bits = 0;
+		for (size_t i = 0; i < count; i++) {
+			bits += BitLength(ZigZag(Residual(values, i, o)));
+		}
+		if (bits < bestBits) {
+			bestBits = bits;
+			order = o;
+		}
+	}
+
+	// Split every zigzag encoded difference in a token, which is entropy coded, and the bits below its highest two, which are stored as they are.
+	std::vector<uint8_t> tokens(count);
+	std::vector<uint8_t> extraBits;
+	BitWriter extra(&extraBits);
+	uint32_t counts[maxSymbols] = {};
+	for (size_t i = 0; i < count; i++) {
+		uint64_t value = ZigZag(Residual(values, i, order));
+		if (value < numDirect) {
+			tokens[i] = (uint8_t)value;
+		}
+		else {
+			int length = BitLength(value);
+			tokens[i] = (uint8_t)(numDirect + (length - 5) * 2 + ((value >> (length - 2)) & 1));
+			extra.Put(value, length - 2);
+		}
+		counts[tokens[i]]++;
+	}
+	extra.Flush();
+
+	// Scale the token counts to frequencies that add up to 2^scaleBits. Every token that occurs keeps at least 1,
+	// what that adds too much is taken from the most frequent tokens.
+	const uint32_t total = 1u << scaleBits;
+	uint32_t freq[maxSymbols] = {};
+	uint32_t sum = 0;
+	int numSymbols = 0;
+	for (int s = 0; s < maxSymbols; s++) {
+		if (counts[s]) {
+			freq[s] = std::max((uint32_t)((uint64_t)counts[s] * total / count), 1u);
+			sum += freq[s];
+			numSymbols++;
+		}
+	}
+	while (numSymbols && sum != total) {
+		uint32_t* largest = std::max_element(freq, freq + maxSymbols);
+		if (sum > total) {
+			(*largest)--;
+			sum--;
+		}
+		else {
+			*largest += total - sum;
+			sum = total;
+		}
+	}
+	// Dividing the state by a frequency is done with a multiplication by its reciprocal, which is exact for states below 2^31.
+	EncodeSymbol symbols[maxSymbols];
+	for (int s = 0, start = 0; s < maxSymbols; s++) {
+		EncodeSymbol& symbol = symbols[s];
+		const uint32_t f = freq[s];
+		symbol.maxState = ((lowerBound >> scaleBits) << 8) * f;
+		symbol.complement = total - f;
+		if (f < 2) {
+			symbol.reciprocal = ~0u;
+			symbol.shift = 0;
+			symbol.bias = start + total - 1;
+		}
+		else {
+			uint32_t shift = 0;
+			while (f > (1u << shift)) {
+				shift++;
+			}
+			symbol.reciprocal = (uint32_t)(((1ull << (shift + 31)) + f - 1) / f);
+			symbol.shift = shift - 1;
+			symbol.bias = start;
+		}
+		start += f;
+	}
+
+	// rANS codes back to front, so the decoder reads the bytes front to back. A token never takes more than scaleBits bits.
+	// The even and odd tokens have a state of their own, which lets the decoder work on two tokens at the same time.
+	std::vector<uint8_t> coded(count * scaleBits / 8 + 16);
+	uint8_t* end = coded.data() + coded.size();
+	uint8_t* p = end;
+	if (count) {
+		uint32_t states[2] = { lowerBound, lowerBound };
+		for (size_t i = count; i-- > 0;) {
+			uint32_t& state = states[i & 1];
+			const EncodeSymbol& symbol = symbols[tokens[i]];
+			while (state >= symbol.maxState) {
+				*--p = (uint8_t)state;
+				state >>= 8;
+			}
+			uint32_t quotient = (uint32_t)(((uint64_t)state * symbol.reciprocal) >> 32) >> symbol.shift;
+			state += symbol.bias + quotient * symbol.complement;
+		}
+		for (int k = 1; k >= 0; k--) {
+			p -= 4;
+			p[0] = (uint8_t)states[k];
+			p[1] = (uint8_t)(states[k] >> 8);
+			p[2] = (uint8_t)(states[k] >> 16);
+			p[3] = (uint8_t)(states[k] >> 24);
+		}
+	}
+
+	// The order, the tokens that occur with their frequencies, the coded tokens and the extra bits.
+	stream->push_back((uint8_t)order);
+	PutVarint(numSymbols, stream);
+	for (int s = 0; s < maxSymbols; s++) {
+		if (freq[s]) {
+			stream->push_back((uint8_t)s);
+			PutVarint(freq[s], stream);
+		}
+	}
+	PutVarint(end - p, stream);
+	stream->insert(stream->end(), p, end);
+	stream->insert(stream->end(), extraBits.begin(), extraBits.end());
+}
+
+bool ColumnCodec::Decode(const uint8_t* stream, size_t size, int64_t* values, size_t count)
+{
+	const uint8_t* p = stream;
+	const uint8_t* end = stream + size;
+	if (p == end) {
+		return false;
+	}
+	const int order = *p++;
+	if (order > maxOrder) {
+		return false;
+	}
+
+	// Read the frequencies and fill the table that maps every slot of the state to its token.
+	const uint32_t total = 1u << scaleBits;
+	bool present[maxSymbols] = {};
+	DecodeSlot slots[1 << scaleBits];
+	uint64_t numSymbols;
+	if (!GetVarint(&p, end, &numSymbols) || numSymbols > maxSymbols) {
+		return false;
+	}
+	uint32_t sum = 0;
+	for (uint64_t n = 0; n < numSymbols; n++) {
+		uint64_t f;
+		if (p == end) {
+			return false;
+		}
+		uint8_t s = *p++;
+		if (s >= maxSymbols || present[s] || !GetVarint(&p, end, &f) || f == 0 || f > total - sum) {
+			return false;
+		}
+		present[s] = true;
+		for (uint32_t b = 0; b < f; b++) {
+			slots[sum + b] = { (uint16_t)f, (uint16_t)b, s };
+		}
+		sum += (uint32_t)f;
+	}
+	uint64_t codedSize;
+	if (!GetVarint(&p, end, &codedSize) || codedSize > (uint64_t)(end - p)) {
+		return false;
+	}
+	if (!count) {
+		return numSymbols == 0 && codedSize == 0 && p == end;
+	}
+	if (sum != total || codedSize < 8) {
+		return false;
+	}
+	const uint8_t* coded = p;
+	const uint8_t* codedEnd = p + codedSize;
+	BitReader extra(codedEnd, end);
+
+	uint32_t states[2];
+	for (int k = 0; k < 2; k++) {
+		states[k] = (uint32_t)coded[0] | ((uint32_t)coded[1] << 8) | ((uint32_t)coded[2] << 16) | ((uint32_t)coded[3] << 24);
+		coded += 4;
+	}
+	for (size_t i = 0; i < count; i++) {
+		// Decode the token and read the bytes the state needs to stay above the lower bound.
+		uint32_t& state = states[i & 1];
+		const DecodeSlot& slot = slots[state & (total - 1)];
+		const uint8_t s = slot.token;
+		state = slot.freq * (state >> scaleBits) + slot.bias;
+		while (state < lowerBound) {
+			if (coded == codedEnd) {
+				return false;
+			}
+			state = (state << 8) | *coded++;
+		}
+
+		// Put the highest two bits of the token in front of the extra bits, and add the prediction back.
+		uint64_t value = s;
+		if (s >= numDirect) {
+			int length = (s - (int)numDirect) / 2 + 5;
+			uint64_t low;
+			if (!extra.Get(length - 2, &low)) {
+				return false;
+			}
+			value = ((2 | (uint64_t)((s - numDirect) & 1)) << (length - 2)) | low;
+		}
+		uint64_t residual = UnZigZag(value);
+		if (order == 0 || i == 0) {
+			values[i] = (int64_t)residual;
+		}
+		else if (order == 1 || i == 1) {
+			values[i] = (int64_t)(residual + (uint64_t)values[i - 1]);
+		}
+		else {
+			values[i] = (int64_t)(residual + 2 * (uint64_t)values[i - 1] - (uint64_t)values[i - 2]);
+		}
+	}
+
+	// The encoder started from the lower bound, decoding all tokens returns to it with every byte read.
+	return states[0] == lowerBound && states[1] == lowerBound && coded == codedEnd && extra.AtEnd();
+}
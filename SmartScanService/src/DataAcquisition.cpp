@@ -1,6 +1,7 @@
 #include <iomanip>
 #include <ctime>
 #include <cstdio>
+#include <type_traits>
 
 #include "DataAcquisition.h"
 #include "Exceptions.h"
@@ -20,34 +21,64 @@ DataAcqConfig::DataAcqConfig(short int transmitterID, double measurementRate, do
 	}
 }
 
-DataAcq::DataAcq(bool useMockData) : mUseMockData { useMockData }, mTSCtrl(useMockData)
+DataAcq::DataAcq(bool useMockData) : DataAcq(useMockData ? device_backend::MOCK_FILE : device_backend::TRAKSTAR)
 {
 
 }
 
+DataAcq::DataAcq(device_backend backend, const std::string source) : mBackend { backend }
+{
+	// Create the device backend.
+	switch (backend) {
+		case device_backend::TRAKSTAR:
+#ifdef SMARTSCAN_TRAKSTAR
+			mDevice.emplace<TrakStarController>();
+			break;
+#else
+			throw ex_acq("The TrakStar backend is not available in this build.", __func__, __FILE__);
+#endif
+		case device_backend::MOCK_FILE:
+			mDevice.emplace<MockFileDevice>();
+			break;
+		case device_backend::SYNTHETIC:
+			mDevice.emplace<SyntheticDevice>();
+			break;
+		case device_backend::REPLAY:
+			mDevice.emplace<ReplayDevice>(source);
+			break;
+	}
+}
+
 DataAcq::~DataAcq()
 {
+	// Close the journal before the raw data is deleted, so it keeps the session.
+	if (mJournal.IsOpen()) {
+		this->Stop();
+		try {
+			mJournal.Close();
+		}
+		catch (...) {
+			// The journal is recovered like after a crash.
+		}
+	}
+
     // Delete all raw data when this object is removed.
 	this->Stop(true);
 }
 
 void DataAcq::Init()
 {
-	// Skip initalization of the TrakStar device when in Mock mode.
-	if (!mUseMockData) {
-		mTSCtrl.Init();
-		mTSCtrl.SelectTransmitter(mConfig.transmitterID);
-		mTSCtrl.SetPowerlineFrequency(mConfig.powerLineFrequency);
-		mTSCtrl.SetMeasurementRate(mConfig.measurementRate);
-		mTSCtrl.SetMaxRange(mConfig.maximumRange);
-		mTSCtrl.SetMetric();
-		mTSCtrl.SetReferenceFrame(mConfig.transmitterID, mConfig.frameRotations);
-		mTSCtrl.SetSensorFormat();
+	// The journal holds frames of the current sensors, a new sensor layout would not fit in it.
+	if (mJournal.IsOpen()) {
+		throw ex_acq("Cannot initialize data acquisition while a journal is open.", __func__, __FILE__);
 	}
 
-	// Get sensor info from TrakStar object.
-	mPortNumBuff = mTSCtrl.GetAttachedPorts();
-	mSerialBuff = mTSCtrl.GetAttachedSerials();
+	// Initialize the device with the acquisition settings.
+	std::visit([this](auto& device) { device.Configure(mConfig); }, mDevice);
+
+	// Get sensor info from the device.
+	mPortNumBuff = std::visit([](auto& device) { return device.GetAttachedPorts(); }, mDevice);
+	mSerialBuff = std::visit([](auto& device) { return device.GetAttachedSerials(); }, mDevice);
 
     // Remove reference sensor from sensor vector, because it is special.
 	if (mConfig.refSensorSerial >= 0) {
@@ -66,19 +97,22 @@ void DataAcq::Init()
 			throw ex_acq("Could not find the reference sensor specified.", __func__, __FILE__);
 		}
 		// Set the reference sensor to use rotation matrices instead of Euler angles.
-		if (!mUseMockData) {
-			mTSCtrl.SetRefSensorFormat(refSensorPort);
-		}
+		std::visit([this](auto& device) { device.SetReferenceSensor(refSensorPort); }, mDevice);
 	}
 
     // Initialize raw data buffer.
-	for (int i = 0; i < mPortNumBuff.size(); i++) {
-		mRawBuff.push_back(std::vector<Point3>());
-	}
+	mRawBuff.Init(mPortNumBuff.size(), mConfig.measurementRate);
+
+	// Initialize the frame ring, sized to hold a few seconds of frames so slow scans do not lose samples.
+	mFrameRing.Init(mPortNumBuff.size(), (int)(mConfig.measurementRate * ringBufferTime));
 }
 
 void DataAcq::Init(DataAcqConfig acquisitionConfig)
 {
+	if (mJournal.IsOpen()) {
+		throw ex_acq("Cannot initialize data acquisition while a journal is open.", __func__, __FILE__);
+	}
+
 	// Copy config and run init.
 	this->mConfig = acquisitionConfig;
 	this->Init();
@@ -94,13 +128,14 @@ void DataAcq::CorrectZOffset(int serialNumber)
     this->AngleCorrect(&zOnly);
 
 	// Set the offset.
-	mTSCtrl.SetSensorOffset(FindPortNum(serialNumber), zOnly);
+	int port = FindPortNum(serialNumber);
+	std::visit([&](auto& device) { device.SetSensorOffset(port, zOnly); }, mDevice);
 }
 
 void DataAcq::Start()
 {
 	// Check whether trak star controller has been initialised.
-	if (!mRawBuff.size()) {
+	if (!mRawBuff.NumSensors()) {
 		throw ex_acq("Data acquisition is not initialized.", __func__, __FILE__);
 	}
 
@@ -109,18 +144,17 @@ void DataAcq::Start()
 		return;
 	}
 
+	// Set the running flag before the thread starts, otherwise the acquisition loop may see it still cleared and exit right away.
+	mRunning = true;
+
     // Create a new DataAcquisition thread.
 	try	{
 		this->pAcquisitionThread = std::make_unique<std::thread>(&DataAcq::DataAcquisition, this);
 	}
 	catch (...)	{
+		mRunning = false;
 		throw ex_acq("Unnable to start data-acquisition thread.", __func__, __FILE__);
 	}
-
-	// Let it gooooo, let it gooo.
-	this->pAcquisitionThread->detach();
-
-	mRunning = true;
 }
 
 void DataAcq::Stop(bool clearData)
@@ -128,15 +162,19 @@ void DataAcq::Stop(bool clearData)
 	// Wait a bit for the other threads to finish.
 	std::this_thread::sleep_for(std::chrono::milliseconds(500));
 
+	// Stop the thread and wait for it, so it is no longer writing when the buffers are cleared.
+	mRunning = false;
+	if (pAcquisitionThread && pAcquisitionThread->joinable()) {
+		pAcquisitionThread->join();
+	}
+
 	// Clear button state and raw buffer.
     if (clearData) {
-		for (int i = 0; i < mRawBuff.size(); i++) {
-			button_obj.ClearMyButton();
-			mRawBuff.at(i).clear();
-		}
+		button_obj.ClearMyButton();
+		mRawBuff.Clear();
+		mFrameRing.Clear();
+		mJournal.Reset();
 	}
-
-	mRunning = false;
 }
 
 const bool DataAcq::IsRunning() const
@@ -144,15 +182,68 @@ const bool DataAcq::IsRunning() const
 	return mRunning;
 }
 
-const std::vector<std::vector<Point3>>* DataAcq::GetRawBuffer()
+void DataAcq::OpenJournal(const std::string filename, double minutes)
+{
+	// Check whether trak star controller has been initialised.
+	if (!mRawBuff.NumSensors()) {
+		throw ex_acq("Data acquisition is not initialized.", __func__, __FILE__);
+	}
+	if (mRunning) {
+		throw ex_acq("Cannot open a journal while data acquisition is running.", __func__, __FILE__);
+	}
+
+	mJournal.Open(filename, mConfig, mSerialBuff, minutes);
+
+	// Start with the frames that were recorded before, so the journal holds the same session as the raw store.
+	std::vector<Point3> frame(mRawBuff.NumSensors());
+	for (size_t f = 0; f < mRawBuff.NumFrames(); f++) {
+		for (int i = 0; i < mRawBuff.NumSensors(); i++) {
+			frame[i] = mRawBuff.At(i, f);
+		}
+		if (!mJournal.Append(frame.data(), mRawBuff.NumSensors())) {
+			break;
+		}
+	}
+}
+
+void DataAcq::CloseJournal()
+{
+	if (mRunning) {
+		throw ex_acq("Cannot close the journal while data acquisition is running.", __func__, __FILE__);
+	}
+
+	mJournal.Close();
+}
+
+const SessionJournal* DataAcq::GetJournal() const
+{
+	return &mJournal;
+}
+
+const RawStore* DataAcq::GetRawBuffer()
 {
 	return &mRawBuff;
 }
 
+const FrameRing* DataAcq::GetFrameRing() const
+{
+	return &mFrameRing;
+}
+
+const DataAcqConfig& DataAcq::GetConfig() const
+{
+	return mConfig;
+}
+
+const std::vector<int>& DataAcq::GetSerials() const
+{
+	return mSerialBuff;
+}
+
 Point3 DataAcq::GetSingleSample(int sensorSerial, bool raw)
 {
 	// Check whether trak star controller has been initialised.
-	if (!mRawBuff.size()) {
+	if (!mRawBuff.NumSensors()) {
 		throw ex_acq("Data acquisition is not initialized.", __func__, __FILE__);
 	}
 
@@ -160,7 +251,8 @@ Point3 DataAcq::GetSingleSample(int sensorSerial, bool raw)
 	Point3Ref refMatrix;
 
 	// Make Point3 obj to get the position info of the trackStar device.
-	Point3 rawPoint = mTSCtrl.GetRecord(FindPortNum(sensorSerial)); 
+	int port = FindPortNum(sensorSerial);
+	Point3 rawPoint = std::visit([port](auto& device) { return device.GetRecord(port); }, mDevice);
 
 	// Check if raw data is requested.
 	if (raw) {
@@ -168,21 +260,26 @@ Point3 DataAcq::GetSingleSample(int sensorSerial, bool raw)
 	}
 	// Check if a reference sensor is defined.
 	else if (refSensorPort > -1) {
-		refMatrix = mTSCtrl.GetRefRecord(refSensorPort);
+		refMatrix = std::visit([this](auto& device) { return device.GetRefRecord(refSensorPort); }, mDevice);
 		ReferenceCorrect(&refMatrix, &rawPoint);
 	}
 
 	return rawPoint;
 }
 
+const SamplingStats DataAcq::GetSamplingStats() const
+{
+	return mScheduler.GetStats();
+}
+
 const int DataAcq::NumAttachedBoards() const
 {
-	return mTSCtrl.NumAttachedBoards();
+	return std::visit([](auto& device) { return device.NumAttachedBoards(); }, mDevice);
 } 
 
 const int DataAcq::NumAttachedTransmitters() const
 {
-	return mTSCtrl.NumAttachedTransmitters();
+	return std::visit([](auto& device) { return device.NumAttachedTransmitters(); }, mDevice);
 } 
 
 const int DataAcq::NumAttachedSensors(bool includeRef) const
@@ -241,59 +338,69 @@ int DataAcq::FindBuffNum(int serialNumber)
 
 void DataAcq::DataAcquisition()
 {
-    // Store the current time.
-	double time = 0;
-	auto startSampling = std::chrono::steady_clock::now();
-	std::chrono::time_point<std::chrono::steady_clock> endSampleTime = startSampling;
+	// Pick the loop of the device backend once, the loop itself calls the device directly.
+	std::visit([this](auto& device) { this->AcquisitionLoop(device); }, mDevice);
+}
 
-	// Create empty reference point for later use.
+template <class Device>
+void DataAcq::AcquisitionLoop(Device& device)
+{
+	// Start a new timebase, every sample gets the time of its deadline so the timestamps do not drift.
+	mScheduler.Start(mConfig.measurementRate);
+
+	// Create empty reference point and record buffer for later use.
 	Point3Ref refMatrix;
+	std::vector<Point3> frameRecords;
 
 	while (mRunning) {
-		// Store time and calculate the elapsed time since last sample.
-		auto startSampleTime = std::chrono::steady_clock::now();
-		std::chrono::duration<double> elapsedTime = startSampleTime - endSampleTime;
+		// Sleep until the next sample is due.
+		mScheduler.WaitForNextSample();
+		double time = mScheduler.SampleTime();
 
-		if (elapsedTime.count() >= 1 / mConfig.measurementRate) {
-            time += elapsedTime.count();
+		// Read all sensors and the reference sensor in one driver call.
+		device.GetFrame(&frameRecords, &refMatrix, refSensorPort);
 
-			// Check if a reference sensor is defined.
-			if (refSensorPort > -1) {
-				refMatrix = mTSCtrl.GetRefRecord(refSensorPort);
-			}
+		// Write the samples straight into the next slot of the frame ring.
+		Point3* frame = mFrameRing.BeginFrame();
 
-            for (int i = 0; i < mPortNumBuff.size(); i++) {
-                // Make Point3 obj to get the position info of the trackStar device
-				Point3 raw = mTSCtrl.GetRecord(mPortNumBuff[i]); 
+        for (int i = 0; i < mPortNumBuff.size(); i++) {
+            // Take the record of this sensor out of the frame.
+			Point3 raw = frameRecords[mPortNumBuff[i]];
 
-				// Check and store the buttonstate
+			// Check and store the buttonstate. A replayed session already has the button state that was recorded.
+			if constexpr (!std::is_same_v<Device, ReplayDevice>) {
 				button_obj.UpdateButtonState(raw.button); 
 				raw.buttonState = button_obj.GetButtonState();
+			}
+
+			// Add total measurement time to point3.
+			raw.time = time;
 
-				// Add total measurement time to point3.
-				raw.time = time;
+			// Correct point for reference sensor
+			if (refSensorPort > -1) {
+				ReferenceCorrect(&refMatrix, &raw);
+			}
 
-				// Correct point for reference sensor
-				if (refSensorPort > -1) {
-					ReferenceCorrect(&refMatrix, &raw);
-				}
+			frame[i] = raw;
+	    }
 
-				mRawBuff[i].push_back(raw);
-		    }			
+		// Keep the frame in the raw store and publish it to the scans at once.
+		// The raw store comes first, so a scan can refer to a frame in it as soon as the frame is committed.
+		// If the raw store is ever full the scans still receive the frames through the ring.
+		mRawBuff.AppendFrame(frame);
+		mFrameRing.CommitFrame();
 
-			// Print the acquired data
-			if (mRawDataCallback) {
-				std::vector<Point3> sampleRow;
-				for (int i = 0; i < mRawBuff.size(); i++) {
-					sampleRow.push_back(mRawBuff.at(i).back());
-				}
-				mRawDataCallback(sampleRow);
-			}
+		// Copy the frame into the journal, if one is open. This is a copy into memory, the operating system writes it to disk.
+		mJournal.Append(frame, (int)mPortNumBuff.size());
 
-			// Store current time and calculate duration of the samples
-			endSampleTime = std::chrono::steady_clock::now();
+		// Print the acquired data
+		if (mRawDataCallback) {
+			std::vector<Point3> sampleRow(frame, frame + mPortNumBuff.size());
+			mRawDataCallback(sampleRow);
 		}
     }
+
+	mScheduler.Stop();
 }
 
 void DataAcq::ReferenceCorrect(Point3Ref* refPoint, Point3* sensorPoint)
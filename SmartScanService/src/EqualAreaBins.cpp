@@ -0,0 +1,28 @@
+#include "EqualAreaBins.h"
+
+using namespace SmartScan;
+
+EqualAreaBins::EqualAreaBins(int filteringPrecision)
+{
+	// A theta/phi bin at the equator covers about precision^2 steradians, the whole sphere 4 * PI. Round the side up to whole tiles.
+	double precision = filteringPrecision * pi / 180;
+	const int tileSide = 1 << tileShift;
+	mTilesPerSide = std::max((int)ceil(sqrt(4 * pi) / precision / tileSide), 1);
+	mSide = mTilesPerSide * tileSide;
+	mHalfSide = mSide / 2.0;
+}
+
+const int EqualAreaBins::NumCells() const
+{
+	return mSide * mSide;
+}
+
+const int EqualAreaBins::Side() const
+{
+	return mSide;
+}
+
+const double EqualAreaBins::CellArea() const
+{
+	return 4 * pi / this->NumCells();
+}
@@ -0,0 +1,112 @@
+#include "ExportQueue.h"
+
+using namespace SmartScan;
+
+ExportJob::ExportJob(const std::string filename, size_t numRows, Writer write)
+	: mFilename { filename }, mNumRows { numRows }, mWrite { write }
+{
+	mFuture = mDone.get_future().share();
+}
+
+const export_state ExportJob::GetState() const
+{
+	return mState.load(std::memory_order_acquire);
+}
+
+const double ExportJob::GetProgress() const
+{
+	export_state state = this->GetState();
+	if (state == export_state::DONE) {
+		return 1;
+	}
+	return mNumRows ? (double)mRowsWritten.load(std::memory_order_relaxed) / mNumRows : 0;
+}
+
+const std::string& ExportJob::GetFilename() const
+{
+	return mFilename;
+}
+
+std::shared_future<void> ExportJob::GetFuture() const
+{
+	return mFuture;
+}
+
+ExportQueue::ExportQueue()
+{
+
+}
+
+ExportQueue::~ExportQueue()
+{
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		mExit = true;
+	}
+	mChanged.notify_all();
+
+	if (pWritingThread && pWritingThread->joinable()) {
+		pWritingThread->join();
+	}
+}
+
+std::shared_ptr<ExportJob> ExportQueue::Push(const std::string filename, size_t numRows, ExportJob::Writer write)
+{
+	std::shared_ptr<ExportJob> job = std::make_shared<ExportJob>(filename, numRows, write);
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		mJobs.push_back(job);
+		if (!pWritingThread) {
+			pThreadPool = std::make_unique<ThreadPool>();
+			pWritingThread = std::make_unique<std::thread>(&ExportQueue::Writing, this);
+		}
+	}
+	mChanged.notify_all();
+	return job;
+}
+
+void ExportQueue::Wait()
+{
+	std::unique_lock<std::mutex> lock(mMutex);
+	mChanged.wait(lock, [this] { return mJobs.empty(); });
+}
+
+const int ExportQueue::NumPending() const
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	return (int)mJobs.size();
+}
+
+void ExportQueue::Writing()
+{
+	std::unique_lock<std::mutex> lock(mMutex);
+	while (true) {
+		// Queued exports are always finished, also when the queue is destroyed.
+		mChanged.wait(lock, [this] { return mExit || !mJobs.empty(); });
+		if (mJobs.empty()) {
+			return;
+		}
+
+		// Write without holding the lock, so new exports can be queued in the meantime.
+		std::shared_ptr<ExportJob> job = mJobs.front();
+		lock.unlock();
+
+		job->mState.store(export_state::RUNNING, std::memory_order_release);
+		try {
+			job->mWrite(&job->mRowsWritten, pThreadPool.get());
+			job->mState.store(export_state::DONE, std::memory_order_release);
+			job->mDone.set_value();
+		}
+		catch (...) {
+			job->mState.store(export_state::FAILED, std::memory_order_release);
+			job->mDone.set_exception(std::current_exception());
+		}
+
+		// Release what the writer holds on to, like the snapshot of a scan, as soon as the file is written.
+		job->mWrite = nullptr;
+
+		lock.lock();
+		mJobs.pop_front();
+		mChanged.notify_all();
+	}
+}
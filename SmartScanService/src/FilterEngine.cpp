@@ -0,0 +1,231 @@
+#include <algorithm>
+#include <climits>
+
+#include "FilterEngine.h"
+
+using namespace SmartScan;
+
+FilterEngine::FilterEngine(const FrameRing* inBuff)
+	: mInBuff { inBuff }
+{
+
+}
+
+FilterEngine::~FilterEngine()
+{
+	// End the filtering thread, wake it if it is waiting for a frame and wait for it to finish.
+	mExit = true;
+	this->Wake();
+	if (pFilteringThread && pFilteringThread->joinable()) {
+		pFilteringThread->join();
+	}
+}
+
+void FilterEngine::Add(std::shared_ptr<Scan> scan)
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+
+	// Add the scan to the group with exactly the same reference points.
+	const std::vector<Point3>& refPoints = scan->mConfig.refPoints;
+	for (auto& group : mGroups) {
+		bool same = group->refPoints.size() == refPoints.size();
+		for (size_t i = 0; same && i < refPoints.size(); i++) {
+			same = group->refPoints[i].x == refPoints[i].x && group->refPoints[i].y == refPoints[i].y && group->refPoints[i].z == refPoints[i].z;
+		}
+		if (same) {
+			group->scans.push_back(scan);
+			return;
+		}
+	}
+
+	// Otherwise start a new group.
+	std::unique_ptr<Group> group = std::make_unique<Group>();
+	group->refPoints = refPoints;
+	group->refIndex.Build(refPoints);
+	group->scans.push_back(scan);
+	mGroups.push_back(std::move(group));
+}
+
+void FilterEngine::Remove(const Scan* scan)
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+
+	for (size_t g = 0; g < mGroups.size(); g++) {
+		std::vector<std::shared_ptr<Scan>>& scans = mGroups[g]->scans;
+		for (size_t s = 0; s < scans.size(); s++) {
+			if (scans[s].get() == scan) {
+				scans.erase(scans.begin() + s);
+
+				// Drop groups without scans, so their work is not done for nothing.
+				if (scans.empty()) {
+					mGroups.erase(mGroups.begin() + g);
+				}
+				return;
+			}
+		}
+	}
+}
+
+void FilterEngine::Start(Scan* scan)
+{
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		scan->mFiltering = true;
+
+		// Start the filtering thread if it has finished, after joining the finished one.
+		if (!mThreadActive) {
+			if (pFilteringThread && pFilteringThread->joinable()) {
+				pFilteringThread->join();
+			}
+			mThreadActive = true;
+			try {
+				pFilteringThread = std::make_unique<std::thread>(&FilterEngine::Filtering, this);
+			}
+			catch (...) {
+				mThreadActive = false;
+				scan->mFiltering = false;
+				throw;
+			}
+		}
+	}
+
+	// A running thread may be waiting for a frame that is newer than the one this scan needs.
+	this->Wake();
+}
+
+void FilterEngine::Wake()
+{
+	mKeepWaiting = false;
+	mInBuff->WakeAll();
+}
+
+void FilterEngine::WaitForScan(const Scan* scan)
+{
+	// The cells of a scan are only written while holding the mutex, once the scan is no longer filtered they are left alone.
+	std::unique_lock<std::mutex> lock(mMutex);
+	mIdle.wait(lock, [&]() { return !scan->mFiltering || !mThreadActive; });
+}
+
+void FilterEngine::Wait()
+{
+	std::unique_lock<std::mutex> lock(mMutex);
+	mIdle.wait(lock, [&]() { return !mThreadActive; });
+}
+
+const bool FilterEngine::IsFiltering(const Scan* scan) const
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	return scan->mFiltering;
+}
+
+const int FilterEngine::NumGroups() const
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	return mGroups.size();
+}
+
+void FilterEngine::Filtering()
+{
+	while (true) {
+		// Set the flag before looking at the scans. A scan that is stopped after that clears it again, so the wait below can not miss it.
+		mKeepWaiting = true;
+		if (mExit) {
+			break;
+		}
+
+		std::unique_lock<std::mutex> lock(mMutex);
+		uint64_t committed = mInBuff->Committed();
+
+		// Find the oldest frame that a scan still needs. Scans that are stopped and caught up, or reached their stopAtSample, are done.
+		int next = INT_MAX;
+		for (auto& group : mGroups) {
+			for (auto& scan : group->scans) {
+				if (!scan->mFiltering) {
+					continue;
+				}
+				if (!this->IsActive(*scan, committed)) {
+					scan->mFiltering = false;
+					scan->mRunning = false;
+					mIdle.notify_all();
+					continue;
+				}
+				next = std::min(next, scan->mLastFilteredSample);
+			}
+		}
+
+		// Nothing left to do.
+		if (next == INT_MAX) {
+			break;
+		}
+
+		// Block until data acquisition has committed the next frame or a scan is stopped.
+		if ((uint64_t)next >= committed) {
+			lock.unlock();
+			mInBuff->WaitForFrame(next, mKeepWaiting);
+			continue;
+		}
+
+		// Copy the frame out of the ring. This fails when a scan fell so far behind that the frame has already been overwritten.
+		mFrame.resize(mInBuff->NumSensors());
+		if (!mInBuff->ReadFrame(next, mFrame.data())) {
+			// Skip the scans that are behind to the oldest frame that is still available.
+			int oldest = mInBuff->Oldest();
+			for (auto& group : mGroups) {
+				for (auto& scan : group->scans) {
+					if (scan->mFiltering && scan->mLastFilteredSample < oldest) {
+						scan->mDroppedFrames += oldest - scan->mLastFilteredSample;
+						scan->mLastFilteredSample = oldest;
+					}
+				}
+			}
+			continue;
+		}
+
+		for (auto& group : mGroups) {
+			this->FilterGroup(group.get(), next);
+		}
+	}
+
+	// Let Start() know a new thread is needed, and Wait() that this one is done.
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		mThreadActive = false;
+	}
+	mIdle.notify_all();
+}
+
+bool FilterEngine::IsActive(const Scan& scan, uint64_t committed) const
+{
+	// The same condition as the filtering loop of a scan with its own thread.
+	const int stopAtSample = scan.mConfig.stopAtSample;
+	return (stopAtSample < 0 || scan.mLastFilteredSample < stopAtSample) && !scan.mConverged && (scan.mRunning || (uint64_t)scan.mLastFilteredSample < committed);
+}
+
+void FilterEngine::FilterGroup(Group* group, int index)
+{
+	// Collect the scans of the group that need this frame. Scans that are further ahead already have it.
+	mNeedFrame.clear();
+	float outlierThreshold = 0;
+	for (auto& scan : group->scans) {
+		if (scan->mFiltering && scan->mLastFilteredSample == index) {
+			mNeedFrame.push_back(scan.get());
+			outlierThreshold = std::max(outlierThreshold, scan->DirectionThreshold());
+		}
+	}
+	if (mNeedFrame.empty()) {
+		return;
+	}
+
+	// Calculate the nearest reference point, the radius and the direction once for all these scans.
+	// The direction is needed for every sample that at least one scan with a theta/phi grid does not reject as outlier.
+	group->frame = mFrame;
+	group->samples.resize(mFrame.size());
+	for (size_t i = 0; i < group->frame.size(); i++) {
+		Scan::PrepareSample(group->refIndex, group->refPoints, outlierThreshold, &group->frame[i], &group->samples[i]);
+	}
+
+	// Every scan only applies its own outlier threshold and bin size.
+	for (Scan* scan : mNeedFrame) {
+		scan->StoreFrame(group->frame.data(), group->samples.data());
+	}
+}
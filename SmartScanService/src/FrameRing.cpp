@@ -0,0 +1,118 @@
+#include <algorithm>
+
+#include "FrameRing.h"
+
+using namespace SmartScan;
+
+FrameRing::FrameRing()
+{
+
+}
+
+void FrameRing::Init(int numSensors, int minCapacity)
+{
+	// Round the capacity up to a power of two so a frame index can be mapped to a slot with a mask.
+	uint64_t capacity = 1;
+	while (capacity < (uint64_t)std::max(minCapacity, 1)) {
+		capacity <<= 1;
+	}
+
+	mNumSensors = numSensors;
+	mCapacity = capacity;
+	mMask = capacity - 1;
+
+	// Allocate all slots up front so the producer never allocates while sampling.
+	mSlots.assign(mCapacity * mNumSensors, Point3());
+	mCommitIndex.store(0, std::memory_order_release);
+}
+
+Point3* FrameRing::BeginFrame()
+{
+	// Only the producer writes the commit index, so a relaxed load is enough here.
+	uint64_t index = mCommitIndex.load(std::memory_order_relaxed);
+	return &mSlots[(index & mMask) * mNumSensors];
+}
+
+void FrameRing::CommitFrame()
+{
+	// The release store makes the samples written into the slot visible before the new commit index.
+	mCommitIndex.store(mCommitIndex.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+
+	// Only take the mutex when a consumer is waiting, so the producer stays lock-free while every consumer keeps up.
+	// The fence pairs with the one in WaitForFrame(): either the consumer sees the new commit index, or the producer sees the consumer waiting.
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	if (mNumWaiting.load(std::memory_order_relaxed) > 0) {
+		this->WakeAll();
+	}
+}
+
+bool FrameRing::WaitForFrame(uint64_t index, const std::atomic<bool>& keepWaiting) const
+{
+	if (index < mCommitIndex.load(std::memory_order_acquire)) {
+		return true;
+	}
+
+	mNumWaiting.fetch_add(1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	{
+		// The commit index and the flag are checked while holding the mutex, and WakeAll() takes it before notifying, so no wake up is lost.
+		std::unique_lock<std::mutex> lock(mWaitMutex);
+		mWaitCondition.wait(lock, [&]() { return index < mCommitIndex.load(std::memory_order_acquire) || !keepWaiting; });
+	}
+	mNumWaiting.fetch_sub(1, std::memory_order_relaxed);
+
+	return index < mCommitIndex.load(std::memory_order_acquire);
+}
+
+void FrameRing::WakeAll() const
+{
+	{
+		std::lock_guard<std::mutex> lock(mWaitMutex);
+	}
+	mWaitCondition.notify_all();
+}
+
+bool FrameRing::ReadFrame(uint64_t index, Point3* frame) const
+{
+	// Check if the frame is published and not yet overwritten.
+	uint64_t committed = mCommitIndex.load(std::memory_order_acquire);
+	if (index >= committed || committed - index >= mCapacity) {
+		return false;
+	}
+
+	const Point3* slot = &mSlots[(index & mMask) * mNumSensors];
+	std::copy(slot, slot + mNumSensors, frame);
+
+	// The producer only starts overwriting this slot after the commit index has reached index + capacity.
+	// Check the commit index again after the copy, if it moved that far the copy may be torn.
+	std::atomic_thread_fence(std::memory_order_acquire);
+	committed = mCommitIndex.load(std::memory_order_relaxed);
+	return committed - index < mCapacity;
+}
+
+uint64_t FrameRing::Committed() const
+{
+	return mCommitIndex.load(std::memory_order_acquire);
+}
+
+uint64_t FrameRing::Oldest() const
+{
+	// Keep one slot of margin since the producer may be writing the slot after the last committed frame.
+	uint64_t committed = mCommitIndex.load(std::memory_order_acquire);
+	return committed < mCapacity ? 0 : committed - mCapacity + 1;
+}
+
+void FrameRing::Clear()
+{
+	mCommitIndex.store(0, std::memory_order_release);
+}
+
+const int FrameRing::NumSensors() const
+{
+	return mNumSensors;
+}
+
+const int FrameRing::Capacity() const
+{
+	return (int)mCapacity;
+}
@@ -0,0 +1,125 @@
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#include "MappedFile.h"
+
+using namespace SmartScan;
+
+MappedFile::MappedFile()
+{
+
+}
+
+MappedFile::~MappedFile()
+{
+	this->Close();
+}
+
+bool MappedFile::Open(const std::string& path)
+{
+	this->Close();
+
+#ifdef _WIN32
+	HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	if (file == INVALID_HANDLE_VALUE) {
+		return false;
+	}
+	mFile = file;
+
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(file, &size)) {
+		this->Close();
+		return false;
+	}
+	mSize = (size_t)size.QuadPart;
+
+	// An empty file can not be mapped, it is simply presented as no data.
+	if (!mSize) {
+		return true;
+	}
+
+	mMapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (!mMapping) {
+		this->Close();
+		return false;
+	}
+
+	mData = static_cast<const char*>(MapViewOfFile(mMapping, FILE_MAP_READ, 0, 0, 0));
+	if (!mData) {
+		this->Close();
+		return false;
+	}
+#else
+	mFile = open(path.c_str(), O_RDONLY);
+	if (mFile < 0) {
+		return false;
+	}
+
+	struct stat info;
+	if (fstat(mFile, &info) != 0) {
+		this->Close();
+		return false;
+	}
+	mSize = (size_t)info.st_size;
+
+	// An empty file can not be mapped, it is simply presented as no data.
+	if (!mSize) {
+		return true;
+	}
+
+	void* data = mmap(nullptr, mSize, PROT_READ, MAP_PRIVATE, mFile, 0);
+	if (data == MAP_FAILED) {
+		this->Close();
+		return false;
+	}
+	mData = static_cast<const char*>(data);
+
+	// The file is parsed front to back, let the kernel read ahead.
+	madvise(data, mSize, MADV_SEQUENTIAL);
+#endif
+
+	return true;
+}
+
+void MappedFile::Close()
+{
+#ifdef _WIN32
+	if (mData) {
+		UnmapViewOfFile(mData);
+	}
+	if (mMapping) {
+		CloseHandle(mMapping);
+	}
+	if (mFile) {
+		CloseHandle(mFile);
+	}
+	mMapping = nullptr;
+	mFile = nullptr;
+#else
+	if (mData) {
+		munmap(const_cast<char*>(mData), mSize);
+	}
+	if (mFile >= 0) {
+		close(mFile);
+	}
+	mFile = -1;
+#endif
+	mData = nullptr;
+	mSize = 0;
+}
+
+const char* MappedFile::Data() const
+{
+	return mData;
+}
+
+size_t MappedFile::Size() const
+{
+	return mSize;
+}
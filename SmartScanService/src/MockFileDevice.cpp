@@ -0,0 +1,146 @@
+#include <charconv>
+
+#include "MockFileDevice.h"
+#include "MappedFile.h"
+#include "Exceptions.h"
+
+using namespace SmartScan;
+
+MockFileDevice::MockFileDevice(const std::string directory) : mDirectory { directory }
+{
+
+}
+
+void MockFileDevice::Configure(const DataAcqConfig& config)
+{
+	mSamples.clear();
+
+	// Load s0.csv, s1.csv, ... until a file is missing.
+	MappedFile file;
+	while (file.Open(mDirectory + "s" + std::to_string(mSamples.size()) + ".csv")) {
+		mSamples.emplace_back();
+		ParseFile(file.Data(), file.Data() + file.Size(), mSamples.back());
+		if (mSamples.back().empty()) {
+			throw ex_acq("Mock data file contains no samples.", __func__, __FILE__);
+		}
+	}
+	file.Close();
+
+	if (mSamples.empty()) {
+		throw ex_acq("Could not open the mock data files.", __func__, __FILE__);
+	}
+
+	mCursor.assign(mSamples.size(), 0);
+}
+
+void MockFileDevice::SetReferenceSensor(int id)
+{
+
+}
+
+void MockFileDevice::SetSensorOffset(int id, Point3 offset)
+{
+
+}
+
+const int MockFileDevice::NumAttachedBoards() const
+{
+	return 1;
+}
+
+const int MockFileDevice::NumAttachedTransmitters() const
+{
+	return 1;
+}
+
+std::vector<int> MockFileDevice::GetAttachedPorts() const
+{
+	std::vector<int> ports;
+	for (int i = 0; i < (int)mSamples.size(); i++) {
+		ports.push_back(i);
+	}
+	return ports;
+}
+
+std::vector<int> MockFileDevice::GetAttachedSerials() const
+{
+	return this->GetAttachedPorts();
+}
+
+Point3 MockFileDevice::GetRecord(int id)
+{
+	const std::vector<Point3>& samples = mSamples.at(id);
+	size_t& cursor = mCursor[id];
+
+	Point3 record = samples[cursor];
+	if (++cursor == samples.size()) {
+		cursor = 0;
+	}
+	return record;
+}
+
+Point3Ref MockFileDevice::GetRefRecord(int id)
+{
+	return Point3Ref();
+}
+
+void MockFileDevice::GetFrame(std::vector<Point3>* records, Point3Ref* refRecord, int refId)
+{
+	// Return the next sample of every mock data file, except for the reference sensor.
+	records->resize(mSamples.size());
+	for (int i = 0; i < (int)mSamples.size(); i++) {
+		(*records)[i] = (i == refId) ? Point3() : this->GetRecord(i);
+	}
+	*refRecord = Point3Ref();
+}
+
+const size_t MockFileDevice::NumSamples(int id) const
+{
+	return mSamples.at(id).size();
+}
+
+const Point3& MockFileDevice::Sample(int id, size_t index) const
+{
+	return mSamples.at(id)[index];
+}
+
+void MockFileDevice::ParseFile(const char* begin, const char* end, std::vector<Point3>& samples)
+{
+	// Reserve using the typical line length, so the array is rarely reallocated.
+	samples.reserve((end - begin) / 40 + 1);
+
+	const char* p = begin;
+	while (p < end) {
+		// Skip line endings and empty lines.
+		if (*p == '\n' || *p == '\r') {
+			p++;
+			continue;
+		}
+
+		double values[6];
+		for (int c = 0; c < 6; c++) {
+			std::from_chars_result result = std::from_chars(p, end, values[c]);
+			if (result.ec != std::errc()) {
+				throw ex_acq("Mock data file contains an invalid number.", __func__, __FILE__);
+			}
+			p = result.ptr;
+
+			// Values are separated by a comma, the last one is followed by the line ending.
+			if (c < 5) {
+				if (p == end || *p != ',') {
+					throw ex_acq("Mock data file contains a line with less than 6 values.", __func__, __FILE__);
+				}
+				p++;
+			}
+		}
+
+		// Ignore anything else on the line.
+		while (p < end && *p != '\n') {
+			p++;
+		}
+
+		Point3 sample(values[0], values[1], values[2], values[3], values[4], values[5], 0, 0);
+		sample.button = 1;
+		samples.push_back(sample);
+	}
+}
@@ -0,0 +1,68 @@
+#include "RawStore.h"
+
+using namespace SmartScan;
+
+RawStore::RawStore()
+{
+
+}
+
+void RawStore::Init(int numSensors, double measurementRate)
+{
+	mNumSensors = numSensors;
+	mMeasurementRate = measurementRate;
+	mNumFrames.store(0, std::memory_order_release);
+
+	// Size the segments so that a new one is only needed about once a minute.
+	mSensors.reset(new SegmentedBuffer<Point3>[mNumSensors]);
+	for (int i = 0; i < mNumSensors; i++) {
+		mSensors[i].Init((size_t)(measurementRate * segmentTime), maxSegments);
+	}
+}
+
+bool RawStore::AppendFrame(const Point3* frame)
+{
+	size_t index = mNumFrames.load(std::memory_order_relaxed);
+
+	// Write the sample of every sensor before publishing the frame.
+	for (int i = 0; i < mNumSensors; i++) {
+		Point3* slot = mSensors[i].Write(index);
+		if (!slot) {
+			return false;
+		}
+		*slot = frame[i];
+	}
+
+	mNumFrames.store(index + 1, std::memory_order_release);
+	return true;
+}
+
+const size_t RawStore::NumFrames() const
+{
+	return mNumFrames.load(std::memory_order_acquire);
+}
+
+const int RawStore::NumSensors() const
+{
+	return mNumSensors;
+}
+
+const double RawStore::MeasurementRate() const
+{
+	return mMeasurementRate;
+}
+
+const size_t RawStore::Capacity() const
+{
+	return mNumSensors ? mSensors[0].Capacity() : 0;
+}
+
+const Point3& RawStore::At(int sensor, size_t frame) const
+{
+	return mSensors[sensor][frame];
+}
+
+void RawStore::Clear()
+{
+	mNumFrames.store(0, std::memory_order_release);
+}
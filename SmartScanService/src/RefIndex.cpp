@@ -0,0 +1,263 @@
+#include <algorithm>
+#include <cmath>
+#include <float.h>
+
+#include "RefIndex.h"
+
+using namespace SmartScan;
+
+RefIndex::RefIndex()
+{
+
+}
+
+void RefIndex::Build(const std::vector<Point3>& refPoints)
+{
+	mLinear.clear();
+	for (int i = 0; i < (int)refPoints.size(); i++) {
+		mLinear.push_back(RefPoint { { refPoints[i].x, refPoints[i].y, refPoints[i].z }, i });
+	}
+
+	mTreePoints.clear();
+	mNodes.clear();
+	mCellStart.clear();
+	mCandidates.clear();
+	if (mLinear.size() > linearLimit) {
+		mTreePoints = mLinear;
+		this->BuildNode(0, (int)mTreePoints.size());
+		this->BuildGrid();
+	}
+}
+
+int RefIndex::Nearest(double x, double y, double z, double* squaredDistance) const
+{
+	if (mNodes.empty()) {
+		return this->NearestLinear(x, y, z, squaredDistance);
+	}
+	return this->NearestGrid(x, y, z, squaredDistance);
+}
+
+int RefIndex::NearestLinear(double x, double y, double z, double* squaredDistance) const
+{
+	int best = -1;
+	double bestDistance = DBL_MAX;
+	for (const RefPoint& ref : mLinear) {
+		double dx = x - ref.p[0], dy = y - ref.p[1], dz = z - ref.p[2];
+		double distance = dx * dx + dy * dy + dz * dz;
+		if (distance < bestDistance) {
+			bestDistance = distance;
+			best = ref.index;
+		}
+	}
+
+	*squaredDistance = bestDistance;
+	return best;
+}
+
+int RefIndex::NearestTree(double x, double y, double z, double* squaredDistance) const
+{
+	if (mNodes.empty()) {
+		return this->NearestLinear(x, y, z, squaredDistance);
+	}
+
+	const double q[3] = { x, y, z };
+	int best = -1;
+	double bestDistance = DBL_MAX;
+
+	// Depth first search with an explicit stack. Every entry holds a node and a lower bound of the squared distance to anything in it.
+	// The bound is the squared distance to the cell of the node, kept up to date per axis, which prunes far better than the distance to the last plane.
+	// The depth of the tree is about log2 of the number of leaves, so 64 entries is plenty.
+	struct Entry { int node; double bound; double offset[3]; };
+	Entry stack[64];
+	int top = 0;
+	stack[top++] = Entry { 0, 0, { 0, 0, 0 } };
+
+	while (top) {
+		const Entry entry = stack[--top];
+
+		// Skip nodes that can not contain a nearer point. Equally near points are still visited, since the lowest index wins a tie.
+		if (entry.bound > bestDistance) {
+			continue;
+		}
+
+		const Node& node = mNodes[entry.node];
+		if (node.axis < 0) {
+			for (int i = node.first; i < node.second; i++) {
+				const RefPoint& ref = mTreePoints[i];
+				double dx = x - ref.p[0], dy = y - ref.p[1], dz = z - ref.p[2];
+				double distance = dx * dx + dy * dy + dz * dz;
+				// A nearer point is rare after the first few, so this branch predicts well.
+				if (distance <= bestDistance && (distance < bestDistance || ref.index < best)) {
+					bestDistance = distance;
+					best = ref.index;
+				}
+			}
+			continue;
+		}
+
+		// Push the far side first, so the side of the sample is searched first.
+		double offset = q[node.axis] - node.split;
+		int nearChild = offset < 0 ? node.first : node.second;
+		int farChild = offset < 0 ? node.second : node.first;
+
+		Entry far = entry;
+		far.node = farChild;
+		far.bound = entry.bound - entry.offset[node.axis] * entry.offset[node.axis] + offset * offset;
+		far.offset[node.axis] = offset;
+		stack[top++] = far;
+
+		Entry near = entry;
+		near.node = nearChild;
+		stack[top++] = near;
+	}
+
+	*squaredDistance = bestDistance;
+	return best;
+}
+
+int RefIndex::NearestGrid(double x, double y, double z, double* squaredDistance) const
+{
+	if (mCellStart.empty()) {
+		return this->NearestTree(x, y, z, squaredDistance);
+	}
+
+	// Find the cell of the sample, samples outside the grid are searched in the tree.
+	double fx = (x - mGridOrigin[0]) * mCellScale[0];
+	double fy = (y - mGridOrigin[1]) * mCellScale[1];
+	double fz = (z - mGridOrigin[2]) * mCellScale[2];
+	if (!(fx >= 0 && fy >= 0 && fz >= 0 && fx < mGridSize[0] && fy < mGridSize[1] && fz < mGridSize[2])) {
+		return this->NearestTree(x, y, z, squaredDistance);
+	}
+	int cell = ((int)fx * mGridSize[1] + (int)fy) * mGridSize[2] + (int)fz;
+
+	// The candidates are in ascending index order, so the first of equally near points is kept.
+	int best = -1;
+	double bestDistance = DBL_MAX;
+	for (int i = mCellStart[cell]; i < mCellStart[cell + 1]; i++) {
+		const RefPoint& ref = mCandidates[i];
+		double dx = x - ref.p[0], dy = y - ref.p[1], dz = z - ref.p[2];
+		double distance = dx * dx + dy * dy + dz * dz;
+		if (distance < bestDistance) {
+			bestDistance = distance;
+			best = ref.index;
+		}
+	}
+
+	*squaredDistance = bestDistance;
+	return best;
+}
+
+const int RefIndex::Size() const
+{
+	return (int)mLinear.size();
+}
+
+int RefIndex::BuildNode(int begin, int end)
+{
+	int nodeIndex = (int)mNodes.size();
+	mNodes.push_back(Node { -1, 0, begin, end });
+
+	if (end - begin <= leafSize) {
+		return nodeIndex;
+	}
+
+	// Split on the axis with the largest extent.
+	double low[3] = { DBL_MAX, DBL_MAX, DBL_MAX }, high[3] = { -DBL_MAX, -DBL_MAX, -DBL_MAX };
+	for (int i = begin; i < end; i++) {
+		for (int a = 0; a < 3; a++) {
+			low[a] = std::min(low[a], mTreePoints[i].p[a]);
+			high[a] = std::max(high[a], mTreePoints[i].p[a]);
+		}
+	}
+	int axis = 0;
+	for (int a = 1; a < 3; a++) {
+		if (high[a] - low[a] > high[axis] - low[axis]) {
+			axis = a;
+		}
+	}
+
+	// Put the median in the middle, with the smaller points before it and the larger ones after it.
+	int mid = begin + (end - begin) / 2;
+	std::nth_element(mTreePoints.begin() + begin, mTreePoints.begin() + mid, mTreePoints.begin() + end, [axis](const RefPoint& a, const RefPoint& b) {
+		return a.p[axis] < b.p[axis];
+	});
+
+	// The children are built after the push_back above, so take the node by index again.
+	double split = mTreePoints[mid].p[axis];
+	int below = this->BuildNode(begin, mid);
+	int above = this->BuildNode(mid, end);
+	mNodes[nodeIndex] = Node { axis, split, below, above };
+	return nodeIndex;
+}
+
+void RefIndex::BuildGrid()
+{
+	// Bounding box of the reference points.
+	double low[3] = { DBL_MAX, DBL_MAX, DBL_MAX }, high[3] = { -DBL_MAX, -DBL_MAX, -DBL_MAX };
+	for (const RefPoint& ref : mLinear) {
+		for (int a = 0; a < 3; a++) {
+			low[a] = std::min(low[a], ref.p[a]);
+			high[a] = std::max(high[a], ref.p[a]);
+		}
+	}
+
+	// Grow the box so samples on the surface around the reference points still fall in the grid.
+	double extent = std::max({ high[0] - low[0], high[1] - low[1], high[2] - low[2], 1.0 });
+	double margin = gridMargin * extent;
+	double size[3], volume = 1;
+	for (int a = 0; a < 3; a++) {
+		mGridOrigin[a] = low[a] - margin;
+		size[a] = high[a] - low[a] + 2 * margin;
+		volume *= size[a];
+	}
+
+	// Pick cubic cells of about the same size, with a few cells per reference point.
+	double cellSize = cbrt(volume / (cellsPerRef * mLinear.size()));
+	for (int a = 0; a < 3; a++) {
+		mGridSize[a] = std::min(std::max((int)ceil(size[a] / cellSize), 1), 256);
+		mCellScale[a] = mGridSize[a] / size[a];
+	}
+
+	// A reference point is a candidate of a cell if its distance to the cell is not larger than
+	// the smallest distance at which some reference point is sure to cover the whole cell.
+	int numCells = mGridSize[0] * mGridSize[1] * mGridSize[2];
+	mCellStart.assign(numCells + 1, 0);
+	std::vector<double> minDistance(mLinear.size());
+	for (int ix = 0; ix < mGridSize[0]; ix++) {
+		for (int iy = 0; iy < mGridSize[1]; iy++) {
+			for (int iz = 0; iz < mGridSize[2]; iz++) {
+				int index[3] = { ix, iy, iz };
+				double cellLow[3], cellHigh[3];
+				for (int a = 0; a < 3; a++) {
+					// Grow the cell a little, so rounding in NearestGrid() can never put a sample in the wrong cell.
+					double epsilon = 1e-6 / mCellScale[a];
+					cellLow[a] = mGridOrigin[a] + index[a] / mCellScale[a] - epsilon;
+					cellHigh[a] = mGridOrigin[a] + (index[a] + 1) / mCellScale[a] + epsilon;
+				}
+
+				double cover = DBL_MAX;
+				for (int r = 0; r < (int)mLinear.size(); r++) {
+					double nearDistance = 0, farDistance = 0;
+					for (int a = 0; a < 3; a++) {
+						double p = mLinear[r].p[a];
+						double nearOffset = p < cellLow[a] ? cellLow[a] - p : (p > cellHigh[a] ? p - cellHigh[a] : 0);
+						double farOffset = std::max(std::abs(p - cellLow[a]), std::abs(p - cellHigh[a]));
+						nearDistance += nearOffset * nearOffset;
+						farDistance += farOffset * farOffset;
+					}
+					minDistance[r] = nearDistance;
+					cover = std::min(cover, farDistance);
+				}
+
+				int cell = (ix * mGridSize[1] + iy) * mGridSize[2] + iz;
+				mCellStart[cell] = (int)mCandidates.size();
+				for (int r = 0; r < (int)mLinear.size(); r++) {
+					if (minDistance[r] <= cover) {
+						mCandidates.push_back(mLinear[r]);
+					}
+				}
+			}
+		}
+	}
+	mCellStart[numCells] = (int)mCandidates.size();
+}
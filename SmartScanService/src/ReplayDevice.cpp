@@ -0,0 +1,126 @@
+#include <fstream>
+#include <algorithm>
+
+#include "ReplayDevice.h"
+#include "Exceptions.h"
+#include "SessionArchive.h"
+
+using namespace SmartScan;
+
+ReplayDevice::ReplayDevice(const std::string filename) : mFilename { filename }
+{
+
+}
+
+void ReplayDevice::Configure(const DataAcqConfig& config)
+{
+	mFrame = 0;
+
+	// A session archive is loaded into a raw store and copied frame by frame.
+	if (SessionArchive::IsArchive(mFilename)) {
+		RawStore session;
+		try {
+			SessionArchive archive;
+			archive.Load(mFilename, &session);
+		}
+		catch (ex_export& e) {
+			throw ex_acq(e.what(), __func__, __FILE__);
+		}
+
+		mNumSensors = session.NumSensors();
+		mNumFrames = session.NumFrames();
+		mSamples.resize(mNumFrames * mNumSensors);
+		for (size_t i = 0; i < mNumFrames; i++) {
+			for (int j = 0; j < mNumSensors; j++) {
+				mSamples[i * mNumSensors + j] = session.At(j, i);
+			}
+		}
+		return;
+	}
+
+	std::ifstream file(mFilename);
+	if (!file.is_open()) {
+		throw ex_acq("Could not open the replay session file.", __func__, __FILE__);
+	}
+
+	// The top row contains the amount of rows and the amount of sensors.
+	char comma;
+	if (!(file >> mNumFrames >> comma >> mNumSensors) || mNumSensors <= 0) {
+		throw ex_acq("Replay session file has an invalid header.", __func__, __FILE__);
+	}
+
+	// Every row contains time, position, rotation, quality and button state of every sensor, each followed by a comma.
+	mSamples.resize(mNumFrames * mNumSensors);
+	for (size_t i = 0; i < mSamples.size(); i++) {
+		Point3& p = mSamples[i];
+		int buttonState;
+		file >> p.time >> comma >> p.x >> comma >> p.y >> comma >> p.z >> comma >> p.r.x >> comma >> p.r.y >> comma >> p.r.z >> comma >> p.quality >> comma >> buttonState >> comma;
+		if (!file) {
+			throw ex_acq("Replay session file is shorter than its header says.", __func__, __FILE__);
+		}
+		p.buttonState = static_cast<button_state>(buttonState);
+		p.button = 0;
+	}
+}
+
+void ReplayDevice::SetReferenceSensor(int id)
+{
+
+}
+
+void ReplayDevice::SetSensorOffset(int id, Point3 offset)
+{
+
+}
+
+const int ReplayDevice::NumAttachedBoards() const
+{
+	return 1;
+}
+
+const int ReplayDevice::NumAttachedTransmitters() const
+{
+	return 1;
+}
+
+std::vector<int> ReplayDevice::GetAttachedPorts() const
+{
+	std::vector<int> ports;
+	for (int i = 0; i < mNumSensors; i++) {
+		ports.push_back(i);
+	}
+	return ports;
+}
+
+std::vector<int> ReplayDevice::GetAttachedSerials() const
+{
+	return this->GetAttachedPorts();
+}
+
+Point3 ReplayDevice::GetRecord(int id)
+{
+	if (!mNumFrames) {
+		return Point3();
+	}
+	return mSamples[(mFrame % mNumFrames) * mNumSensors + id];
+}
+
+Point3Ref ReplayDevice::GetRefRecord(int id)
+{
+	return Point3Ref();
+}
+
+void ReplayDevice::GetFrame(std::vector<Point3>* records, Point3Ref* refRecord, int refId)
+{
+	records->resize(mNumSensors);
+	*refRecord = Point3Ref();
+
+	if (!mNumFrames) {
+		return;
+	}
+
+	// Copy the next frame and start over after the last one.
+	const Point3* frame = &mSamples[mFrame * mNumSensors];
+	std::copy(frame, frame + mNumSensors, records->begin());
+	mFrame = (mFrame + 1) % mNumFrames;
+}
@@ -0,0 +1,135 @@
+#include <thread>
+
+#include "SampleScheduler.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#include <timeapi.h>
+#pragma comment(lib, "winmm.lib")
+
+// Available from Windows 10 version 1803 on, older SDKs do not define it.
+#ifndef CREATE_WAITABLE_TIMER_HIGH_RESOLUTION
+#define CREATE_WAITABLE_TIMER_HIGH_RESOLUTION 0x00000002
+#endif
+#endif
+
+using namespace SmartScan;
+
+SampleScheduler::SampleScheduler()
+{
+
+}
+
+void SampleScheduler::Start(double measurementRate)
+{
+#ifdef _WIN32
+	// The default Windows timer resolution is 15.6 ms, which is longer than a sample period. A high resolution waitable timer wakes up well within a
+	// millisecond without changing the resolution of the whole system. Without one, request 1 ms for as long as the scheduler runs.
+	if (!mTimer) {
+		mTimer = CreateWaitableTimerExW(NULL, NULL, CREATE_WAITABLE_TIMER_HIGH_RESOLUTION, TIMER_ALL_ACCESS);
+	}
+	if (!mTimer && !mTimerRequested) {
+		mTimerRequested = timeBeginPeriod(1) == TIMERR_NOERROR;
+	}
+#endif
+
+	mPeriod = 1 / measurementRate;
+	mSampleIndex = 0;
+	mStart = clock::now();
+
+	mNumSamples = 0;
+	mMissedDeadlines = 0;
+	mLastLateness = 0;
+	mMaxLateness = 0;
+	mSumLateness = 0;
+}
+
+void SampleScheduler::Stop()
+{
+#ifdef _WIN32
+	if (mTimer) {
+		CloseHandle(mTimer);
+		mTimer = nullptr;
+	}
+	if (mTimerRequested) {
+		timeEndPeriod(1);
+		mTimerRequested = false;
+	}
+#endif
+}
+
+uint64_t SampleScheduler::WaitForNextSample()
+{
+	mSampleIndex++;
+	clock::time_point deadline = this->Deadline(mSampleIndex);
+	clock::time_point now = clock::now();
+
+	// Skip the deadlines that have already passed by more than a period, so the loop does not try to catch up with a burst of samples.
+	if (now >= this->Deadline(mSampleIndex + 1)) {
+		std::chrono::duration<double> behind = now - mStart;
+		uint64_t current = (uint64_t)(behind.count() / mPeriod);
+		mMissedDeadlines += current - mSampleIndex;
+		mSampleIndex = current;
+		deadline = this->Deadline(mSampleIndex);
+	}
+
+	// Sleep until shortly before the deadline and spin for the remaining time, the sleep alone is not accurate enough.
+	if (deadline - now > spinTime) {
+		this->SleepUntil(deadline - spinTime);
+	}
+	while ((now = clock::now()) < deadline) {
+		// Spin.
+	}
+
+	// Keep track of how far the wake up was from the deadline.
+	std::chrono::duration<double> lateness = now - deadline;
+	mLastLateness = lateness.count();
+	mSumLateness = mSumLateness + lateness.count();
+	if (lateness.count() > mMaxLateness) {
+		mMaxLateness = lateness.count();
+	}
+	mNumSamples++;
+
+	return mSampleIndex;
+}
+
+const double SampleScheduler::SampleTime() const
+{
+	return mSampleIndex * mPeriod;
+}
+
+const SamplingStats SampleScheduler::GetStats() const
+{
+	SamplingStats stats;
+	stats.numSamples = mNumSamples;
+	stats.missedDeadlines = mMissedDeadlines;
+	stats.lastLateness = mLastLateness;
+	stats.maxLateness = mMaxLateness;
+	stats.meanLateness = stats.numSamples ? mSumLateness / stats.numSamples : 0;
+	return stats;
+}
+
+void SampleScheduler::SleepUntil(clock::time_point wakeUp)
+{
+#ifdef _WIN32
+	if (mTimer) {
+		// A negative due time is relative, in steps of 100 ns.
+		LARGE_INTEGER dueTime;
+		dueTime.QuadPart = -std::chrono::duration_cast<std::chrono::duration<long long, std::ratio<1, 10000000>>>(wakeUp - clock::now()).count();
+		if (dueTime.QuadPart >= 0) {
+			return;
+		}
+		if (SetWaitableTimerEx(mTimer, &dueTime, 0, NULL, NULL, NULL, 0)) {
+			WaitForSingleObject(mTimer, INFINITE);
+			return;
+		}
+	}
+#endif
+	std::this_thread::sleep_until(wakeUp);
+}
+
+SampleScheduler::clock::time_point SampleScheduler::Deadline(uint64_t index) const
+{
+	// Compute every deadline from the start instead of adding periods, so rounding errors do not accumulate.
+	return mStart + std::chrono::duration_cast<clock::duration>(std::chrono::duration<double>(index * mPeriod));
+}
@@ -1,29 +1,34 @@
 #include <ctime>
 #include <cstdio>
 #include <float.h>
+#include <climits>
+#include <algorithm>
 
 #include "Scan.h"
+#include "FilterEngine.h"
 #include "Exceptions.h"
 
 using namespace SmartScan;
 
-Scan::Scan(const int id, ScanConfig config)
-	: mId { id }, mConfig { config }
+Scan::Scan(const int id, ScanConfig config, FilterEngine* engine)
+	: mId { id }, mConfig { config }, mAngleBins { config.filteringPrecision }, mEqualAreaBins { config.filteringPrecision }, mEngine { engine }
 {
-	// Resize the sorted buffer to be a 3d vector with the indices being [numRefpoints][thetaRange][phiRange]
-	mSortedBuff.resize(this->NumRefPoints());
-	for (int i = 0; i < mSortedBuff.size(); i++) {
-		mSortedBuff[i].resize(360/mConfig.filteringPrecision);			// Theta has a default range of 0-360 degrees.
-		for (int k = 0; k < mSortedBuff[i].size(); k++) {
-			mSortedBuff[i][k].resize(180/mConfig.filteringPrecision);	// Phi has a default range of 0-180 degrees.
-		}
-	}
+	this->InitCells(&mSortedBuff, true);
+	mFilledCells.reset(new std::atomic<int>[std::max(this->NumRefPoints(), 1)]);
+	this->ResetCoverage();
+
+	// Index the reference points once, every sample is matched against them.
+	mRefIndex.Build(mConfig.refPoints);
 }
 
 Scan::~Scan()
 {
-	// Clear the sorted buffer.
-	mSortedBuff.clear();
+	// Stop the filtering thread, wake it if it is waiting for a frame and wait for it to finish.
+	mRunning = false;
+	mConfig.inBuff->WakeAll();
+	if (pScanningThread && pScanningThread->joinable()) {
+		pScanningThread->join();
+	}
 }
 
 void Scan::Run()
@@ -33,18 +38,41 @@ void Scan::Run()
 		return;
 	}
 
+	// A scan that converged may be started again, it gets a whole coverage window before it can stop again.
+	mConverged = false;
+	if (mCoverageStart >= 0) {
+		mCoverageStart = mLastFilteredSample;
+	}
+
+	// Scans of a filter engine are filtered by the thread of the engine.
+	if (mEngine) {
+		mRunning = true;
+		try {
+			mEngine->Start(this);
+		}
+		catch (...) {
+			mRunning = false;
+			throw ex_scan("Unnable to start thread.", __func__, __FILE__);
+		}
+		return;
+	}
+
+	// A stopped thread may still be filtering the last frames, let it finish first.
+	if (pScanningThread && pScanningThread->joinable()) {
+		pScanningThread->join();
+	}
+
+	// Set the running flag before the thread starts, otherwise the filtering loop may see it still cleared and exit right away.
+	mRunning = true;
+
 	// Create the Scanning thread.
 	try	{
 		this->pScanningThread = std::make_unique<std::thread>(&Scan::DataFiltering, this);
 	}
 	catch (...)	{
+		mRunning = false;
 		throw ex_scan("Unnable to start thread.", __func__, __FILE__);
 	}
-
-	// Let it gooooo, let it gooo
-	this->pScanningThread->detach();
-
-	mRunning = true;
 }
 
 void Scan::Stop(bool clearData)
@@ -52,20 +80,122 @@ void Scan::Stop(bool clearData)
 	// Wait a bit for the other threads to finish.
 	std::this_thread::sleep_for(std::chrono::milliseconds(500));
 
+	// Wake the filtering thread if it is waiting for a frame, so it sees the flag.
+	mRunning = false;
+	if (mEngine) {
+		mEngine->Wake();
+	}
+	else {
+		mConfig.inBuff->WakeAll();
+	}
+
     if (clearData) {
+		// Wait until the filtering thread has caught up and left the cells alone, so clearing them is the only write.
+		if (mEngine) {
+			mEngine->WaitForScan(this);
+		}
+		else if (pScanningThread && pScanningThread->joinable()) {
+			pScanningThread->join();
+		}
+
+		this->BeginWrite();
 		mLastFilteredSample = 0;
+		mDroppedFrames = 0;
 
-		// Replace every Point3 in the sorted buffer with an empty one.
-		for (int i = 0; i < mSortedBuff.size(); i++) {
-			for (int k = 0; k < mSortedBuff[i].size(); k++) {
-				for (int j = 0; j < mSortedBuff[i][k].size(); j++) {
-					mSortedBuff[i][k][j] = Point3();
-				}
+		// Mark every cell in the sorted buffer empty.
+		mSortedBuff.Clear();
+		this->ResetCoverage();
+		this->EndWrite();
+	}
+}
+
+void Scan::Refilter(ThreadPool* pool)
+{
+	if (this->IsRunning() || (mEngine && mEngine->IsFiltering(this))) {
+		throw ex_scan("Cannot refilter a running scan.", __func__, __FILE__);
+	}
+
+	// A stopped thread may still be filtering the last frames, let it finish first.
+	if (pScanningThread && pScanningThread->joinable()) {
+		pScanningThread->join();
+	}
+
+	// Filter the same frames as the scan does when running: every recorded frame, up to the stopAtSample.
+	const int numSensors = mConfig.rawBuff->NumSensors();
+	int numFrames = (int)std::min(mConfig.rawBuff->NumFrames(), (size_t)INT_MAX);
+	if (mConfig.stopAtSample >= 0) {
+		numFrames = std::min(numFrames, mConfig.stopAtSample);
+	}
+
+	// Every thread filters one contiguous range of frames. The first range goes straight into the cells of the scan, the others into cells of their own.
+	// These are merged into the cells of the scan in the order of their ranges, so every cell ends up with the earliest sample of the smallest radius.
+	// Whether a scan converges depends on the order of the frames, scans that can stop on their coverage are filtered in order.
+	const bool autoStop = mConfig.stopBelowFillRate > 0;
+	const int numParts = autoStop ? 1 : std::max(std::min(pool ? pool->NumThreads() : 1, numFrames), 1);
+	std::vector<CellGrid> partCells(numParts - 1);
+	this->BeginWrite();
+	mSortedBuff.Clear();
+	this->ResetCoverage();
+
+	auto filterPart = [&](int part) {
+		CellGrid* cells = &mSortedBuff;
+		if (part > 0) {
+			cells = &partCells[part - 1];
+			this->InitCells(cells, false);
+		}
+
+		std::vector<Point3> frame(numSensors);
+		std::vector<SharedSample> samples(numSensors);
+		for (int f = (int)((int64_t)numFrames * part / numParts); f < (int)((int64_t)numFrames * (part + 1) / numParts); f++) {
+			for (int i = 0; i < numSensors; i++) {
+				frame[i] = mConfig.rawBuff->At(i, f);
+				PrepareSample(mRefIndex, mConfig.refPoints, this->DirectionThreshold(), &frame[i], &samples[i]);
+			}
+			if (numParts > 1) {
+				this->FillCells(f, numSensors, frame.data(), samples.data(), cells);
+				continue;
+			}
+
+			// A single range is filtered in order, with the coverage counted just like when the scan is running.
+			this->UpdateCoverage(f, this->FillCells(f, numSensors, frame.data(), samples.data(), cells, mFilledCells.get()));
+			if (mConverged) {
+				numFrames = f + 1;
+				break;
+			}
+		}
+	};
+
+	// Every thread merges one slice of the cells.
+	auto mergePart = [&](int part) {
+		size_t begin = mSortedBuff.Size() * part / numParts, end = mSortedBuff.Size() * (part + 1) / numParts;
+		for (const CellGrid& cells : partCells) {
+			mSortedBuff.Merge(cells, begin, end);
+		}
+	};
+
+	if (numParts > 1) {
+		pool->ParallelFor(numParts, filterPart);
+		pool->ParallelFor(numParts, mergePart);
+
+		// Count the filled cells of the merged cells.
+		const size_t cellsPerRef = mSortedBuff.CellsPerRef();
+		uint64_t filled = 0;
+		for (size_t c = 0; c < mSortedBuff.Size(); c++) {
+			if (mSortedBuff.At(c).sample != CellGrid::emptySample) {
+				mFilledCells[c / cellsPerRef]++;
+				filled++;
 			}
 		}
+		mImprovements = filled;
+	}
+	else {
+		filterPart(0);
 	}
 
-	mRunning = false;
+	// The scan continues after the refiltered frames when it is started again.
+	mLastFilteredSample = numFrames;
+	mDroppedFrames = 0;
+	this->EndWrite();
 }
 
 const bool Scan::IsRunning() const {
@@ -74,21 +204,108 @@ const bool Scan::IsRunning() const {
 
 void Scan::CopyOutputBuffer(std::vector<Point3>* buffer) const
 {
-	// Loop through the sorted buffer and copy only the points that are non-empty.
-	for (int i = 0; i < mSortedBuff.size(); i++) {
-		for (int k = 0; k < mSortedBuff[i].size(); k++) {
-			for (int j = 0; j < mSortedBuff[i][k].size(); j++) {
-				if (mSortedBuff[i][k][j].s.r != DBL_MAX) {
-					buffer->push_back(mSortedBuff[i][k][j]);
-				}
+	this->CopySnapshot(buffer);
+}
+
+const int Scan::CopySnapshot(std::vector<Point3>* buffer, bool* consistent) const
+{
+	// Only the cells are copied while the filter may write, looking up their samples takes much longer and is done afterwards.
+	std::vector<Cell> cells;
+	int frames = this->SnapshotCells(&cells, consistent);
+
+	// Sweep through the cells and copy the samples of the non-empty ones out of the raw store.
+	Point3 point;
+	for (size_t c = 0; c < cells.size(); c++) {
+		if (this->CellSample(c, cells[c], &point)) {
+			buffer->push_back(point);
+		}
+	}
+	return frames;
+}
+
+const int Scan::CopyCoarse(int level, std::vector<Point3>* buffer) const
+{
+	if (mConfig.gridType != grid_type::EQUAL_AREA) {
+		throw ex_scan("Coarse copies need an equal-area grid.", __func__, __FILE__);
+	}
+	if (level < 0 || level > EqualAreaBins::maxLevel) {
+		throw ex_scan("Level of the coarse copy is out of range.", __func__, __FILE__);
+	}
+
+	std::vector<Cell> cells;
+	int frames = this->SnapshotCells(&cells, nullptr);
+
+	// Every parent holds the same number of consecutive cells, and the cells of a reference point are a whole number of parents.
+	const size_t children = (size_t)1 << (2 * level);
+	Point3 point;
+	for (size_t parent = 0; parent < cells.size(); parent += children) {
+		size_t best = parent;
+		for (size_t c = parent + 1; c < parent + children; c++) {
+			if (cells[c].r < cells[best].r) {
+				best = c;
 			}
 		}
+		if (this->CellSample(best, cells[best], &point)) {
+			buffer->push_back(point);
+		}
+	}
+	return frames;
+}
+
+const uint32_t Scan::CopyChanges(uint32_t since, std::vector<Point3>* buffer, std::vector<size_t>* cells, bool* reset) const
+{
+	// Close the version first, cells that change while copying are reported by the next call.
+	uint32_t next = mSortedBuff.NextVersion();
+
+	// After a clear the caller has to start over, with all cells filled since the clear.
+	bool cleared = since != 0 && mSortedBuff.ClearedSince(since);
+	if (reset) {
+		*reset = cleared;
+	}
+
+	std::vector<size_t> changed;
+	mSortedBuff.ChangedSince(cleared ? 0 : since, &changed);
+
+	Point3 point;
+	for (size_t c : changed) {
+		if (this->CellSample(c, mSortedBuff.At(c), &point)) {
+			buffer->push_back(point);
+			if (cells) {
+				cells->push_back(c);
+			}
+		}
+	}
+	return next;
+}
+
+const ScanCoverage Scan::GetCoverage() const
+{
+	ScanCoverage coverage;
+	for (int r = 0; r < this->NumRefPoints(); r++) {
+		coverage.filledCells.push_back(mFilledCells[r].load(std::memory_order_relaxed));
 	}
+	coverage.cellsPerRef = mSortedBuff.CellsPerRef();
+	coverage.improvements = mImprovements.load(std::memory_order_relaxed);
+	coverage.fillRate = mFillRate.load(std::memory_order_relaxed);
+	coverage.improvementRate = mImprovementRate.load(std::memory_order_relaxed);
+	coverage.filteredFrames = mPublishedFrames.load(std::memory_order_relaxed);
+	coverage.converged = mConverged;
+	return coverage;
+}
+
+const size_t Scan::NumCells() const
+{
+	return mSortedBuff.Size();
+}
+
+const size_t Scan::MemoryUsage() const
+{
+	return mSortedBuff.MemoryUsage();
 }
 
 const int Scan::NumUsedSensors() const
 {
-	return mConfig.inBuff->size();
+	return mConfig.inBuff->NumSensors();
 }
 
 const int Scan::NumRefPoints() const
@@ -96,6 +313,11 @@ const int Scan::NumRefPoints() const
 	return mConfig.refPoints.size();
 }
 
+const std::vector<Point3>& Scan::GetRefPoints() const
+{
+	return mConfig.refPoints;
+}
+
 const int Scan::GetFilteringPrecision() const
 {
 	return mConfig.filteringPrecision;
@@ -111,62 +333,223 @@ const double Scan::GetOutlierThreshold() const
 	return mConfig.outlierThreshold;
 }
 
+const int Scan::NumDroppedFrames() const
+{
+	return mDroppedFrames;
+}
+
 void Scan::DataFiltering()
 {
-	// Run while not last filtered sample is at stopAtSample or if the thread is lacking behind data acquisition.
-	// -1 is there since the maximum buffer index is equal to buffer size -1.
-	while (mLastFilteredSample != mConfig.stopAtSample && (mRunning || mLastFilteredSample != mConfig.inBuff->back().size() - 1)) {
-		int nearestRef, nearestTheta, nearestPhi;
-
-		// Look at the last sensor of the input buffer since if this is higher, then all the other sensors before it also have a sample.
-		// +1 is here for the same reason as explained above, just the opposite way.
-		if (mConfig.inBuff->back().size() > mLastFilteredSample + 1) {
-			// Loop through all the sensors.
-			for (int i = 0; i < mConfig.inBuff->size(); i++) {
-				Point3 point = mConfig.inBuff->at(i).at(mLastFilteredSample);	// Temporarily store the sample of a single sensor at the current index.
-				nearestRef = this->CalcNearestRef(&point);	// Calculate radius and find nearest reference point.
-
-				if (point.s.r < mConfig.outlierThreshold) {	// Do not store the point if radius is too large.
-					CalcAngle(mConfig.refPoints.at(nearestRef), &point); // Calculate theta and phi.
-
-					// Calculate the indexes for the sorted buffer.
-					nearestTheta = (int)(point.s.theta/mConfig.filteringPrecision);
-					nearestPhi = (int)(point.s.phi/mConfig.filteringPrecision);
-					
-					// Do not store point if the radius is larger than the one already stored.
-					if (point.s.r < mSortedBuff[nearestRef][nearestTheta][nearestPhi].s.r) {
-						mSortedBuff[nearestRef][nearestTheta][nearestPhi] = point;
-					}
-				}
+	std::vector<Point3> frame(mConfig.inBuff->NumSensors());	// Local copy of the frame that is being filtered.
+	std::vector<SharedSample> samples(frame.size());			// Nearest reference point and direction of every sample in the frame.
+
+	// Run while the stopAtSample is not reached, the scan has not converged and it is either running or lagging behind data acquisition.
+	while ((mConfig.stopAtSample < 0 || mLastFilteredSample < mConfig.stopAtSample) && !mConverged && (mRunning || (uint64_t)mLastFilteredSample < mConfig.inBuff->Committed())) {
+		// Block until data acquisition has committed the next frame or the scan is stopped.
+		if ((uint64_t)mLastFilteredSample >= mConfig.inBuff->Committed()) {
+			mConfig.inBuff->WaitForFrame(mLastFilteredSample, mRunning);
+			continue;
+		}
+
+		// Copy the frame out of the ring. This fails when the scan fell so far behind that the frame has already been overwritten.
+		if (!mConfig.inBuff->ReadFrame(mLastFilteredSample, frame.data())) {
+			// Skip to the oldest frame that is still available.
+			int oldest = mConfig.inBuff->Oldest();
+			if (oldest > mLastFilteredSample) {
+				mDroppedFrames += oldest - mLastFilteredSample;
+				mLastFilteredSample = oldest;
 			}
-			mLastFilteredSample++;
+			continue;
 		}
+
+		// Calculate radius and find nearest reference point, and the direction of the samples that are not too far away.
+		for (size_t i = 0; i < frame.size(); i++) {
+			PrepareSample(mRefIndex, mConfig.refPoints, this->DirectionThreshold(), &frame[i], &samples[i]);
+		}
+		this->StoreFrame(frame.data(), samples.data());
 	}
 
 	mRunning = false;
 }
 
-int Scan::CalcNearestRef(Point3* point)
+void Scan::StoreFrame(const Point3* frame, const SharedSample* samples)
+{
+	this->BeginWrite();
+	this->UpdateCoverage(mLastFilteredSample, this->FillCells(mLastFilteredSample, mConfig.inBuff->NumSensors(), frame, samples, &mSortedBuff, mFilledCells.get()));
+	mLastFilteredSample++;
+	this->EndWrite();
+}
+
+float Scan::DirectionThreshold() const
+{
+	return mConfig.gridType == grid_type::THETA_PHI ? mConfig.outlierThreshold : 0;
+}
+
+void Scan::InitCells(CellGrid* cells, bool trackChanges) const
 {
-	int index = 0;
-	float radius = DBL_MAX, temp = 0; // Set radius to be an irrealistic value.
+	if (mConfig.gridType == grid_type::EQUAL_AREA) {
+		// Equal-area cells have no theta and phi bins, the cells of every reference point are a single row.
+		cells->Init(this->NumRefPoints(), 1, mEqualAreaBins.NumCells(), trackChanges, mConfig.cellMemoryBudget);
+	}
+	else {
+		// Create one cell for every combination of reference point, theta and phi.
+		// Theta has a range of 0-360 degrees and phi a range of 0-180 degrees. Cells beyond the memory budget are only allocated when they are filled.
+		cells->Init(this->NumRefPoints(), 360/mConfig.filteringPrecision, 180/mConfig.filteringPrecision, trackChanges, mConfig.cellMemoryBudget);
+	}
+}
 
-	// Loop through all the reference points.
-	for (int i = 0; i < mConfig.refPoints.size(); i++) {
-		// Calulate radius and if it is smaller than the previous calculated one.
-		temp = sqrt(pow(point->x - mConfig.refPoints[i].x, 2) + pow(point->y - mConfig.refPoints[i].y, 2) + pow(point->z - mConfig.refPoints[i].z, 2));
-		if (temp < radius) {
-			radius = temp;
-			index = i;
+int Scan::SnapshotCells(std::vector<Cell>* cells, bool* consistent) const
+{
+	// Copy the cells, and check that the filter did not write them in the meantime.
+	int frames = 0;
+	bool same = false;
+	for (int attempt = 0; ; attempt++) {
+		uint64_t sequence = mSequence.load(std::memory_order_acquire);
+		frames = mPublishedFrames.load(std::memory_order_relaxed);
+		mSortedBuff.CopyCells(cells);
+		std::atomic_thread_fence(std::memory_order_acquire);
+		same = !(sequence & 1) && sequence == mSequence.load(std::memory_order_relaxed);
+		if (same || attempt + 1 >= maxSnapshotAttempts) {
+			break;
 		}
+		std::this_thread::yield();
+	}
+	if (consistent) {
+		*consistent = same;
 	}
+	return frames;
+}
 
-	point->s.r = radius;
-	return index;
+void Scan::BeginWrite()
+{
+	// The fence keeps the writes to the cells after the odd sequence number.
+	mSequence.fetch_add(1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
 }
 
-void Scan::CalcAngle(Point3 refPoint, Point3* point)
+void Scan::EndWrite()
+{
+	mPublishedFrames.store(mLastFilteredSample, std::memory_order_relaxed);
+	mSequence.fetch_add(1, std::memory_order_release);
+}
+
+Scan::FrameCoverage Scan::FillCells(int index, int numSensors, const Point3* frame, const SharedSample* samples, CellGrid* cells, std::atomic<int>* filledCells) const
+{
+	// Cells refer to samples in the raw store, frames that did not fit in it or in a 32-bit sample index can not be stored.
+	FrameCoverage coverage { 0, 0 };
+	uint64_t sampleBase = (uint64_t)index * numSensors;
+	if ((size_t)index >= mConfig.rawBuff->NumFrames() || sampleBase + numSensors > CellGrid::emptySample) {
+		return coverage;
+	}
+
+	// Loop through all the sensors.
+	for (int i = 0; i < numSensors; i++) {
+		if (frame[i].s.r < mConfig.outlierThreshold) {	// Do not store the point if radius is too large.
+			cell_update update;
+			if (mConfig.gridType == grid_type::EQUAL_AREA) {
+				size_t cell = (size_t)samples[i].ref * cells->CellsPerRef() + mEqualAreaBins.Bin(mConfig.refPoints[samples[i].ref], frame[i]);
+				update = cells->Update(cell, (float)frame[i].s.r, (uint32_t)(sampleBase + i));
+			}
+			else {
+				// Calculate the indexes for the sorted buffer, the same bins as truncating the angles of CalcAngle().
+				int nearestTheta, nearestPhi;
+				mAngleBins.Bin(samples[i].direction, mConfig.refPoints[samples[i].ref], frame[i], &nearestTheta, &nearestPhi);
+
+				// Do not store point if the radius is larger than the one already stored.
+				update = cells->Update(samples[i].ref, nearestTheta, nearestPhi, (float)frame[i].s.r, (uint32_t)(sampleBase + i));
+			}
+
+			// Count the stored samples, and the filled cells per reference point.
+			if (update != cell_update::UNCHANGED) {
+				coverage.improved++;
+			}
+			if (update == cell_update::FILLED) {
+				coverage.filled++;
+				if (filledCells) {
+					filledCells[samples[i].ref].store(filledCells[samples[i].ref].load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+				}
+			}
+		}
+	}
+	return coverage;
+}
+
+void Scan::UpdateCoverage(int index, const FrameCoverage& coverage)
+{
+	mImprovements.store(mImprovements.load(std::memory_order_relaxed) + coverage.improved, std::memory_order_relaxed);
+
+	// Exponential moving averages over the frames, with the coverage window as time constant.
+	const double measurementRate = mConfig.rawBuff->MeasurementRate();
+	const double weight = 1 / std::max(mConfig.coverageWindow * measurementRate, 1.0);
+	double fillRate = mFillRate.load(std::memory_order_relaxed);
+	fillRate += weight * (coverage.filled * measurementRate - fillRate);
+	mFillRate.store(fillRate, std::memory_order_relaxed);
+	double improvementRate = mImprovementRate.load(std::memory_order_relaxed);
+	improvementRate += weight * (coverage.improved * measurementRate - improvementRate);
+	mImprovementRate.store(improvementRate, std::memory_order_relaxed);
+
+	// The averages need a coverage window after the first filled cell to settle, the scan does not stop before that.
+	if (coverage.filled && mCoverageStart < 0) {
+		mCoverageStart = index;
+	}
+	if (mConfig.stopBelowFillRate > 0 && mCoverageStart >= 0 && index - mCoverageStart >= mConfig.coverageWindow * measurementRate && fillRate < mConfig.stopBelowFillRate) {
+		mConverged = true;
+	}
+}
+
+void Scan::ResetCoverage()
+{
+	for (int r = 0; r < this->NumRefPoints(); r++) {
+		mFilledCells[r] = 0;
+	}
+	mImprovements = 0;
+	mFillRate = 0;
+	mImprovementRate = 0;
+	mCoverageStart = -1;
+	mConverged = false;
+}
+
+void Scan::PrepareSample(const RefIndex& refIndex, const std::vector<Point3>& refPoints, float outlierThreshold, Point3* point, SharedSample* sample)
+{
+	sample->ref = CalcNearestRef(refIndex, point);
+	if (point->s.r < outlierThreshold) {
+		sample->direction = AngleBins::Estimate(refPoints[sample->ref], *point);
+	}
+}
+
+int Scan::CalcNearestRef(const RefIndex& refIndex, Point3* point)
+{
+	// Compare squared distances and only take the square root of the nearest one.
+	double squaredRadius;
+	int index = refIndex.Nearest(point->x, point->y, point->z, &squaredRadius);
+
+	// The radius keeps float precision, like the radius stored in the cells.
+	point->s.r = (float)sqrt(squaredRadius);
+	return index < 0 ? 0 : index;
+}
+
+void Scan::CalcAngle(Point3 refPoint, Point3* point) const
 {
 	point->s.theta = (atan2(point->y - refPoint.y, point->x - refPoint.x) * toAngle) + 180;
-	point->s.phi = acos((point->z - refPoint.z)/point->s.r) * toAngle;
+	point->s.phi = acos(AngleBins::ClampCosine((point->z - refPoint.z)/point->s.r)) * toAngle;
+}
+
+bool Scan::CellSample(size_t index, const Cell& cell, Point3* point) const
+{
+	if (cell.sample == CellGrid::emptySample) {
+		return false;
+	}
+
+	// Skip samples of raw data that has been cleared in the meantime.
+	const int numSensors = mConfig.rawBuff->NumSensors();
+	size_t frame = cell.sample / numSensors;
+	if (frame >= mConfig.rawBuff->NumFrames()) {
+		return false;
+	}
+
+	// Restore the radius, theta and phi that were calculated while filtering.
+	*point = mConfig.rawBuff->At(cell.sample % numSensors, frame);
+	point->s.r = cell.r;
+	this->CalcAngle(mConfig.refPoints[index / mSortedBuff.CellsPerRef()], point);
+	return true;
 }
\ No newline at end of file
@@ -0,0 +1,367 @@
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <algorithm>
+
+#include "SessionArchive.h"
+#include "ColumnCodec.h"
+#include "MappedFile.h"
+
+using namespace SmartScan;
+
+namespace
+{
+	const char magic[8] = { 'S', 'S', 'E', 'S', 'S', 'I', 'O', 'N' };	// First bytes of every archive.
+	const uint32_t version = 1;										// Version of the layout of the archive.
+
+	const double timeScale = 1e6;									// Number of steps per second of the time stamps.
+	const double positionScale = 1e3;								// Number of steps per mm of the positions.
+	const double angleScale = 1e3;									// Number of steps per degree of the angles.
+	const double maxSteps = 0x1p62;									// Largest number of steps of a value, far beyond any real sample.
+
+	// Enum containing the columns of a sensor, in the order in which they are stored.
+	enum column
+	{
+		TIME, X, Y, Z, ROLL, ELEVATION, AZIMUTH, QUALITY, BUTTON, BUTTON_STATE,
+	};
+
+	// Returns the field of a sample that is stored in a column.
+	inline double GetField(const Point3& p, int c)
+	{
+		switch (c) {
+			case TIME: return p.time;
+			case X: return p.x;
+			case Y: return p.y;
+			case Z: return p.z;
+			case ROLL: return p.r.x;
+			case ELEVATION: return p.r.y;
+			case AZIMUTH: return p.r.z;
+			case QUALITY: return p.quality;
+			case BUTTON: return p.button;
+			default: return (double)p.buttonState;
+		}
+	}
+
+	// Set the field of a sample that is stored in a column.
+	inline void SetField(Point3* p, int c, double value)
+	{
+		switch (c) {
+			case TIME: p->time = value; break;
+			case X: p->x = value; break;
+			case Y: p->y = value; break;
+			case Z: p->z = value; break;
+			case ROLL: p->r.x = value; break;
+			case ELEVATION: p->r.y = value; break;
+			case AZIMUTH: p->r.z = value; break;
+			case QUALITY: p->quality = (unsigned short)value; break;
+			case BUTTON: p->button = (unsigned short)value; break;
+			default: p->buttonState = static_cast<button_state>((int)value); break;
+		}
+	}
+
+	// Reads the little-endian numbers of an archive one after the other, and throws when the file ends too early.
+	class ArchiveReader
+	{
+	public:
+		ArchiveReader(const uint8_t* data, size_t size) : mData { data }, mEnd { data + size }
+		{
+
+		}
+
+		// Returns a pointer to the next bytes and skips them.
+		const uint8_t* GetBytes(size_t size)
+		{
+			if ((size_t)(mEnd - mData) < size) {
+				throw ex_export("Session archive is damaged.", __func__, __FILE__);
+			}
+			const uint8_t* bytes = mData;
+			mData += size;
+			return bytes;
+		}
+
+		uint16_t GetUint16()
+		{
+			const uint8_t* b = this->GetBytes(2);
+			return (uint16_t)(b[0] | (b[1] << 8));
+		}
+
+		uint32_t GetUint32()
+		{
+			const uint8_t* b = this->GetBytes(4);
+			return (uint32_t)b[0] | ((uint32_t)b[1] << 8) | ((uint32_t)b[2] << 16) | ((uint32_t)b[3] << 24);
+		}
+
+		uint64_t GetUint64()
+		{
+			uint64_t low = this->GetUint32();
+			return low | ((uint64_t)this->GetUint32() << 32);
+		}
+
+		double GetDouble()
+		{
+			uint64_t bits = this->GetUint64();
+			double value;
+			memcpy(&value, &bits, sizeof(value));
+			return value;
+		}
+
+		// Returns the number of bytes that have not been read.
+		size_t Remaining() const
+		{
+			return mEnd - mData;
+		}
+	private:
+		const uint8_t* mData;										// Next byte that is read.
+		const uint8_t* mEnd;										// End of the archive.
+	};
+}
+
+SessionArchive::SessionArchive()
+{
+
+}
+
+void SessionArchive::Save(const RawStore* data, const SessionInfo& info, const std::string filename, size_t numFrames)
+{
+	// Only save the frames that are published right now, acquisition may still be appending.
+	numFrames = std::min(numFrames, data->NumFrames());
+	const int numSensors = data->NumSensors();
+	if (!numFrames || !numSensors) {
+		throw ex_export("Raw buffer is empty.", __func__, __FILE__);
+	}
+	if (!info.serials.empty() && (int)info.serials.size() != numSensors) {
+		throw ex_export("Session needs a serial number for every sensor.", __func__, __FILE__);
+	}
+
+	mFile.Open(filename);
+	mFile.Write(magic, sizeof(magic));
+	mFile.PutUint32(version);
+
+	// The layout of the samples and the steps to which they are rounded.
+	mFile.PutUint32(numSensors);
+	mFile.PutUint64(numFrames);
+	mFile.PutUint32(framesPerBlock);
+	mFile.PutDouble(data->MeasurementRate());
+	mFile.PutDouble(timeScale);
+	mFile.PutDouble(positionScale);
+	mFile.PutDouble(angleScale);
+
+	// The acquisition configuration.
+	const DataAcqConfig& config = info.config;
+	mFile.PutUint16((uint16_t)config.transmitterID);
+	mFile.PutDouble(config.measurementRate);
+	mFile.PutDouble(config.powerLineFrequency);
+	mFile.PutDouble(config.maximumRange);
+	mFile.PutUint32((uint32_t)config.refSensorSerial);
+	for (double rotation : config.frameRotations) {
+		mFile.PutDouble(rotation);
+	}
+	const SyntheticConfig& synthetic = config.synthetic;
+	mFile.PutUint32((uint32_t)synthetic.numSensors);
+	mFile.PutDouble(synthetic.noise);
+	mFile.PutUint16(synthetic.quality);
+	mFile.PutDouble(synthetic.strokeFrequency);
+	mFile.PutDouble(synthetic.footLength);
+	mFile.PutDouble(synthetic.footWidth);
+	mFile.PutDouble(synthetic.footHeight);
+	mFile.PutUint16(synthetic.moveReference ? 1 : 0);
+	mFile.PutUint32(synthetic.seed);
+
+	// The sensors and the reference points of the scans.
+	for (int j = 0; j < numSensors; j++) {
+		mFile.PutUint32((uint32_t)(info.serials.empty() ? j : info.serials[j]));
+	}
+	mFile.PutUint32((uint32_t)info.refPoints.size());
+	for (const std::vector<Point3>& refPoints : info.refPoints) {
+		mFile.PutUint32((uint32_t)refPoints.size());
+		for (const Point3& p : refPoints) {
+			mFile.PutDouble(p.x);
+			mFile.PutDouble(p.y);
+			mFile.PutDouble(p.z);
+		}
+	}
+
+	// Every block starts with the sizes of its columns, sensor by sensor, followed by the columns themselves.
+	const double scales[numColumns] = { timeScale, positionScale, positionScale, positionScale, angleScale, angleScale, angleScale, 1, 1, 1 };
+	mValues.resize(numSensors * framesPerBlock);
+	mStreams.resize(numSensors * numColumns);
+	for (size_t first = 0; first < numFrames; first += framesPerBlock) {
+		const size_t count = std::min((size_t)framesPerBlock, numFrames - first);
+		std::atomic<bool> fits { true };
+		this->ForEachSensor(numSensors, [&](int j) {
+			int64_t* values = &mValues[j * framesPerBlock];
+			for (int c = 0; c < numColumns && fits; c++) {
+				for (size_t i = 0; i < count; i++) {
+					double steps = GetField(data->At(j, first + i), c) * scales[c];
+					if (!(std::abs(steps) < maxSteps)) {
+						fits = false;
+						return;
+					}
+					values[i] = std::llround(steps);
+				}
+				mStreams[j * numColumns + c].clear();
+				ColumnCodec::Encode(values, count, &mStreams[j * numColumns + c]);
+			}
+		});
+		if (!fits) {
+			mFile.Close();
+			throw ex_export("Sample is too large or not a number and cannot be archived.", __func__, __FILE__);
+		}
+
+		for (const std::vector<uint8_t>& stream : mStreams) {
+			mFile.PutUint32((uint32_t)stream.size());
+		}
+		for (const std::vector<uint8_t>& stream : mStreams) {
+			mFile.Write(stream.data(), stream.size());
+		}
+		if (pProgress) {
+			pProgress->store(first + count, std::memory_order_relaxed);
+		}
+	}
+	mFile.Close();
+}
+
+SessionInfo SessionArchive::Load(const std::string filename, RawStore* data)
+{
+	MappedFile file;
+	if (!file.Open(filename)) {
+		throw ex_export("Could not open the session archive.", __func__, __FILE__);
+	}
+	ArchiveReader in((const uint8_t*)file.Data(), file.Size());
+	if (in.Remaining() < sizeof(magic) || memcmp(in.GetBytes(sizeof(magic)), magic, sizeof(magic))) {
+		throw ex_export("File is not a session archive.", __func__, __FILE__);
+	}
+	if (in.GetUint32() != version) {
+		throw ex_export("Session archive has an unknown version.", __func__, __FILE__);
+	}
+
+	const uint32_t numSensors = in.GetUint32();
+	const uint64_t numFrames = in.GetUint64();
+	const uint32_t blockFrames = in.GetUint32();
+	const double measurementRate = in.GetDouble();
+	const double time = in.GetDouble(), position = in.GetDouble(), angle = in.GetDouble();
+	const double scales[numColumns] = { time, position, position, position, angle, angle, angle, 1, 1, 1 };
+	if (!numSensors || (uint64_t)numSensors * numColumns * 4 > in.Remaining() || !blockFrames || blockFrames > (1 << 20)
+		|| !(measurementRate > 0) || !(time > 0) || !(position > 0) || !(angle > 0)) {
+		throw ex_export("Session archive is damaged.", __func__, __FILE__);
+	}
+
+	SessionInfo info;
+	DataAcqConfig& config = info.config;
+	config.transmitterID = (short int)in.GetUint16();
+	config.measurementRate = in.GetDouble();
+	config.powerLineFrequency = in.GetDouble();
+	config.maximumRange = in.GetDouble();
+	config.refSensorSerial = (int)in.GetUint32();
+	for (double& rotation : config.frameRotations) {
+		rotation = in.GetDouble();
+	}
+	SyntheticConfig& synthetic = config.synthetic;
+	synthetic.numSensors = (int)in.GetUint32();
+	synthetic.noise = in.GetDouble();
+	synthetic.quality = in.GetUint16();
+	synthetic.strokeFrequency = in.GetDouble();
+	synthetic.footLength = in.GetDouble();
+	synthetic.footWidth = in.GetDouble();
+	synthetic.footHeight = in.GetDouble();
+	synthetic.moveReference = in.GetUint16() != 0;
+	synthetic.seed = in.GetUint32();
+
+	for (uint32_t j = 0; j < numSensors; j++) {
+		info.serials.push_back((int)in.GetUint32());
+	}
+	const uint32_t numScans = in.GetUint32();
+	for (uint32_t s = 0; s < numScans; s++) {
+		const uint32_t numRefPoints = in.GetUint32();
+		if (numRefPoints > in.Remaining() / 24) {
+			throw ex_export("Session archive is damaged.", __func__, __FILE__);
+		}
+		info.refPoints.emplace_back();
+		for (uint32_t r = 0; r < numRefPoints; r++) {
+			Point3 p;
+			p.x = in.GetDouble();
+			p.y = in.GetDouble();
+			p.z = in.GetDouble();
+			info.refPoints.back().push_back(p);
+		}
+	}
+
+	// Decode the columns of a block into the samples of every sensor, and append them to the store frame by frame.
+	data->Init(numSensors, measurementRate);
+	const size_t numStreams = numSensors * numColumns;
+	std::vector<const uint8_t*> streams(numStreams);
+	std::vector<uint32_t> sizes(numStreams);
+	std::vector<Point3> frame(numSensors);
+	mValues.resize(numSensors * blockFrames);
+	mSamples.resize(numSensors * blockFrames);
+	for (uint64_t first = 0; first < numFrames; first += blockFrames) {
+		const size_t count = (size_t)std::min<uint64_t>(blockFrames, numFrames - first);
+		for (size_t s = 0; s < numStreams; s++) {
+			sizes[s] = in.GetUint32();
+		}
+		for (size_t s = 0; s < numStreams; s++) {
+			streams[s] = in.GetBytes(sizes[s]);
+		}
+
+		this->ForEachSensor(numSensors, [&](int j) {
+			int64_t* values = &mValues[j * blockFrames];
+			Point3* samples = &mSamples[j * blockFrames];
+			for (int c = 0; c < numColumns; c++) {
+				if (!ColumnCodec::Decode(streams[j * numColumns + c], sizes[j * numColumns + c], values, count)) {
+					throw ex_export("Session archive is damaged.", __func__, __FILE__);
+				}
+				for (size_t i = 0; i < count; i++) {
+					SetField(&samples[i], c, values[i] / scales[c]);
+				}
+			}
+		});
+
+		for (size_t i = 0; i < count; i++) {
+			for (uint32_t j = 0; j < numSensors; j++) {
+				frame[j] = mSamples[j * blockFrames + i];
+			}
+			if (!data->AppendFrame(frame.data())) {
+				throw ex_export("Session is longer than a raw store can hold.", __func__, __FILE__);
+			}
+		}
+	}
+	if (in.Remaining()) {
+		throw ex_export("Session archive is damaged.", __func__, __FILE__);
+	}
+
+	return info;
+}
+
+void SessionArchive::SetThreadPool(ThreadPool* pool)
+{
+	pThreadPool = pool;
+}
+
+void SessionArchive::SetProgress(std::atomic<size_t>* progress)
+{
+	pProgress = progress;
+}
+
+const bool SessionArchive::IsArchive(const std::string filename)
+{
+	std::ifstream file(filename, std::ios::binary);
+	char start[sizeof(magic)];
+	return file.read(start, sizeof(start)) && !memcmp(start, magic, sizeof(magic));
+}
+
+const std::string SessionArchive::Extension()
+{
+	return ".ssa";
+}
+
+void SessionArchive::ForEachSensor(int numSensors, const std::function<void(int)>& task)
+{
+	if (pThreadPool && pThreadPool->NumThreads() > 1 && numSensors > 1) {
+		pThreadPool->ParallelFor(numSensors, task);
+	}
+	else {
+		for (int j = 0; j < numSensors; j++) {
+			task(j);
+		}
+	}
+}
@@ -0,0 +1,369 @@
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#include <cmath>
+#include <cstring>
+#include <atomic>
+
+#include "SessionJournal.h"
+#include "MappedFile.h"
+
+using namespace SmartScan;
+
+namespace
+{
+	const char magic[8] = { 'S', 'S', 'J', 'O', 'U', 'R', 'N', 'L' };	// First bytes of every journal.
+	const uint32_t version = 1;										// Version of the layout of the journal.
+
+	// The header fills the first page, the frames follow it. The watermark has a cache line of its own.
+	const size_t headerSize = 4096;									// Size of the header in bytes.
+	const size_t watermarkOffset = 64;								// Position of the number of committed frames in the header.
+	const size_t checksumOffset = 56;								// Position of the checksum of the header, which covers everything in front of it and the serials.
+	const size_t serialsOffset = 128;								// Position of the serial numbers of the sensors in the header.
+	const int maxSensors = (int)(headerSize - serialsOffset) / 4;	// Largest number of sensors whose serial numbers fit in the header.
+
+	// A frame record is its index and checksum, followed by a sample record of every sensor.
+	const size_t frameHeaderSize = 16;								// Size of the index and checksum of a frame in bytes.
+	const size_t sampleSize = 64;									// Size of a sample record in bytes: 7 doubles, quality, button and button state.
+
+	const uint64_t checksumSeed = 0x9e3779b97f4a7c15ull;			// Start of every checksum, so a record of zeros does not have a checksum of zero.
+
+	// Copy a number into the journal.
+	template <class T>
+	inline void Store(uint8_t* p, T value)
+	{
+		memcpy(p, &value, sizeof(T));
+	}
+
+	// Copy a number out of the journal.
+	template <class T>
+	inline T Load(const uint8_t* p)
+	{
+		T value;
+		memcpy(&value, p, sizeof(T));
+		return value;
+	}
+
+	// Mix bytes into a checksum, 8 at a time. The size is a multiple of 8.
+	inline uint64_t Mix(uint64_t hash, const uint8_t* data, size_t size)
+	{
+		for (size_t i = 0; i < size; i += 8) {
+			hash = (hash ^ Load<uint64_t>(data + i)) * 0xff51afd7ed558ccdull;
+			hash ^= hash >> 32;
+		}
+		return hash;
+	}
+
+	// Returns the checksum of a frame record, over its index and samples. Frames written before a reset have another checksum.
+	inline uint64_t FrameChecksum(const uint8_t* record, size_t frameSize, uint32_t generation)
+	{
+		uint64_t hash = Mix(checksumSeed ^ generation, record, 8);
+		return Mix(hash, record + frameHeaderSize, frameSize - frameHeaderSize);
+	}
+
+	// Returns the checksum of the header. The serial numbers are followed by zeros up to a multiple of 8 bytes.
+	inline uint64_t HeaderChecksum(const uint8_t* header, int numSensors)
+	{
+		uint64_t hash = Mix(checksumSeed, header, checksumOffset);
+		return Mix(hash, header + serialsOffset, (numSensors * 4 + 7) & ~(size_t)7);
+	}
+}
+
+SessionJournal::SessionJournal()
+{
+
+}
+
+SessionJournal::~SessionJournal()
+{
+	try {
+		this->Close();
+	}
+	catch (...) {
+		// The destructor must not throw, the journal is recovered like after a crash.
+	}
+}
+
+void SessionJournal::Open(const std::string filename, const DataAcqConfig& config, const std::vector<int>& serials, double minutes)
+{
+	this->Close();
+
+	const int numSensors = (int)serials.size();
+	if (numSensors <= 0 || numSensors > maxSensors || !(config.measurementRate > 0) || !(minutes > 0)) {
+		throw ex_acq("Cannot journal a session without sensors, measurement rate or duration.", __func__, __FILE__);
+	}
+	const size_t frameSize = frameHeaderSize + numSensors * sampleSize;
+	const size_t capacity = (size_t)std::ceil(minutes * 60 * config.measurementRate);
+	const size_t viewSize = headerSize + capacity * frameSize;
+
+#ifdef _WIN32
+	HANDLE file = CreateFileA(filename.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (file == INVALID_HANDLE_VALUE) {
+		throw ex_acq("Could not create the journal.", __func__, __FILE__);
+	}
+	mFile = file;
+
+	// Creating the mapping allocates the whole file, so writing to it never runs out of disk space halfway through a session.
+	mMapping = CreateFileMappingA(file, NULL, PAGE_READWRITE, (DWORD)((uint64_t)viewSize >> 32), (DWORD)viewSize, NULL);
+	if (!mMapping) {
+		this->Unmap(0);
+		throw ex_acq("Could not allocate the journal.", __func__, __FILE__);
+	}
+
+	pView = static_cast<uint8_t*>(MapViewOfFile(mMapping, FILE_MAP_WRITE, 0, 0, 0));
+	if (!pView) {
+		this->Unmap(0);
+		throw ex_acq("Could not map the journal.", __func__, __FILE__);
+	}
+#else
+	mFile = open(filename.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+	if (mFile < 0) {
+		throw ex_acq("Could not create the journal.", __func__, __FILE__);
+	}
+
+	// Allocate the whole file on the disk, writing to a page that has no room on the disk would crash the application.
+	if (posix_fallocate(mFile, 0, (off_t)viewSize) != 0) {
+		this->Unmap(0);
+		throw ex_acq("Could not allocate the journal.", __func__, __FILE__);
+	}
+
+	// Map the pages in right away where that is possible, which takes the slowest page faults out of the sample loop.
+	int flags = MAP_SHARED;
+#ifdef MAP_POPULATE
+	flags |= MAP_POPULATE;
+#endif
+	void* view = mmap(nullptr, viewSize, PROT_READ | PROT_WRITE, flags, mFile, 0);
+	if (view == MAP_FAILED) {
+		this->Unmap(0);
+		throw ex_acq("Could not map the journal.", __func__, __FILE__);
+	}
+	pView = static_cast<uint8_t*>(view);
+#endif
+	mViewSize = viewSize;
+	mNumSensors = numSensors;
+	mFrameSize = frameSize;
+	mCapacity = capacity;
+	mNumFrames = 0;
+	mGeneration = 0;
+	mRecord.assign(frameSize, 0);
+
+	// The new file reads as zeros, only the fields of the header are written.
+	memcpy(pView, magic, sizeof(magic));
+	Store<uint32_t>(pView + 8, version);
+	Store<uint32_t>(pView + 12, (uint32_t)numSensors);
+	Store<double>(pView + 16, config.measurementRate);
+	Store<uint64_t>(pView + 24, capacity);
+	Store<uint32_t>(pView + 32, (uint32_t)frameSize);
+	Store<int32_t>(pView + 36, config.refSensorSerial);
+	for (int i = 0; i < numSensors; i++) {
+		Store<int32_t>(pView + serialsOffset + i * 4, serials[i]);
+	}
+	this->SealHeader();
+}
+
+void SessionJournal::Close()
+{
+	if (!pView) {
+		return;
+	}
+
+	// Only the committed frames are kept.
+	if (!this->Unmap(headerSize + mNumFrames * mFrameSize)) {
+		throw ex_acq("Could not write the journal.", __func__, __FILE__);
+	}
+}
+
+bool SessionJournal::Append(const Point3* frame, int numSensors)
+{
+	if (mNumFrames == mCapacity || numSensors != mNumSensors) {
+		return false;
+	}
+
+	// Put the record together first, so the frame is copied into the mapping in one go.
+	uint8_t* record = mRecord.data();
+	Store<uint64_t>(record, mNumFrames);
+	for (int i = 0; i < mNumSensors; i++) {
+		uint8_t* sample = record + frameHeaderSize + i * sampleSize;
+		const Point3& p = frame[i];
+		Store<double>(sample, p.time);
+		Store<double>(sample + 8, p.x);
+		Store<double>(sample + 16, p.y);
+		Store<double>(sample + 24, p.z);
+		Store<double>(sample + 32, p.r.x);
+		Store<double>(sample + 40, p.r.y);
+		Store<double>(sample + 48, p.r.z);
+		Store<uint16_t>(sample + 56, p.quality);
+		Store<uint16_t>(sample + 58, p.button);
+		sample[60] = (uint8_t)p.buttonState;
+	}
+	Store<uint64_t>(record + 8, FrameChecksum(record, mFrameSize, mGeneration));
+	memcpy(pView + headerSize + mNumFrames * mFrameSize, record, mFrameSize);
+
+	// Commit the frame. The watermark moves only after the frame is in the mapping, and is a single aligned store that is never torn.
+	mNumFrames++;
+	std::atomic_thread_fence(std::memory_order_release);
+	*reinterpret_cast<volatile uint64_t*>(pView + watermarkOffset) = mNumFrames;
+	return true;
+}
+
+void SessionJournal::Reset()
+{
+	if (!pView) {
+		return;
+	}
+
+	*reinterpret_cast<volatile uint64_t*>(pView + watermarkOffset) = 0;
+	mNumFrames = 0;
+	mGeneration++;
+	Store<uint32_t>(pView + 40, mGeneration);
+	this->SealHeader();
+}
+
+const bool SessionJournal::IsOpen() const
+{
+	return pView != nullptr;
+}
+
+const size_t SessionJournal::NumFrames() const
+{
+	return mNumFrames;
+}
+
+const size_t SessionJournal::Capacity() const
+{
+	return mCapacity;
+}
+
+SessionInfo SessionJournal::Recover(const std::string filename, RawStore* data)
+{
+	MappedFile file;
+	if (!file.Open(filename)) {
+		throw ex_acq("Could not open the journal.", __func__, __FILE__);
+	}
+	const uint8_t* view = reinterpret_cast<const uint8_t*>(file.Data());
+	const size_t size = file.Size();
+	if (size < headerSize || memcmp(view, magic, sizeof(magic)) || Load<uint32_t>(view + 8) != version) {
+		throw ex_acq("File is not a session journal.", __func__, __FILE__);
+	}
+
+	const int numSensors = (int)Load<uint32_t>(view + 12);
+	if (numSensors <= 0 || numSensors > maxSensors || Load<uint64_t>(view + checksumOffset) != HeaderChecksum(view, numSensors)) {
+		throw ex_acq("Session journal is damaged.", __func__, __FILE__);
+	}
+	const double measurementRate = Load<double>(view + 16);
+	const uint64_t capacity = Load<uint64_t>(view + 24);
+	const size_t frameSize = Load<uint32_t>(view + 32);
+	const uint32_t generation = Load<uint32_t>(view + 40);
+	if (frameSize != frameHeaderSize + numSensors * sampleSize || !(measurementRate > 0)) {
+		throw ex_acq("Session journal is damaged.", __func__, __FILE__);
+	}
+
+	SessionInfo info;
+	info.config.measurementRate = measurementRate;
+	info.config.refSensorSerial = Load<int32_t>(view + 36);
+	for (int i = 0; i < numSensors; i++) {
+		info.serials.push_back(Load<int32_t>(view + serialsOffset + i * 4));
+	}
+
+	// Frames above the watermark were never committed, and a crash may have cut the file short.
+	// Below the watermark, a frame whose index or checksum is wrong did not reach the disk before the machine went down.
+	uint64_t numFrames = Load<uint64_t>(view + watermarkOffset);
+	if (numFrames > capacity) {
+		numFrames = capacity;
+	}
+	if (numFrames > (size - headerSize) / frameSize) {
+		numFrames = (size - headerSize) / frameSize;
+	}
+
+	data->Init(numSensors, measurementRate);
+	std::vector<Point3> frame(numSensors);
+	for (uint64_t f = 0; f < numFrames; f++) {
+		const uint8_t* record = view + headerSize + f * frameSize;
+		if (Load<uint64_t>(record) != f || Load<uint64_t>(record + 8) != FrameChecksum(record, frameSize, generation)) {
+			break;
+		}
+		for (int i = 0; i < numSensors; i++) {
+			const uint8_t* sample = record + frameHeaderSize + i * sampleSize;
+			Point3& p = frame[i];
+			p.time = Load<double>(sample);
+			p.x = Load<double>(sample + 8);
+			p.y = Load<double>(sample + 16);
+			p.z = Load<double>(sample + 24);
+			p.r.x = Load<double>(sample + 32);
+			p.r.y = Load<double>(sample + 40);
+			p.r.z = Load<double>(sample + 48);
+			p.quality = Load<uint16_t>(sample + 56);
+			p.button = Load<uint16_t>(sample + 58);
+			p.buttonState = static_cast<button_state>(sample[60]);
+		}
+		if (!data->AppendFrame(frame.data())) {
+			break;
+		}
+	}
+	return info;
+}
+
+const std::string SessionJournal::Extension()
+{
+	return ".ssj";
+}
+
+void SessionJournal::SealHeader()
+{
+	Store<uint64_t>(pView + checksumOffset, HeaderChecksum(pView, mNumSensors));
+}
+
+bool SessionJournal::Unmap(uint64_t size)
+{
+	bool written = true;
+#ifdef _WIN32
+	if (pView) {
+		written = FlushViewOfFile(pView, 0) != 0;
+		UnmapViewOfFile(pView);
+	}
+	if (mMapping) {
+		CloseHandle(mMapping);
+	}
+	if (mFile) {
+		LARGE_INTEGER end;
+		end.QuadPart = (LONGLONG)size;
+		if (size && !(SetFilePointerEx(mFile, end, NULL, FILE_BEGIN) && SetEndOfFile(mFile))) {
+			written = false;
+		}
+		if (!FlushFileBuffers(mFile)) {
+			written = false;
+		}
+		CloseHandle(mFile);
+	}
+	mMapping = nullptr;
+	mFile = nullptr;
+#else
+	if (pView) {
+		written = msync(pView, mViewSize, MS_SYNC) == 0;
+		munmap(pView, mViewSize);
+	}
+	if (mFile >= 0) {
+		if (size && ftruncate(mFile, (off_t)size) != 0) {
+			written = false;
+		}
+		if (fsync(mFile) != 0) {
+			written = false;
+		}
+		close(mFile);
+	}
+	mFile = -1;
+#endif
+	pView = nullptr;
+	mViewSize = 0;
+	mNumSensors = 0;
+	mFrameSize = 0;
+	mCapacity = 0;
+	mNumFrames = 0;
+	return written;
+}
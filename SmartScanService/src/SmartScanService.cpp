@@ -1,5 +1,6 @@
 #include <chrono>
 #include <iomanip>
+#include <cstdio>
 
 #include "Exceptions.h"
 #include "SmartScanService.h"
@@ -8,13 +9,30 @@
 using namespace SmartScan;
 
 SmartScanService::SmartScanService(bool useMockData)
-	: mUseMockData{ useMockData }, mDataAcq(useMockData) // Initializer list needed to initialize member classes and values.
+	: mUseMockData{ useMockData }, mDataAcq(useMockData), mFilterEngine(mDataAcq.GetFrameRing()) // Initializer list needed to initialize member classes and values.
+{
+
+}
+
+SmartScanService::SmartScanService(device_backend backend, const std::string source)
+	: mUseMockData{ backend != device_backend::TRAKSTAR }, mDataAcq(backend, source), mFilterEngine(mDataAcq.GetFrameRing())
 {
 
 }
 
 SmartScanService::~SmartScanService()
 {
+	// Close the journal before the data is cleared, so it keeps the session when the application exits.
+	if (mDataAcq.GetJournal()->IsOpen()) {
+		mDataAcq.Stop();
+		try {
+			mDataAcq.CloseJournal();
+		}
+		catch (...) {
+			// The journal is recovered like after a crash.
+		}
+	}
+
 	// Clear all data.
 	this->ClearData();
 	scans.clear();
@@ -22,11 +40,14 @@ SmartScanService::~SmartScanService()
 
 void SmartScanService::Init()
 {
+	// Init() allocates a new raw store, queued exports may still be reading the old one.
+	mExportQueue.Wait();
 	mDataAcq.Init();
 }
 
 void SmartScanService::Init(DataAcqConfig acquisitionConfig)
 {
+	mExportQueue.Wait();
 	mDataAcq.Init(acquisitionConfig);
 }
 
@@ -44,13 +65,18 @@ void SmartScanService::NewScan(ScanConfig config)
 	if (180%config.filteringPrecision != 0) {
 		throw ex_smartScan("180 is not a multiple of the filtering precision", __func__, __FILE__);
 	}
-	// Give raw data buffer to the scan.
-	config.inBuff = mDataAcq.GetRawBuffer();
-	this->scans.emplace_back(std::make_shared<Scan>(FindNewScanId(), config));
+	// Give the frame ring and the raw store to the scan.
+	config.inBuff = mDataAcq.GetFrameRing();
+	config.rawBuff = mDataAcq.GetRawBuffer();
+	this->scans.emplace_back(std::make_shared<Scan>(FindNewScanId(), config, &mFilterEngine));
+	mFilterEngine.Add(scans.back());
 }
 
 void SmartScanService::DeleteScan()
 {
+	for (size_t s = 0; s < scans.size(); s++) {
+		mFilterEngine.Remove(scans[s].get());
+	}
 	this->scans.clear();
 }
 
@@ -60,6 +86,7 @@ void SmartScanService::DeleteScan(int id)
 	// Find the scan with the specified id and erase it.
 	for (int s = 0; s < scans.size(); s++) {
 		if (scans[s]->mId == id) {
+			mFilterEngine.Remove(scans[s].get());
 			this->scans.erase(scans.begin() + s);
 			ok = true;
 			break;
@@ -70,12 +97,71 @@ void SmartScanService::DeleteScan(int id)
 	}
 }
 
+void SmartScanService::RefilterScan(int id)
+{
+	for (size_t s = 0; s < scans.size(); s++) {
+		if (scans[s]->mId == id) {
+			if (!pThreadPool) {
+				pThreadPool = std::make_unique<ThreadPool>();
+			}
+			scans[s]->Refilter(pThreadPool.get());
+			return;
+		}
+	}
+	throw ex_smartScan("Scan id not found", __func__, __FILE__);
+}
+
+std::vector<SweepResult> SmartScanService::SweepScans(std::vector<ScanConfig> configs, const RawStore* rawBuff)
+{
+	// Check all configurations before filtering any of them, for the same reason as in NewScan().
+	for (ScanConfig& config : configs) {
+		if (config.filteringPrecision <= 0 || 180%config.filteringPrecision != 0) {
+			throw ex_smartScan("180 is not a multiple of the filtering precision", __func__, __FILE__);
+		}
+		config.inBuff = mDataAcq.GetFrameRing();
+		config.rawBuff = rawBuff ? rawBuff : mDataAcq.GetRawBuffer();
+	}
+
+	if (!pThreadPool) {
+		pThreadPool = std::make_unique<ThreadPool>();
+	}
+
+	// The scans are not added to the scan list or the filter engine, they only live for the sweep.
+	std::vector<std::unique_ptr<Scan>> sweepScans;
+	for (size_t i = 0; i < configs.size(); i++) {
+		sweepScans.push_back(std::make_unique<Scan>((int)i, configs[i]));
+	}
+
+	// With at least as many configurations as threads, every thread filters whole configurations. Otherwise every configuration is split over all threads.
+	if (configs.size() >= (size_t)pThreadPool->NumThreads()) {
+		pThreadPool->ParallelFor(configs.size(), [&](int i) { sweepScans[i]->Refilter(); });
+	}
+	else {
+		for (auto& scan : sweepScans) {
+			scan->Refilter(pThreadPool.get());
+		}
+	}
+
+	std::vector<SweepResult> results(configs.size());
+	for (size_t i = 0; i < configs.size(); i++) {
+		SweepResult& result = results[i];
+		result.config = configs[i];
+		sweepScans[i]->CopyOutputBuffer(&result.cloud);
+		result.numCells = sweepScans[i]->NumCells();
+		result.filledCells = result.cloud.size();
+
+		double sum = 0;
+		for (const Point3& point : result.cloud) {
+			sum += point.s.r;
+		}
+		result.meanRadius = result.cloud.empty() ? 0 : sum / result.cloud.size();
+	}
+	return results;
+}
+
 void SmartScanService::StartScan()
 {
-	char arg[51];
-	const char startString[] = "Cannot start scan ";
-	const char endString[] = " due to reference points set.";
-	char scan[3];
+	static char arg[64];	// Static, since the exception only keeps a pointer to the message.
 
 	// Start the scan:
 	mDataAcq.Start();
@@ -83,11 +169,7 @@ void SmartScanService::StartScan()
 	for (int i = 0; i < scans.size(); i++) {
 		// Check if reference points have been set;
 		if (!this->scans.at(i)->NumRefPoints() && !this->scans.at(i)->NumUsedSensors()) {
-			// Ugly stuff to put a number into an error string. This can probalby be done easier.
-			sprintf_s(scan, "%d", i);
-			strcpy_s(arg, startString);
-			strcat_s(arg, scan);
-			strcat_s(arg, endString);
+			snprintf(arg, sizeof(arg), "Cannot start scan %d due to reference points set.", i);
 			throw ex_smartScan(arg, __func__, __FILE__);
 		}
 
@@ -97,6 +179,8 @@ void SmartScanService::StartScan()
 
 void SmartScanService::ClearData()
 {
+	// The next session overwrites the raw store, queued exports may still be reading it.
+	mExportQueue.Wait();
 	mDataAcq.Stop(true);
 
 	for (int i = 0; i < scans.size(); i++) {
@@ -118,11 +202,26 @@ void SmartScanService::StopScan()
 	}
 }
 
+const ScanCoverage SmartScanService::GetScanCoverage(int id) const
+{
+	for (size_t s = 0; s < scans.size(); s++) {
+		if (scans[s]->mId == id) {
+			return scans[s]->GetCoverage();
+		}
+	}
+	throw ex_smartScan("Scan id not found", __func__, __FILE__);
+}
+
 const std::vector<std::shared_ptr<Scan>>& SmartScanService::GetScansList() const
 {
 	return scans;
 }
 
+const SamplingStats SmartScanService::GetSamplingStats() const
+{
+	return mDataAcq.GetSamplingStats();
+}
+
 const int SmartScanService::NumAttachedBoards() const
 {
 	return mDataAcq.NumAttachedBoards();
@@ -140,6 +239,12 @@ const int SmartScanService::NumAttachedSensors(bool includeRef) const
 
 void SmartScanService::ExportCSV(const std::string filename, int scanId, const bool raw)
 {
+	// Format the rows on all cores.
+	if (!pThreadPool) {
+		pThreadPool = std::make_unique<ThreadPool>();
+	}
+	csvExport.SetThreadPool(pThreadPool.get());
+
 	try {
 		if (raw) {
 			csvExport.ExportPoint3Raw(mDataAcq.GetRawBuffer(), filename);
@@ -162,6 +267,12 @@ void SmartScanService::ExportCSV(const std::string filename, int scanId, const b
 
 void SmartScanService::ExportPointCloud(const std::string filename, int scanId, const bool raw)
 {
+	// Format the rows on all cores.
+	if (!pThreadPool) {
+		pThreadPool = std::make_unique<ThreadPool>();
+	}
+	csvExport.SetThreadPool(pThreadPool.get());
+
 	try {
 		if (raw) {
 			csvExport.ExportPoint3RawCloud(mDataAcq.GetRawBuffer(), filename);
@@ -182,11 +293,176 @@ void SmartScanService::ExportPointCloud(const std::string filename, int scanId,
 	}
 }
 
+void SmartScanService::ExportBinaryCloud(const std::string filename, int scanId, const CloudOptions& options, const bool raw)
+{
+	try {
+		if (raw) {
+			cloudExport.ExportRawCloud(mDataAcq.GetRawBuffer(), filename, options);
+		}
+		else {
+			// Copy the scan buffer into a temporary vector and export that.
+			std::vector<Point3> temp;
+			scans.at(scanId)->CopyOutputBuffer(&temp);
+			cloudExport.ExportCloud(&temp, filename, options);
+		}
+	}
+	catch(ex_export e) {
+		throw e;
+	}
+	catch (...) {
+		throw ex_smartScan("Could not export data.", __func__, __FILE__);
+	}
+}
+
+std::shared_ptr<ExportJob> SmartScanService::ExportCSVAsync(const std::string filename, int scanId, const bool raw)
+{
+	const int precision = csvExport.GetPrecision();
+	if (raw) {
+		// Published frames never change, so the frame count is the whole snapshot.
+		const RawStore* rawBuff = mDataAcq.GetRawBuffer();
+		const size_t numFrames = rawBuff->NumFrames();
+		return mExportQueue.Push(filename, numFrames, [rawBuff, numFrames, filename, precision](std::atomic<size_t>* progress, ThreadPool* pool) {
+			CSVExport exporter(precision);
+			exporter.SetThreadPool(pool);
+			exporter.SetProgress(progress);
+			exporter.ExportPoint3Raw(rawBuff, filename, numFrames);
+		});
+	}
+
+	std::shared_ptr<std::vector<Point3>> snapshot = std::make_shared<std::vector<Point3>>();
+	scans.at(scanId)->CopyOutputBuffer(snapshot.get());
+	return mExportQueue.Push(filename, snapshot->size(), [snapshot, filename, precision](std::atomic<size_t>* progress, ThreadPool* pool) {
+		CSVExport exporter(precision);
+		exporter.SetThreadPool(pool);
+		exporter.SetProgress(progress);
+		exporter.ExportPoint3(snapshot.get(), filename);
+	});
+}
+
+std::shared_ptr<ExportJob> SmartScanService::ExportPointCloudAsync(const std::string filename, int scanId, const bool raw)
+{
+	const int precision = csvExport.GetPrecision();
+	if (raw) {
+		const RawStore* rawBuff = mDataAcq.GetRawBuffer();
+		const size_t numFrames = rawBuff->NumFrames();
+		return mExportQueue.Push(filename, numFrames * rawBuff->NumSensors(), [rawBuff, numFrames, filename, precision](std::atomic<size_t>* progress, ThreadPool* pool) {
+			CSVExport exporter(precision);
+			exporter.SetThreadPool(pool);
+			exporter.SetProgress(progress);
+			exporter.ExportPoint3RawCloud(rawBuff, filename, numFrames);
+		});
+	}
+
+	std::shared_ptr<std::vector<Point3>> snapshot = std::make_shared<std::vector<Point3>>();
+	scans.at(scanId)->CopyOutputBuffer(snapshot.get());
+	return mExportQueue.Push(filename, snapshot->size(), [snapshot, filename, precision](std::atomic<size_t>* progress, ThreadPool* pool) {
+		CSVExport exporter(precision);
+		exporter.SetThreadPool(pool);
+		exporter.SetProgress(progress);
+		exporter.ExportPoint3Cloud(snapshot.get(), filename);
+	});
+}
+
+std::shared_ptr<ExportJob> SmartScanService::ExportBinaryCloudAsync(const std::string filename, int scanId, const CloudOptions& options, const bool raw)
+{
+	if (raw) {
+		const RawStore* rawBuff = mDataAcq.GetRawBuffer();
+		const size_t numFrames = rawBuff->NumFrames();
+		return mExportQueue.Push(filename, numFrames * rawBuff->NumSensors(), [rawBuff, numFrames, filename, options](std::atomic<size_t>* progress, ThreadPool*) {
+			CloudExport exporter;
+			exporter.SetProgress(progress);
+			exporter.ExportRawCloud(rawBuff, filename, options, numFrames);
+		});
+	}
+
+	std::shared_ptr<std::vector<Point3>> snapshot = std::make_shared<std::vector<Point3>>();
+	scans.at(scanId)->CopyOutputBuffer(snapshot.get());
+	return mExportQueue.Push(filename, snapshot->size(), [snapshot, filename, options](std::atomic<size_t>* progress, ThreadPool*) {
+		CloudExport exporter;
+		exporter.SetProgress(progress);
+		exporter.ExportCloud(snapshot.get(), filename, options);
+	});
+}
+
+void SmartScanService::SaveSession(const std::string filename)
+{
+	// Compress the sensors on all cores.
+	if (!pThreadPool) {
+		pThreadPool = std::make_unique<ThreadPool>();
+	}
+	sessionArchive.SetThreadPool(pThreadPool.get());
+
+	try {
+		sessionArchive.Save(mDataAcq.GetRawBuffer(), this->DescribeSession(), filename);
+	}
+	catch(ex_export e) {
+		throw e;
+	}
+	catch (...) {
+		throw ex_smartScan("Could not save the session.", __func__, __FILE__);
+	}
+}
+
+std::shared_ptr<ExportJob> SmartScanService::SaveSessionAsync(const std::string filename)
+{
+	const RawStore* rawBuff = mDataAcq.GetRawBuffer();
+	const size_t numFrames = rawBuff->NumFrames();
+	const SessionInfo info = this->DescribeSession();
+	return mExportQueue.Push(filename, numFrames, [rawBuff, numFrames, info, filename](std::atomic<size_t>* progress, ThreadPool* pool) {
+		SessionArchive archive;
+		archive.SetThreadPool(pool);
+		archive.SetProgress(progress);
+		archive.Save(rawBuff, info, filename, numFrames);
+	});
+}
+
+SessionInfo SmartScanService::LoadSession(const std::string filename, RawStore* rawBuff)
+{
+	// Decompress the sensors on all cores.
+	if (!pThreadPool) {
+		pThreadPool = std::make_unique<ThreadPool>();
+	}
+	sessionArchive.SetThreadPool(pThreadPool.get());
+
+	return sessionArchive.Load(filename, rawBuff);
+}
+
+void SmartScanService::OpenJournal(const std::string filename, double minutes)
+{
+	mDataAcq.OpenJournal(filename, minutes);
+}
+
+void SmartScanService::CloseJournal()
+{
+	mDataAcq.CloseJournal();
+}
+
+SessionInfo SmartScanService::RecoverJournal(const std::string filename, RawStore* rawBuff)
+{
+	return SessionJournal::Recover(filename, rawBuff);
+}
+
+void SmartScanService::WaitForExports()
+{
+	mExportQueue.Wait();
+}
+
 void SmartScanService::RegisterRawDataCallback(std::function<void(const std::vector<SmartScan::Point3>&)> callback)
 {
 	mDataAcq.RegisterRawDataCallback(callback);
 }
 
+const SessionInfo SmartScanService::DescribeSession() const
+{
+	SessionInfo info;
+	info.config = mDataAcq.GetConfig();
+	info.serials = mDataAcq.GetSerials();
+	for (const std::shared_ptr<Scan>& scan : scans) {
+		info.refPoints.push_back(scan->GetRefPoints());
+	}
+	return info;
+}
+
 const int SmartScanService::FindNewScanId() const
 {
 	int newId = 0;
@@ -0,0 +1,240 @@
+#include <cmath>
+#include <algorithm>
+
+#include "SyntheticDevice.h"
+
+using namespace SmartScan;
+
+SyntheticDevice::SyntheticDevice(SyntheticConfig config) : mConfig { config }
+{
+	mRandom.seed(mConfig.seed);
+	mGroundTruth.resize(mConfig.numSensors + 1);
+}
+
+void SyntheticDevice::Configure(const DataAcqConfig& config)
+{
+	mConfig = config.synthetic;
+	mMeasurementRate = config.measurementRate;
+
+	// Start over, so the same configuration always gives the same samples.
+	mFrame = 0;
+	mRandom.seed(mConfig.seed);
+	mNoise.reset();
+	mGroundTruth.assign(mConfig.numSensors + 1, Point3());
+}
+
+void SyntheticDevice::SetReferenceSensor(int id)
+{
+
+}
+
+void SyntheticDevice::SetSensorOffset(int id, Point3 offset)
+{
+
+}
+
+const int SyntheticDevice::NumAttachedBoards() const
+{
+	return 1;
+}
+
+const int SyntheticDevice::NumAttachedTransmitters() const
+{
+	return 1;
+}
+
+std::vector<int> SyntheticDevice::GetAttachedPorts() const
+{
+	std::vector<int> ports;
+	for (int i = 0; i <= mConfig.numSensors; i++) {
+		ports.push_back(i);
+	}
+	return ports;
+}
+
+std::vector<int> SyntheticDevice::GetAttachedSerials() const
+{
+	return this->GetAttachedPorts();
+}
+
+Point3 SyntheticDevice::GetRecord(int id)
+{
+	double time = mFrame / mMeasurementRate;
+	Rotation3 refAngles;
+	Point3Ref ref = this->ReferencePose(time, &refAngles);
+
+	// The reference sensor reports its own pose.
+	if (id == 0) {
+		Point3 record(ref.x, ref.y, ref.z, refAngles, Spherical3());
+		record.quality = mConfig.quality;
+		record.button = 0;
+		return record;
+	}
+
+	// Noise-free sample on the foot surface, in the reference sensor frame.
+	Point3 local = this->StrokePoint(id - 1, time);
+	mGroundTruth.at(id) = local;
+
+	double q[3] = { local.x, local.y, local.z };
+	for (int j = 0; j < 3; j++) {
+		q[j] += mConfig.noise * mNoise(mRandom);
+	}
+
+	// Move the sample into the measurement frame with the reference pose. DataAcq::ReferenceCorrect() undoes exactly this.
+	double p[3], n[3];
+	const double normal[3] = { local.r.x, local.r.y, local.r.z };
+	const double refPos[3] = { ref.x, ref.y, ref.z };
+	for (int k = 0; k < 3; k++) {
+		p[k] = refPos[k] + ref.m[k][0] * q[0] + ref.m[k][1] * q[1] + ref.m[k][2] * q[2];
+		n[k] = ref.m[k][0] * normal[0] + ref.m[k][1] * normal[1] + ref.m[k][2] * normal[2];
+	}
+
+	// The sensor points along the surface normal, so its azimuth and elevation follow the normal. There is no roll.
+	double azimuth = atan2(n[1], n[0]) * toAngle;
+	double elevation = atan2(-n[2], sqrt(n[0] * n[0] + n[1] * n[1])) * toAngle;
+
+	return Point3(p[0], p[1], p[2], 0, elevation, azimuth, mConfig.quality, 0);
+}
+
+Point3Ref SyntheticDevice::GetRefRecord(int id)
+{
+	Rotation3 angles;
+	return this->ReferencePose(mFrame / mMeasurementRate, &angles);
+}
+
+void SyntheticDevice::GetFrame(std::vector<Point3>* records, Point3Ref* refRecord, int refId)
+{
+	records->resize(mConfig.numSensors + 1);
+	for (int i = 0; i <= mConfig.numSensors; i++) {
+		(*records)[i] = this->GetRecord(i);
+	}
+	*refRecord = this->GetRefRecord(0);
+
+	mFrame++;
+}
+
+Point3 SyntheticDevice::SurfacePoint(double u, double v) const
+{
+	double a, b;
+	this->CrossSection(u, &a, &b);
+	return Point3(mConfig.footLength * (u - 0.5), a * cos(v), b * sin(v));
+}
+
+Point3 SyntheticDevice::GroundTruth(int id) const
+{
+	Point3 truth = mGroundTruth.at(id);
+	truth.r = Rotation3();
+	return truth;
+}
+
+double SyntheticDevice::GroundTruthRadius(const Point3& center, double theta, double phi) const
+{
+	if (!this->Inside(center.x, center.y, center.z)) {
+		return 0;
+	}
+
+	// Direction of theta and phi, using the definition of Scan::CalcAngle().
+	double azimuth = (theta - 180) * toRad;
+	double d[3] = { sin(phi * toRad) * cos(azimuth), sin(phi * toRad) * sin(azimuth), cos(phi * toRad) };
+
+	// Step outwards until the ray leaves the foot.
+	const double step = 1.0;
+	const double maxRadius = mConfig.footLength + mConfig.footWidth + mConfig.footHeight;
+	double inner = 0, outer = step;
+	while (outer < maxRadius && this->Inside(center.x + d[0] * outer, center.y + d[1] * outer, center.z + d[2] * outer)) {
+		inner = outer;
+		outer += step;
+	}
+
+	// Narrow the crossing down with a bisection.
+	for (int i = 0; i < 30; i++) {
+		double mid = (inner + outer) / 2;
+		if (this->Inside(center.x + d[0] * mid, center.y + d[1] * mid, center.z + d[2] * mid)) {
+			inner = mid;
+		}
+		else {
+			outer = mid;
+		}
+	}
+	return (inner + outer) / 2;
+}
+
+Point3Ref SyntheticDevice::ReferencePose(double time, Rotation3* angles) const
+{
+	// The foot rests at a fixed spot in front of the transmitter, and slowly sways and turns around it when the reference moves.
+	double x = 200, y = 0, z = 100;
+	double azimuth = 0, elevation = 0, roll = 0;
+	if (mConfig.moveReference) {
+		x += 20 * sin(2 * pi * 0.30 * time);
+		y += 15 * sin(2 * pi * 0.20 * time);
+		z += 10 * sin(2 * pi * 0.25 * time);
+		azimuth = 15 * sin(2 * pi * 0.10 * time);
+		elevation = 10 * sin(2 * pi * 0.13 * time);
+		roll = 5 * sin(2 * pi * 0.17 * time);
+	}
+	*angles = Rotation3(roll, elevation, azimuth);
+
+	// Rotation matrix of the euler angles, in the same layout as the TrakStar device reports it.
+	double ca = cos(azimuth * toRad), sa = sin(azimuth * toRad);
+	double ce = cos(elevation * toRad), se = sin(elevation * toRad);
+	double cr = cos(roll * toRad), sr = sin(roll * toRad);
+	double m[3][3] = {
+		{ ce * ca, ce * sa, -se },
+		{ -cr * sa + sr * se * ca, cr * ca + sr * se * sa, sr * ce },
+		{ sr * sa + cr * se * ca, -sr * ca + cr * se * sa, cr * ce },
+	};
+	return Point3Ref(x, y, z, m);
+}
+
+Point3 SyntheticDevice::StrokePoint(int sensor, double time) const
+{
+	// Every sensor strokes back and forth along the foot, the sensors are spread around it and slowly circle it so the whole surface is covered.
+	double phase = 2 * pi * sensor / std::max(mConfig.numSensors, 1);
+	double stroke = 2 * pi * mConfig.strokeFrequency * time + phase;
+	double u = 0.5 + 0.45 * sin(stroke);
+	double v = phase + 2 * pi * 0.05 * time + 0.3 * sin(0.37 * stroke);
+
+	Point3 point = this->SurfacePoint(u, v);
+
+	// Surface normal from the tangents along v and u.
+	const double h = 1e-4;
+	Point3 du1 = this->SurfacePoint(u + h, v), du0 = this->SurfacePoint(u - h, v);
+	Point3 dv1 = this->SurfacePoint(u, v + h), dv0 = this->SurfacePoint(u, v - h);
+	double tu[3] = { du1.x - du0.x, du1.y - du0.y, du1.z - du0.z };
+	double tv[3] = { dv1.x - dv0.x, dv1.y - dv0.y, dv1.z - dv0.z };
+	double n[3] = { tv[1] * tu[2] - tv[2] * tu[1], tv[2] * tu[0] - tv[0] * tu[2], tv[0] * tu[1] - tv[1] * tu[0] };
+	double length = sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+	if (length < 1e-12) {
+		// At the tips of the foot the tangents vanish, point the normal away from the centre instead.
+		n[0] = point.x; n[1] = point.y; n[2] = point.z;
+		length = sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+	}
+
+	// The normal is handed over in the rotation member, GetRecord() turns it into euler angles.
+	point.r = Rotation3(n[0] / length, n[1] / length, n[2] / length);
+	return point;
+}
+
+bool SyntheticDevice::Inside(double x, double y, double z) const
+{
+	double u = x / mConfig.footLength + 0.5;
+	if (u <= 0 || u >= 1) {
+		return false;
+	}
+
+	double a, b;
+	this->CrossSection(u, &a, &b);
+	if (a <= 0 || b <= 0) {
+		return false;
+	}
+	return (y / a) * (y / a) + (z / b) * (z / b) <= 1;
+}
+
+void SyntheticDevice::CrossSection(double u, double* a, double* b) const
+{
+	// The cross-section closes towards the heel and the toes. The foot is widest at the front and highest at the back.
+	double s = 2 * u - 1;
+	double envelope = pow(std::max(0.0, 1 - s * s), 0.35);
+	*a = mConfig.footWidth / 2 * (0.8 + 0.2 * u) * envelope;
+	*b = mConfig.footHeight / 2 * (1.0 - 0.3 * u) * envelope;
+}
@@ -0,0 +1,105 @@
+#include <algorithm>
+
+#include "ThreadPool.h"
+
+using namespace SmartScan;
+
+ThreadPool::ThreadPool(int numThreads)
+{
+	if (numThreads <= 0) {
+		numThreads = std::max((int)std::thread::hardware_concurrency(), 1);
+	}
+
+	// The calling thread is one of the threads that work on a loop.
+	for (int i = 1; i < numThreads; i++) {
+		mWorkers.emplace_back(&ThreadPool::Worker, this);
+	}
+}
+
+ThreadPool::~ThreadPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		mExit = true;
+	}
+	mWorkAvailable.notify_all();
+	for (std::thread& worker : mWorkers) {
+		worker.join();
+	}
+}
+
+void ThreadPool::ParallelFor(int count, const std::function<void(int)>& task)
+{
+	if (count <= 0) {
+		return;
+	}
+
+	// Hand the loop to the workers.
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		pTask = &task;
+		mCount = count;
+		mNext = 0;
+		mError = nullptr;
+		mGeneration++;
+	}
+	mWorkAvailable.notify_all();
+
+	this->RunParts();
+
+	// Wait until every worker that joined the loop has finished its last part.
+	std::unique_lock<std::mutex> lock(mMutex);
+	mWorkDone.wait(lock, [&]() { return mBusy == 0; });
+	pTask = nullptr;
+	mCount = 0;
+
+	if (mError) {
+		std::exception_ptr error = mError;
+		mError = nullptr;
+		std::rethrow_exception(error);
+	}
+}
+
+const int ThreadPool::NumThreads() const
+{
+	return (int)mWorkers.size() + 1;
+}
+
+void ThreadPool::Worker()
+{
+	unsigned int generation = 0;
+	while (true) {
+		{
+			std::unique_lock<std::mutex> lock(mMutex);
+			mWorkAvailable.wait(lock, [&]() { return mExit || (pTask && generation != mGeneration); });
+			if (mExit) {
+				return;
+			}
+			generation = mGeneration;
+			mBusy++;
+		}
+
+		this->RunParts();
+
+		{
+			std::lock_guard<std::mutex> lock(mMutex);
+			mBusy--;
+		}
+		mWorkDone.notify_one();
+	}
+}
+
+void ThreadPool::RunParts()
+{
+	for (int part = mNext++; part < mCount; part = mNext++) {
+		try {
+			(*pTask)(part);
+		}
+		catch (...) {
+			std::lock_guard<std::mutex> lock(mMutex);
+			if (!mError) {
+				mError = std::current_exception();
+			}
+		}
+	}
+}
@@ -1,32 +1,30 @@
+#include "TrakStarController.h"
+
+#ifdef SMARTSCAN_TRAKSTAR
+
 #include <iostream>
-#include <stdlib.h>
-#include <time.h>
+#include <cstring>
+#include <algorithm>
 
 #include "Exceptions.h"
-#include "TrakStarController.h"
 
 using namespace SmartScan;
 
-TrakStarController::TrakStarController(bool useMockData) : mUseMockData { useMockData }
+TrakStarController::TrakStarController()
 {
-	if (mUseMockData) {
-		// Initialize random seed.
-		srand(time(NULL));
-	}
+
 }
 
 TrakStarController::~TrakStarController()
 {
-	this->StopTransmit();
+	// Only turn off the transmitter if the system was initialized, otherwise there is nothing to turn off.
+	if (mInitialized) {
+		this->StopTransmit();
+	}
 }
 
 void TrakStarController::Init()
 {
-	// Do nothing if mock data is used.
-	if (mUseMockData) {
-		return;
-	}
-
 	// Initialize the system.
 	int errorCode = InitializeBIRDSystem();
 	ErrorHandler(errorCode);
@@ -48,15 +46,29 @@ void TrakStarController::Init()
 		errorCode = GetSensorConfiguration(i, &pSensor[i].m_config);
 		ErrorHandler(errorCode);
 	}
+
+	// Allocate the record buffer for batched reads once, every sensor has a slot in an ALL_SENSORS record.
+	mFrameRecords.resize(ATC3DG.m_config.numberSensors);
+
+	mInitialized = true;
 }
 
-void TrakStarController::StopTransmit()
+void TrakStarController::Configure(const DataAcqConfig& config)
 {
-	// Do nothing if mock data is used.
-	if (mUseMockData) {
-		return;
-	}
+	double frameRotations[3] = { config.frameRotations[0], config.frameRotations[1], config.frameRotations[2] };
+
+	this->Init();
+	this->SelectTransmitter(config.transmitterID);
+	this->SetPowerlineFrequency(config.powerLineFrequency);
+	this->SetMeasurementRate(config.measurementRate);
+	this->SetMaxRange(config.maximumRange);
+	this->SetMetric();
+	this->SetReferenceFrame(config.transmitterID, frameRotations);
+	this->SetSensorFormat();
+}
 
+void TrakStarController::StopTransmit()
+{
 	// Setting transmitter id to -1 turns it off.
 	short int id = -1;
 	int errorCode = SetSystemParameter(SELECT_TRANSMITTER, &id, sizeof(id));
@@ -117,7 +129,7 @@ void TrakStarController::SetSensorFormat()
 {
 	// Loop through all sensors.
 	for (int i = 0; i < ATC3DG.m_config.numberSensors; i++)	{
-		DATA_FORMAT_TYPE type = DOUBLE_POSITION_ANGLES_TIME_Q_BUTTON;
+		DATA_FORMAT_TYPE type = DOUBLE_POSITION_ANGLES_MATRIX_QUATERNION_TIME_Q_BUTTON;
 		int errorCode = SetSensorParameter(i, DATA_FORMAT, &type, sizeof(type));
 		ErrorHandler(errorCode);
 	}
@@ -125,11 +137,16 @@ void TrakStarController::SetSensorFormat()
 
 void TrakStarController::SetRefSensorFormat(int id)
 {
-	DATA_FORMAT_TYPE type = DOUBLE_POSITION_MATRIX;
+	DATA_FORMAT_TYPE type = DOUBLE_POSITION_ANGLES_MATRIX_QUATERNION_TIME_Q_BUTTON;
 	int errorCode = SetSensorParameter(id, DATA_FORMAT, &type, sizeof(type));
 	ErrorHandler(errorCode);
 }
 
+void TrakStarController::SetReferenceSensor(int id)
+{
+	this->SetRefSensorFormat(id);
+}
+
 void TrakStarController::SetSensorOffset(int id, Point3 offset)
 {
 	DOUBLE_POSITION_RECORD record;
@@ -145,21 +162,11 @@ void TrakStarController::SetSensorOffset(int id, Point3 offset)
 
 const int TrakStarController::NumAttachedBoards() const
 {
-	// Return 1 if mock data is used.
-	if (mUseMockData) {
-		return 1;
-	}
-	
 	return ATC3DG.m_config.numberBoards;
 }
 
 const int TrakStarController::NumAttachedTransmitters() const
 {
-	// Return 1 if mock data is used.
-	if (mUseMockData) {
-		return 1;
-	}
-
 	return pXmtr.size();
 }
 
@@ -167,19 +174,11 @@ std::vector<int> TrakStarController::GetAttachedPorts() const
 {
 	std::vector<int> attachedSensors;
 
-	if (!mUseMockData) {
-    	for (int i = 0; i < ATC3DG.m_config.numberSensors; i++) {
-    	    if(pSensor[i].m_config.attached) {
-    	        attachedSensors.push_back(i);
-    	    }
-    	}
-	}
-	// Return 0, 1, 2 if mock data is used. (3 sensors for 3 mock data files)
-	else {
-		for (int i = 0; i < 3; i++) {
-			attachedSensors.push_back(i);
-		}
-	}
+    for (int i = 0; i < pSensor.size(); i++) {
+        if(pSensor[i].m_config.attached) {
+            attachedSensors.push_back(i);
+        }
+    }
 
 	return attachedSensors;
 }
@@ -188,31 +187,17 @@ std::vector<int> TrakStarController::GetAttachedSerials() const
 {
 	std::vector<int> attachedSensors;
 
-	if (!mUseMockData) {
-    	for (int i = 0; i < ATC3DG.m_config.numberSensors; i++) {
-    	    if (pSensor[i].m_config.attached) {
-    	        attachedSensors.push_back(pSensor[i].m_config.serialNumber);
-    	    }
-    	}
-	}
-	// Return 0, 1, 2 if mock data is used. (3 sensors for 3 mock data files)
-	else {
-		for (int i = 0; i < 3; i++) {
-			attachedSensors.push_back(i);
-		}
-	}
+    for (int i = 0; i < pSensor.size(); i++) {
+        if (pSensor[i].m_config.attached) {
+            attachedSensors.push_back(pSensor[i].m_config.serialNumber);
+        }
+    }
 
 	return attachedSensors;
 }
 
 Point3 TrakStarController::GetRecord(int id)
 {
-	// When in mock mode, return a value from one of the mockdata files.
-	if (mUseMockData) {
-		//return GetMockRecord(); // Return a random point on a sphere.
-		return GetMockRecordFromFile(id);
-	}
-
 	// Only report the data if everything is okay.
 	// Device status handler for sensors 
 	unsigned int status = GetSensorStatus(id);
@@ -232,7 +217,7 @@ Point3 TrakStarController::GetRecord(int id)
 	}
     
 	// Acquire a sample.
-	DOUBLE_POSITION_ANGLES_TIME_Q_BUTTON_RECORD record;
+	DOUBLE_POSITION_ANGLES_MATRIX_QUATERNION_TIME_Q_BUTTON_RECORD record;
 	int errorCode = GetAsynchronousRecord(id, &record, sizeof(record));
 	static int lastErrorCode;
 
@@ -249,17 +234,11 @@ Point3 TrakStarController::GetRecord(int id)
 	}
     lastErrorCode = errorCode;
 
-	return Point3(record.x, record.y, record.z, record.r, record.e, record.a, record.quality, record.button);
+	return ToPoint3(record);
 }
 
 Point3Ref TrakStarController::GetRefRecord(int id)
 {
-	// When in mock mode, return a random value on a sphere.
-	if (mUseMockData) {
-		//return GetMockRecord();
-		return Point3Ref();
-	}
-
 	// Only report the data if everything is okay.
 	// Device status handler for sensors 
 	unsigned int status = GetSensorStatus(id);
@@ -279,7 +258,7 @@ Point3Ref TrakStarController::GetRefRecord(int id)
 	}
     
 	// Acquire a sample.
-	DOUBLE_POSITION_MATRIX_RECORD record;
+	DOUBLE_POSITION_ANGLES_MATRIX_QUATERNION_TIME_Q_BUTTON_RECORD record;
 	int errorCode = GetAsynchronousRecord(id, &record, sizeof(record));
 	static int lastErrorCode;
 
@@ -296,107 +275,55 @@ Point3Ref TrakStarController::GetRefRecord(int id)
 	}
     lastErrorCode = errorCode;
 
-	return Point3Ref(record.x, record.y, record.z, record.s);
+	return ToPoint3Ref(record);
 }
 
-Point3 TrakStarController::GetMockRecord()
+void TrakStarController::GetFrame(std::vector<Point3>* records, Point3Ref* refRecord, int refId)
 {
-	double radius = 100;
-	int randomMax = 10;
-	double randomMaxRadius = 200;
-
-	//return Point3();
+	records->resize(mFrameRecords.size());
 
-	if (mPrevMockRecord.x == 0 && mPrevMockRecord.y == 0 && mPrevMockRecord.z == 0)	{
-		// First mock value.
-		mPrevMockRecord = Point3(radius, 0, 0);
-		return mPrevMockRecord;
-	}
-	else {
-		// Add some random noise to the previous mockRecord.
-		mPrevMockRecord = Point3(mPrevMockRecord.x + ((rand() % randomMax) - randomMax / 2), mPrevMockRecord.y + ((rand() % randomMax) - randomMax / 2), mPrevMockRecord.z + ((rand() % randomMax) - randomMax / 2));
-		return mPrevMockRecord;
-	}
-}
+	// Acquire the records of all sensors in one call.
+	int errorCode = GetSynchronousRecord(ALL_SENSORS, mFrameRecords.data(), (int)(mFrameRecords.size() * sizeof(mFrameRecords[0])));
+	static int lastErrorCode;
 
-Point3 TrakStarController::GetMockRecordFromFile(int sensorId)
-{
-	// Open the file if not already open.
-	if (!s0MockDataFile.is_open()) {
-		s0MockDataFile.open(s0MockDataFilePath, std::ifstream::in);
-	}
-	if (!s1MockDataFile.is_open()) {
-		s1MockDataFile.open(s1MockDataFilePath, std::ifstream::in);
+	// Check errorCode.
+	try	{
+		ErrorHandler(errorCode);
 	}
-	if (!s2MockDataFile.is_open()) {
-		s2MockDataFile.open(s2MockDataFilePath, std::ifstream::in);
+	catch (ex_trakStar e) {
+		// Only print the error once to prevent flodding the command prompt window.
+		if (errorCode != lastErrorCode)	{
+			std::cerr << e.what() << std::endl;
+		}
+		lastErrorCode = errorCode;
+		std::fill(records->begin(), records->end(), Point3());
+		*refRecord = Point3Ref();
+		return;
 	}
+	lastErrorCode = errorCode;
 
-	// Get the next line from the file.
-	Point3 newPoint;
-	char line[512];
-	if (sensorId == 0 && !s0MockDataFile.getline(line, 512)) {
-		// No more lines to read.
-		// Close the file.
-		s0MockDataFile.close();
-		// Try again.
-		return GetMockRecordFromFile(sensorId);
-	}
-	else if (sensorId == 1 && !s1MockDataFile.getline(line, 512)) {
-		// No more lines to read.
-		// Close the file.
-		s1MockDataFile.close();
-		// Try again.
-		return GetMockRecordFromFile(sensorId);
-	}
-	else if (sensorId == 2 && !s2MockDataFile.getline(line, 512)) {
-		//no more lines to read
-		//close the file
-		s2MockDataFile.close();
-		//try again:
-		return GetMockRecordFromFile(sensorId);
-	}
-	//parse the coorindates from the line:
-	for (int c = 5; c >= 0; c--) {
-		//find the last comma
-		char* found = line;
-		if (c) {
-			found = strrchr(line, ',');
-			++found;
+	// Convert the records of the attached sensors.
+	for (int i = 0; i < mFrameRecords.size(); i++) {
+		if (!pSensor[i].m_config.attached) {
+			(*records)[i] = Point3();
 		}
-
-		//parse the number after that comma:
-		float f = std::atof(found);
-
-		//delete the number from the line
-		if (c) {
-			*(--found) = '\0';
+		else if (i == refId) {
+			*refRecord = ToPoint3Ref(mFrameRecords[i]);
 		}
-
-		//add it to the point:
-		switch (c) {
-			case 0:
-				newPoint.x = f;
-				break;
-			case 1:
-				newPoint.y = f;
-				break;
-			case 2:
-				newPoint.z = f;
-				break;
-			case 3:
-				newPoint.r.x = f;
-				break;
-			case 4:
-				newPoint.r.y = f;
-				break;
-			case 5:
-				newPoint.r.z = f;
-				break;
+		else {
+			(*records)[i] = ToPoint3(mFrameRecords[i]);
 		}
 	}
-	newPoint.button = 1;
-	return newPoint;
+}
+
+Point3 TrakStarController::ToPoint3(const DOUBLE_POSITION_ANGLES_MATRIX_QUATERNION_TIME_Q_BUTTON_RECORD& record) const
+{
+	return Point3(record.x, record.y, record.z, record.r, record.e, record.a, record.quality, record.button);
+}
+
+Point3Ref TrakStarController::ToPoint3Ref(DOUBLE_POSITION_ANGLES_MATRIX_QUATERNION_TIME_Q_BUTTON_RECORD& record) const
+{
+	return Point3Ref(record.x, record.y, record.z, record.s);
 }
 
 void TrakStarController::DeviceStatusHandler(int deviceStatus)
@@ -471,6 +398,9 @@ const std::string TrakStarController::GetErrorString(int error)
 	{
 		error = GetErrorText(error, buffer, sizeof(buffer), SIMPLE_MESSAGE);
 		errorString = buffer;
-		return errorString;
 	}
-}
\ No newline at end of file
+
+	return errorString;
+}
+
+#endif